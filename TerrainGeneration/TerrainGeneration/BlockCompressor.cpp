@@ -0,0 +1,312 @@
+#include "BlockCompressor.h"
+
+#include "Timer.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+namespace
+{
+	struct Color
+	{
+		float r, g, b;
+	};
+
+	inline int quantize(float v, int bits)
+	{
+		int top= (1 << bits) - 1;
+		int q= (int)(v * top / 255.f + 0.5f);
+		return std::min(std::max(q, 0), top);
+	}
+
+	inline unsigned short pack565(const Color &c)
+	{
+		return (unsigned short)(quantize(c.r, 5) << 11 | quantize(c.g, 6) << 5 | quantize(c.b, 5));
+	}
+
+	//the color the hardware decodes the endpoint to
+	inline Color unpack565(unsigned short v)
+	{
+		int r= v >> 11 & 31;
+		int g= v >> 5 & 63;
+		int b= v & 31;
+		Color c= { (float)(r << 3 | r >> 2), (float)(g << 2 | g >> 4), (float)(b << 3 | b >> 2) };
+		return c;
+	}
+
+	inline float distance2(const Color &a, const Color &b)
+	{
+		float dr= a.r - b.r, dg= a.g - b.g, db= a.b - b.b;
+		return dr * dr + dg * dg + db * db;
+	}
+
+	//picks the nearest of the four palette entries for every pixel, returns
+	//the total squared error
+	float assignIndices(const Color *pixels, unsigned short e0, unsigned short e1, int *indices)
+	{
+		Color c0= unpack565(e0), c1= unpack565(e1);
+		Color palette[4]= { c0, c1,
+			{ (2 * c0.r + c1.r) / 3, (2 * c0.g + c1.g) / 3, (2 * c0.b + c1.b) / 3 },
+			{ (c0.r + 2 * c1.r) / 3, (c0.g + 2 * c1.g) / 3, (c0.b + 2 * c1.b) / 3 } };
+		float error= 0.f;
+		for(int i= 0; i < 16; ++i)
+		{
+			int best= 0;
+			float bestDistance= distance2(pixels[i], palette[0]);
+			for(int p= 1; p < 4; ++p)
+			{
+				float d= distance2(pixels[i], palette[p]);
+				if(d < bestDistance)
+				{
+					bestDistance= d;
+					best= p;
+				}
+			}
+			indices[i]= best;
+			error+= bestDistance;
+		}
+		return error;
+	}
+
+	//endpoints that best fit the current indices in the least squares sense
+	bool refineEndpoints(const Color *pixels, const int *indices, Color &c0, Color &c1)
+	{
+		static const float weight[4]= { 1.f, 0.f, 2.f / 3.f, 1.f / 3.f };
+		float aa= 0.f, ab= 0.f, bb= 0.f;
+		Color ax= { 0.f, 0.f, 0.f }, bx= { 0.f, 0.f, 0.f };
+		for(int i= 0; i < 16; ++i)
+		{
+			float a= weight[indices[i]];
+			float b= 1.f - a;
+			aa+= a * a;
+			ab+= a * b;
+			bb+= b * b;
+			ax.r+= a * pixels[i].r; ax.g+= a * pixels[i].g; ax.b+= a * pixels[i].b;
+			bx.r+= b * pixels[i].r; bx.g+= b * pixels[i].g; bx.b+= b * pixels[i].b;
+		}
+		float det= aa * bb - ab * ab;
+		if(fabs(det) < 1e-6f)
+			return false;
+		float inv= 1.f / det;
+		c0.r= (ax.r * bb - bx.r * ab) * inv; c0.g= (ax.g * bb - bx.g * ab) * inv; c0.b= (ax.b * bb - bx.b * ab) * inv;
+		c1.r= (bx.r * aa - ax.r * ab) * inv; c1.g= (bx.g * aa - ax.g * ab) * inv; c1.b= (bx.b * aa - ax.b * ab) * inv;
+		return true;
+	}
+
+	//endpoints at the ends of the block's color range, either its bounding
+	//box diagonal or its principal axis
+	void findEndpoints(const Color *pixels, BlockCompressor::Quality quality, Color &c0, Color &c1)
+	{
+		Color lo= pixels[0], hi= pixels[0];
+		Color mean= { 0.f, 0.f, 0.f };
+		for(int i= 0; i < 16; ++i)
+		{
+			lo.r= std::min(lo.r, pixels[i].r); lo.g= std::min(lo.g, pixels[i].g); lo.b= std::min(lo.b, pixels[i].b);
+			hi.r= std::max(hi.r, pixels[i].r); hi.g= std::max(hi.g, pixels[i].g); hi.b= std::max(hi.b, pixels[i].b);
+			mean.r+= pixels[i].r; mean.g+= pixels[i].g; mean.b+= pixels[i].b;
+		}
+		if(quality == BlockCompressor::FAST)
+		{
+			//pull the box in a little, the ends are rarely hit exactly
+			Color inset= { (hi.r - lo.r) / 16, (hi.g - lo.g) / 16, (hi.b - lo.b) / 16 };
+			c0.r= hi.r - inset.r; c0.g= hi.g - inset.g; c0.b= hi.b - inset.b;
+			c1.r= lo.r + inset.r; c1.g= lo.g + inset.g; c1.b= lo.b + inset.b;
+
+			//the box diagonal may have to run the other way in green or blue
+			float cov[2]= { 0.f, 0.f };
+			mean.r/= 16; mean.g/= 16; mean.b/= 16;
+			for(int i= 0; i < 16; ++i)
+			{
+				float dr= pixels[i].r - mean.r;
+				cov[0]+= dr * (pixels[i].g - mean.g);
+				cov[1]+= dr * (pixels[i].b - mean.b);
+			}
+			if(cov[0] < 0.f)
+				std::swap(c0.g, c1.g);
+			if(cov[1] < 0.f)
+				std::swap(c0.b, c1.b);
+			return;
+		}
+
+		mean.r/= 16; mean.g/= 16; mean.b/= 16;
+		float cov[6]= { 0.f, 0.f, 0.f, 0.f, 0.f, 0.f };
+		for(int i= 0; i < 16; ++i)
+		{
+			float r= pixels[i].r - mean.r, g= pixels[i].g - mean.g, b= pixels[i].b - mean.b;
+			cov[0]+= r * r; cov[1]+= r * g; cov[2]+= r * b;
+			cov[3]+= g * g; cov[4]+= g * b; cov[5]+= b * b;
+		}
+		//power iteration from the box diagonal
+		Color axis= { hi.r - lo.r, hi.g - lo.g, hi.b - lo.b };
+		for(int k= 0; k < 8; ++k)
+		{
+			Color next= { cov[0] * axis.r + cov[1] * axis.g + cov[2] * axis.b,
+				cov[1] * axis.r + cov[3] * axis.g + cov[4] * axis.b,
+				cov[2] * axis.r + cov[4] * axis.g + cov[5] * axis.b };
+			float length= std::max(std::max(fabs(next.r), fabs(next.g)), fabs(next.b));
+			if(length < 1e-6f)
+				break;
+			axis.r= next.r / length; axis.g= next.g / length; axis.b= next.b / length;
+		}
+		float minT= 1e30f, maxT= -1e30f;
+		for(int i= 0; i < 16; ++i)
+		{
+			float t= (pixels[i].r - mean.r) * axis.r + (pixels[i].g - mean.g) * axis.g + (pixels[i].b - mean.b) * axis.b;
+			minT= std::min(minT, t);
+			maxT= std::max(maxT, t);
+		}
+		float length2= axis.r * axis.r + axis.g * axis.g + axis.b * axis.b;
+		if(length2 < 1e-12f)
+		{
+			c0= c1= mean;
+			return;
+		}
+		minT/= length2;
+		maxT/= length2;
+		c0.r= mean.r + axis.r * maxT; c0.g= mean.g + axis.g * maxT; c0.b= mean.b + axis.b * maxT;
+		c1.r= mean.r + axis.r * minT; c1.g= mean.g + axis.g * minT; c1.b= mean.b + axis.b * minT;
+	}
+
+	inline void writeShort(GLubyte *out, unsigned short v)
+	{
+		out[0]= (GLubyte)v;
+		out[1]= (GLubyte)(v >> 8);
+	}
+
+	//8 bytes, both endpoints then 2 bits a pixel, always in four color mode
+	void encodeColor(const Color *pixels, BlockCompressor::Quality quality, GLubyte *out)
+	{
+		Color c0, c1;
+		findEndpoints(pixels, quality, c0, c1);
+		unsigned short e0= pack565(c0), e1= pack565(c1);
+		int indices[16];
+		float error= assignIndices(pixels, e0, e1, indices);
+
+		if(quality == BlockCompressor::HIGH)
+		{
+			for(int pass= 0; pass < 2 && error > 0.f; ++pass)
+			{
+				Color r0, r1;
+				if(!refineEndpoints(pixels, indices, r0, r1))
+					break;
+				unsigned short f0= pack565(r0), f1= pack565(r1);
+				int refined[16];
+				float refinedError= assignIndices(pixels, f0, f1, refined);
+				if(refinedError >= error)
+					break;
+				e0= f0;
+				e1= f1;
+				error= refinedError;
+				memcpy(indices, refined, sizeof(indices));
+			}
+		}
+
+		//e0 > e1 selects four colors, swapping the ends swaps index 0 with 1
+		//and 2 with 3, equal ends give one color and every index 0
+		if(e0 < e1)
+		{
+			std::swap(e0, e1);
+			for(int i= 0; i < 16; ++i)
+				indices[i]^= 1;
+		}
+		else if(e0 == e1)
+		{
+			for(int i= 0; i < 16; ++i)
+				indices[i]= 0;
+		}
+
+		unsigned int bits= 0;
+		for(int i= 0; i < 16; ++i)
+			bits|= (unsigned int)indices[i] << (i * 2);
+		writeShort(out, e0);
+		writeShort(out + 2, e1);
+		out[4]= (GLubyte)bits;
+		out[5]= (GLubyte)(bits >> 8);
+		out[6]= (GLubyte)(bits >> 16);
+		out[7]= (GLubyte)(bits >> 24);
+	}
+
+	//8 bytes, two alpha ends with a0 > a1 for the eight step ramp, then
+	//3 bits a pixel
+	void encodeAlpha(const GLubyte *alpha, GLubyte *out)
+	{
+		int a0= alpha[0], a1= alpha[0];
+		for(int i= 1; i < 16; ++i)
+		{
+			a0= std::max(a0, (int)alpha[i]);
+			a1= std::min(a1, (int)alpha[i]);
+		}
+		unsigned long long bits= 0;
+		if(a0 > a1)
+		{
+			for(int i= 0; i < 16; ++i)
+			{
+				//step 7 is a0 and step 0 is a1, the ones between are codes 6 to 2
+				int step= (int)((alpha[i] - a1) * 7.f / (a0 - a1) + 0.5f);
+				int code= step == 7 ? 0 : (step == 0 ? 1 : 8 - step);
+				bits|= (unsigned long long)code << (i * 3);
+			}
+		}
+		out[0]= (GLubyte)a0;
+		out[1]= (GLubyte)a1;
+		for(int b= 0; b < 6; ++b)
+			out[2 + b]= (GLubyte)(bits >> (b * 8));
+	}
+}
+
+BlockCompressor::BlockCompressor()
+{
+	stats.blocks= 0;
+	stats.bytes= 0;
+	stats.encodeMs= 0.0;
+}
+
+size_t BlockCompressor::compressedSize(int width, int height, Format format)
+{
+	size_t blocks= (size_t)((width + 3) / 4) * ((height + 3) / 4);
+	return blocks * (format == BC1 ? 8 : 16);
+}
+
+GLenum BlockCompressor::glFormat(Format format)
+{
+	return format == BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+}
+
+void BlockCompressor::compress(const GLubyte *rgba, int width, int height, Format format, Quality quality,
+	ThreadPool &pool, std::vector<GLubyte> &out)
+{
+	Timer timer;
+	int blocksX= (width + 3) / 4;
+	int blocksY= (height + 3) / 4;
+	int blockBytes= format == BC1 ? 8 : 16;
+	out.resize(compressedSize(width, height, format));
+
+	pool.parallelFor(0, blocksY, [&](int by) {
+		Color pixels[16];
+		GLubyte alpha[16];
+		for(int bx= 0; bx < blocksX; ++bx)
+		{
+			for(int i= 0; i < 16; ++i)
+			{
+				int x= std::min(bx * 4 + (i & 3), width - 1);
+				int y= std::min(by * 4 + (i >> 2), height - 1);
+				const GLubyte *p= rgba + ((size_t)y * width + x) * 4;
+				pixels[i].r= p[0];
+				pixels[i].g= p[1];
+				pixels[i].b= p[2];
+				alpha[i]= p[3];
+			}
+			GLubyte *block= &out[((size_t)by * blocksX + bx) * blockBytes];
+			if(format == BC3)
+			{
+				encodeAlpha(alpha, block);
+				block+= 8;
+			}
+			encodeColor(pixels, quality, block);
+		}
+	});
+
+	stats.blocks= blocksX * blocksY;
+	stats.bytes= out.size();
+	stats.encodeMs= timer.elapsedMs();
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "GLIncludes.h"
+#include "ThreadPool.h"
+#include <vector>
+
+//BC1 and BC3 (DXT1 / DXT5) encoder for 8 bit rgba images
+//every 4x4 block is encoded on its own, rows of blocks are spread over the
+//pool, partial blocks at the right and top edge repeat their last pixels
+class BlockCompressor
+{
+public:
+	enum Format
+	{
+		//opaque color, 8 bytes a block
+		BC1,
+		//color and interpolated alpha, 16 bytes a block
+		BC3
+	};
+
+	enum Quality
+	{
+		//endpoints from the bounding box of the block's colors
+		FAST,
+		//endpoints along the principal axis, refined by least squares
+		HIGH
+	};
+
+	struct Stats
+	{
+		int blocks;
+		size_t bytes;
+		double encodeMs;
+	};
+
+private:
+	Stats stats;
+
+public:
+	BlockCompressor();
+
+	//compressed data for a width x height image, blocks in row order
+	void compress(const GLubyte *rgba, int width, int height, Format format, Quality quality, ThreadPool &pool,
+		std::vector<GLubyte> &out);
+
+	static size_t compressedSize(int width, int height, Format format);
+	//internal format to hand to glTexStorage2D
+	static GLenum glFormat(Format format);
+
+	const Stats& getStats() const { return stats; }
+};
\ No newline at end of file
@@ -0,0 +1,322 @@
+#include "ContourLines.h"
+
+#include "Timer.h"
+#include <algorithm>
+#include <stdio.h>
+#include <iostream>
+using std::cerr;
+using std::endl;
+
+namespace
+{
+	//a crossing is named by the grid edge it lies on: the lower grid point
+	//and whether the edge runs along x (0) or z (1)
+	inline unsigned long long edgeKey(int x, int z, int depth, int axis)
+	{
+		return ((unsigned long long)x * depth + z) << 1 | axis;
+	}
+
+	//where the contour at level crosses the edge named by key
+	vec3 crossingPosition(unsigned long long key, const float *h, int depth, float level)
+	{
+		int cell= (int)(key >> 1);
+		int x= cell / depth;
+		int z= cell % depth;
+		float a= h[cell];
+		if(key & 1)
+		{
+			float t= (level - a) / (h[cell + 1] - a);
+			return vec3((float)x, level, z + t);
+		}
+		float t= (level - a) / (h[cell + depth] - a);
+		return vec3(x + t, level, (float)z);
+	}
+
+	//open addressing map from edge key to segment index
+	class EdgeTable
+	{
+	private:
+		std::vector<unsigned long long> keys;
+		std::vector<int> values;
+		unsigned long long mask;
+
+		size_t slot(unsigned long long key) const
+		{
+			return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 20 & mask);
+		}
+
+	public:
+		explicit EdgeTable(size_t count)
+		{
+			size_t capacity= 16;
+			while(capacity < count * 2)
+				capacity<<= 1;
+			keys.assign(capacity, ~0ull);
+			values.assign(capacity, -1);
+			mask= capacity - 1;
+		}
+
+		void insert(unsigned long long key, int value)
+		{
+			size_t i= slot(key);
+			while(keys[i] != ~0ull)
+				i= (i + 1) & mask;
+			keys[i]= key;
+			values[i]= value;
+		}
+
+		int find(unsigned long long key) const
+		{
+			for(size_t i= slot(key); keys[i] != ~0ull; i= (i + 1) & mask)
+			{
+				if(keys[i] == key)
+					return values[i];
+			}
+			return -1;
+		}
+	};
+}
+
+const GLuint ContourLines::RESTART_INDEX;
+
+ContourLines::ContourLines() : vaoHandle(0), vertexBuffer(0), elementBuffer(0), numOfElements(0)
+{
+	stats.levels= 0;
+	stats.segments= 0;
+	stats.polylines= 0;
+	stats.vertices= 0;
+	stats.extractMs= 0.0;
+	stats.stitchMs= 0.0;
+}
+
+ContourLines::~ContourLines()
+{
+	if(vaoHandle == 0)
+		return;
+	glDeleteVertexArrays(1, &vaoHandle);
+	glDeleteBuffers(1, &vertexBuffer);
+	glDeleteBuffers(1, &elementBuffer);
+}
+
+void ContourLines::extractRow(const HeightField &field, const std::vector<float> &levels, int x, std::vector<Segment> &out) const
+{
+	const int depth= field.getDepth();
+	const float *row0= field.heightData() + x * depth;
+	const float *row1= row0 + depth;
+
+	for(int z= 0; z < depth - 1; ++z)
+	{
+		//corners counter clockwise: (x, z), (x+1, z), (x+1, z+1), (x, z+1)
+		float h[4]= {row0[z], row1[z], row1[z + 1], row0[z + 1]};
+		float lo= std::min(std::min(h[0], h[1]), std::min(h[2], h[3]));
+		float hi= std::max(std::max(h[0], h[1]), std::max(h[2], h[3]));
+
+		//only the levels strictly above the lowest corner and at most the
+		//highest one cross this cell
+		std::vector<float>::const_iterator it= std::upper_bound(levels.begin(), levels.end(), lo);
+		if(it == levels.end() || *it > hi)
+			continue;
+
+		//edge k runs from corner k to corner k+1
+		unsigned long long edges[4]=
+		{
+			edgeKey(x, z, depth, 0),
+			edgeKey(x + 1, z, depth, 1),
+			edgeKey(x, z + 1, depth, 0),
+			edgeKey(x, z, depth, 1)
+		};
+
+		for(; it != levels.end() && *it <= hi; ++it)
+		{
+			float level= *it;
+			bool in[4]= {h[0] >= level, h[1] >= level, h[2] >= level, h[3] >= level};
+
+			//segments always go from the edge where the contour enters the
+			//solid region to the one where it leaves, so neighbours agree on direction
+			for(int k= 0; k < 4; ++k)
+			{
+				if(in[k] || !in[(k + 1) & 3])
+					continue;
+
+				//follow the run of high corners to the edge where it ends
+				int exitEdge;
+				if(!in[(k + 2) & 3])
+				{
+					exitEdge= (k + 1) & 3;
+					//saddle, a high center joins the two high corners instead
+					if(in[(k + 3) & 3] && (h[0] + h[1] + h[2] + h[3]) * 0.25f >= level)
+						exitEdge= (k + 3) & 3;
+				}
+				else if(!in[(k + 3) & 3])
+				{
+					exitEdge= (k + 2) & 3;
+				}
+				else
+				{
+					exitEdge= (k + 3) & 3;
+				}
+
+				Segment s;
+				s.level= (int)(it - levels.begin());
+				s.from= edges[k];
+				s.to= edges[exitEdge];
+				out.push_back(s);
+			}
+		}
+	}
+}
+
+void ContourLines::stitchLevel(const HeightField &field, float level, const std::vector<Segment> &segments,
+	std::vector<vec3> &outVerts, std::vector<GLuint> &outIndices) const
+{
+	const int depth= field.getDepth();
+	const float *h= field.heightData();
+
+	EdgeTable byFrom(segments.size());
+	EdgeTable byTo(segments.size());
+	for(size_t i= 0; i < segments.size(); ++i)
+	{
+		byFrom.insert(segments[i].from, (int)i);
+		byTo.insert(segments[i].to, (int)i);
+	}
+
+	std::vector<char> visited(segments.size(), 0);
+
+	//open polylines first, starting from segments nothing leads into, then
+	//whatever is left over forms closed loops
+	for(int pass= 0; pass < 2; ++pass)
+	{
+		for(size_t i= 0; i < segments.size(); ++i)
+		{
+			if(visited[i] || (pass == 0 && byTo.find(segments[i].from) >= 0))
+				continue;
+
+			outIndices.push_back((GLuint)outVerts.size());
+			outVerts.push_back(crossingPosition(segments[i].from, h, depth, level));
+
+			for(int s= (int)i; s >= 0 && !visited[s]; s= byFrom.find(segments[s].to))
+			{
+				visited[s]= 1;
+				outIndices.push_back((GLuint)outVerts.size());
+				outVerts.push_back(crossingPosition(segments[s].to, h, depth, level));
+			}
+			outIndices.push_back(RESTART_INDEX);
+		}
+	}
+}
+
+void ContourLines::extract(const HeightField &field, const std::vector<float> &unsortedLevels, ThreadPool &pool)
+{
+	std::vector<float> levels(unsortedLevels);
+	std::sort(levels.begin(), levels.end());
+	levels.erase(std::unique(levels.begin(), levels.end()), levels.end());
+
+	//marching squares, one task per grid row
+	Timer timer;
+	int rows= field.getWidth() - 1;
+	std::vector<std::vector<Segment> > rowSegments(rows > 0 ? rows : 0);
+	pool.parallelFor(0, rows, [&](int x) { extractRow(field, levels, x, rowSegments[x]); }, 8);
+	stats.extractMs= timer.elapsedMs();
+
+	//bucket by level, then every level is stitched independently
+	timer.reset();
+	std::vector<std::vector<Segment> > levelSegments(levels.size());
+	int totalSegments= 0;
+	for(int x= 0; x < rows; ++x)
+	{
+		for(size_t i= 0; i < rowSegments[x].size(); ++i)
+			levelSegments[rowSegments[x][i].level].push_back(rowSegments[x][i]);
+		totalSegments+= (int)rowSegments[x].size();
+		std::vector<Segment>().swap(rowSegments[x]);
+	}
+
+	std::vector<std::vector<vec3> > levelVerts(levels.size());
+	std::vector<std::vector<GLuint> > levelIndices(levels.size());
+	pool.parallelFor(0, (int)levels.size(), [&](int l) {
+		stitchLevel(field, levels[l], levelSegments[l], levelVerts[l], levelIndices[l]);
+	});
+
+	vertices.clear();
+	indices.clear();
+	int polylines= 0;
+	for(size_t l= 0; l < levels.size(); ++l)
+	{
+		GLuint base= (GLuint)vertices.size();
+		vertices.insert(vertices.end(), levelVerts[l].begin(), levelVerts[l].end());
+		for(size_t i= 0; i < levelIndices[l].size(); ++i)
+		{
+			if(levelIndices[l][i] == RESTART_INDEX)
+			{
+				indices.push_back(RESTART_INDEX);
+				++polylines;
+			}
+			else
+			{
+				indices.push_back(base + levelIndices[l][i]);
+			}
+		}
+	}
+	stats.stitchMs= timer.elapsedMs();
+
+	stats.levels= (int)levels.size();
+	stats.segments= totalSegments;
+	stats.polylines= polylines;
+	stats.vertices= (int)vertices.size();
+
+	printf("Contours: %d levels, %d segments -> %d polylines, extract %.2f ms, stitch %.2f ms\n",
+		stats.levels, stats.segments, stats.polylines, stats.extractMs, stats.stitchMs);
+}
+
+void ContourLines::upload()
+{
+	if(vaoHandle == 0)
+	{
+		try
+		{
+			prog.compileShader("shaders/contour.vert", GLSLShader::VERTEX);
+			prog.compileShader("shaders/contour.frag", GLSLShader::FRAGMENT);
+			prog.link();
+		}
+		catch(GLSLProgramException &e)
+		{
+			cerr<<e.what()<<endl;
+			exit(EXIT_FAILURE);
+		}
+
+		glGenVertexArrays(1, &vaoHandle);
+		glGenBuffers(1, &vertexBuffer);
+		glGenBuffers(1, &elementBuffer);
+
+		glBindVertexArray(vaoHandle);
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+		glBindVertexArray(0);
+	}
+
+	numOfElements= (int)indices.size();
+	if(numOfElements == 0)
+		return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vec3), &vertices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+}
+
+void ContourLines::Render(const mat4 &mvp)
+{
+	if(numOfElements == 0)
+		return;
+
+	prog.use();
+	prog.setUniform("MVP", mvp);
+
+	//RESTART_INDEX is the fixed restart index for GL_UNSIGNED_INT
+	glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+	glBindVertexArray(vaoHandle);
+	glDrawElements(GL_LINE_STRIP, numOfElements, GL_UNSIGNED_INT, (void*)0);
+	glBindVertexArray(0);
+	glDisable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+}
\ No newline at end of file
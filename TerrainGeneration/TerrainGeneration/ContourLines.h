@@ -0,0 +1,67 @@
+#pragma once
+
+#include "GLSLProgram.h"
+#include "HeightField.h"
+#include "ThreadPool.h"
+#include <vector>
+#include <glm/glm.hpp>
+using glm::vec3;
+using glm::mat4;
+
+//elevation contours over the height field grid, extracted with marching squares
+//the result is a single line strip buffer with primitive restarts between polylines
+class ContourLines
+{
+public:
+	static const GLuint RESTART_INDEX= 0xFFFFFFFF;
+
+	struct Stats
+	{
+		int levels;
+		int segments;
+		int polylines;
+		int vertices;
+		double extractMs;
+		double stitchMs;
+	};
+
+private:
+	//one cell crossing, from and to are edge keys, see edgeKey in the .cpp
+	struct Segment
+	{
+		int level;
+		unsigned long long from;
+		unsigned long long to;
+	};
+
+	std::vector<vec3> vertices;
+	std::vector<GLuint> indices;
+
+	GLuint vaoHandle;
+	GLuint vertexBuffer;
+	GLuint elementBuffer;
+	int numOfElements;
+	Stats stats;
+
+	void extractRow(const HeightField &field, const std::vector<float> &levels, int x, std::vector<Segment> &out) const;
+	void stitchLevel(const HeightField &field, float level, const std::vector<Segment> &segments,
+		std::vector<vec3> &outVerts, std::vector<GLuint> &outIndices) const;
+
+public:
+	GLSLProgram prog;
+
+	ContourLines();
+	~ContourLines();
+
+	//levels don't need to be sorted, every level becomes a set of polylines
+	void extract(const HeightField &field, const std::vector<float> &levels, ThreadPool &pool);
+
+	//copies the last extraction into gl buffers, compiling the shaders on first use
+	void upload();
+
+	void Render(const mat4 &mvp);
+
+	const std::vector<vec3>& getVertices() const { return vertices; }
+	const std::vector<GLuint>& getIndices() const { return indices; }
+	const Stats& getStats() const { return stats; }
+};
\ No newline at end of file
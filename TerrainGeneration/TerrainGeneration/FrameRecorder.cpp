@@ -0,0 +1,81 @@
+#include "FrameRecorder.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+FrameRecorder::FrameRecorder() : maxFrames(0), frame(0), policy(DROP), maxWaitMs(0.0), recording(false)
+{
+	stats.recorded= 0;
+	stats.dropped= 0;
+	stats.waited= 0;
+	stats.waitMs= 0.0;
+	stats.maxFrameMs= 0.0;
+	stats.recordMs= 0.0;
+}
+
+void FrameRecorder::Create(int ringFrames, int width, int height, int encoders)
+{
+	capture.Create(ringFrames, width, height, encoders);
+	capture.setVerbose(false);
+}
+
+void FrameRecorder::Destroy()
+{
+	if(recording)
+		stop();
+	capture.Destroy();
+}
+
+void FrameRecorder::start(const char *filePrefix, int numFrames, Policy framePolicy, double waitMs)
+{
+	prefix= filePrefix;
+	maxFrames= numFrames;
+	policy= framePolicy;
+	maxWaitMs= waitMs;
+	frame= 0;
+	recording= true;
+	stats.recorded= 0;
+	stats.dropped= 0;
+	stats.waited= 0;
+	stats.waitMs= 0.0;
+	stats.maxFrameMs= 0.0;
+	stats.recordMs= 0.0;
+	clock.reset();
+	printf("FrameRecorder: recording %d frames to %s####.tga\n", maxFrames, prefix.c_str());
+}
+
+void FrameRecorder::stop()
+{
+	//frames still in flight are finished by the following updates
+	recording= false;
+	stats.recordMs= clock.elapsedMs();
+	printf("FrameRecorder: %d frames recorded, %d dropped, %d waited %.1f ms in all, slowest frame %.2f ms, %.1f s\n",
+		stats.recorded, stats.dropped, stats.waited, stats.waitMs, stats.maxFrameMs, stats.recordMs * 0.001);
+}
+
+void FrameRecorder::captureFrame(int width, int height)
+{
+	Timer timer;
+	capture.update();
+	if(recording)
+	{
+		char fileName[512];
+		sprintf(fileName, "%s%04d.tga", prefix.c_str(), frame++);
+		bool queued= capture.request(fileName, width, height);
+		if(!queued && policy == BACKPRESSURE)
+		{
+			Timer wait;
+			++stats.waited;
+			if(capture.waitForSlot(maxWaitMs))
+				queued= capture.request(fileName, width, height);
+			stats.waitMs+= wait.elapsedMs();
+		}
+		if(queued)
+			++stats.recorded;
+		else
+			++stats.dropped;
+		if(frame >= maxFrames)
+			stop();
+	}
+	stats.maxFrameMs= std::max(stats.maxFrameMs, timer.elapsedMs());
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "ScreenCapture.h"
+#include "Timer.h"
+#include <string>
+
+//records a run of frames to numbered TGA files for reviewing flythroughs
+//frames go through a preallocated ring of readback buffers and are encoded
+//by a set of writer threads, when the ring is full the frame is either
+//dropped or the render loop waits a bounded time for a buffer, and both
+//are counted, so a slow disk never stalls rendering for long
+class FrameRecorder
+{
+public:
+	enum Policy
+	{
+		//skip the frame when no buffer is free
+		DROP,
+		//wait up to maxWaitMs for a buffer, then drop
+		BACKPRESSURE
+	};
+
+	struct Stats
+	{
+		int recorded;
+		int dropped;
+		//frames that had to wait for a buffer, and the total time waited
+		int waited;
+		double waitMs;
+		//slowest render thread time spent on one frame
+		double maxFrameMs;
+		double recordMs;
+	};
+
+private:
+	ScreenCapture capture;
+	std::string prefix;
+	int maxFrames;
+	int frame;
+	Policy policy;
+	double maxWaitMs;
+	bool recording;
+	Timer clock;
+	Stats stats;
+
+public:
+	FrameRecorder();
+
+	//ringFrames buffers of width x height frames are allocated up front,
+	//encoders files are written at once
+	void Create(int ringFrames, int width, int height, int encoders);
+	//finishes the frames in flight, needs the context
+	void Destroy();
+
+	//frames are written to prefix0000.tga on, a dropped frame leaves a gap in
+	//the numbers, recording stops by itself after maxFrames
+	void start(const char *prefix, int maxFrames, Policy policy, double maxWaitMs);
+	void stop();
+	bool isRecording() const { return recording; }
+
+	//once a frame after drawing, captures the back buffer while recording and
+	//recycles the buffers of frames already written
+	void captureFrame(int width, int height);
+
+	const Stats& getStats() const { return stats; }
+};
\ No newline at end of file
@@ -1,34 +1,102 @@
 #include "HeightField.h"
 
-#include "tgaio.h"
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
 #include <iostream>
+#include <glm/gtc/matrix_transform.hpp>
 using std::cerr;
 using std::endl;
 
+//image rows run along x and columns along z, the same order as the raw
+//files, 16 bit samples are scaled into the 0-255 range of the 8 bit maps
+bool HeightField::loadTGAHeights(const char *fileName)
+{
+	int width, height;
+	TGAIO::PixelFormat format;
+	GLubyte *data;
+	try
+	{
+		data= TGAIO::readNative(fileName, width, height, format);
+	}
+	catch(TGAIO::IOException &e)
+	{
+		cerr<<"HeightField: "<<e.what()<<endl;
+		return false;
+	}
+	if(format != TGAIO::GRAY8 && format != TGAIO::GRAY16)
+	{
+		cerr<<"HeightField: "<<fileName<<" is not a grayscale TGA"<<endl;
+		delete[] data;
+		return false;
+	}
+
+	hmWidth= height;
+	hmHeight= width;
+	heights.resize(width * height);
+	const unsigned short *samples= (const unsigned short*)data;
+	for(size_t i= 0; i < heights.size(); ++i)
+		heights[i]= format == TGAIO::GRAY8 ? (float)data[i] : samples[i] / 257.f;
+	delete[] data;
+	return true;
+}
+
 bool HeightField::Create(char *hFileName, int hWidth, int hHeight)
 {
-	hmWidth= hWidth;
-	hmHeight= hHeight;
-	unsigned char buffer;
-
-	FILE *fp;
-
-	fp= fopen(hFileName, "rb");
-	
-	//read in vertices from texture
-	//can be optimized by just loading texture??
-	//consider this first/simplest attempt with height maps
-	std::vector<glm::vec3> Vertices;
-	for(int hMapX= 0; hMapX < hWidth; ++hMapX)
+	size_t nameLength= strlen(hFileName);
+	if(nameLength > 4 && (strcmp(hFileName + nameLength - 4, ".tga") == 0 || strcmp(hFileName + nameLength - 4, ".TGA") == 0))
 	{
-		for(int hMapZ= 0; hMapZ < hHeight; ++hMapZ)
+		if(!loadTGAHeights(hFileName))
+			return false;
+	}
+	else
+	{
+		hmWidth= hWidth;
+		hmHeight= hHeight;
+		unsigned char buffer;
+
+		FILE *fp;
+
+		fp= fopen(hFileName, "rb");
+
+		//read in heights from texture
+		//can be optimized by just loading texture??
+		//consider this first/simplest attempt with height maps
+		heights.resize(hWidth * hHeight);
+		for(int hMapX= 0; hMapX < hWidth; ++hMapX)
 		{
-			fread(&buffer, 1, 1, fp);
-			Vertices.push_back(vec3(hMapX, int(buffer), hMapZ));
+			for(int hMapZ= 0; hMapZ < hHeight; ++hMapZ)
+			{
+				fread(&buffer, 1, 1, fp);
+				heights[hMapX * hHeight + hMapZ]= float(buffer);
+			}
+		}
+		fclose(fp);
+	}
+	hWidth= hmWidth;
+	hHeight= hmHeight;
+
+	//the grid is cut into tiles of TILE_QUADS quads, every tile's vertices are
+	//relative to its own corner so they stay small however far out the map sits
+	//tiles on the far edges repeat the last row and column, which only adds
+	//triangles with no area
+	tileVerts= TILE_QUADS + 1;
+	buildTiles();
+	std::vector<vec3> Vertices;
+	Vertices.reserve(tiles.size() * tileVerts * tileVerts);
+	for(size_t t= 0; t < tiles.size(); ++t)
+	{
+		const Tile &tile= tiles[t];
+		for(int i= 0; i < tileVerts; ++i)
+		{
+			for(int j= 0; j < tileVerts; ++j)
+			{
+				int x= glm::min(tile.gridX + i, hWidth - 1);
+				int z= glm::min(tile.gridZ + j, hHeight - 1);
+				Vertices.push_back(vec3(x - tile.gridX, heightAt(x, z), z - tile.gridZ));
+			}
 		}
 	}
-	fclose(fp);
 
 	//load number of vertices for glDrawArrays
 	numOfVerts= Vertices.size();
@@ -38,23 +106,12 @@ bool HeightField::Create(char *hFileName, int hWidth, int hHeight)
 	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
 	glBufferData(GL_ARRAY_BUFFER, Vertices.size() * sizeof(vec3), &Vertices[0], GL_STATIC_DRAW);
 
-	generateElementArrayBuffer(Vertices);
-
-	//load texture for terrain
-	GLint w, h;
-	glActiveTexture(GL_TEXTURE0);
-	GLubyte* data= TGAIO::read("texture.tga", w, h);
-	
-	GLuint texID;
-	glGenTextures(1, &texID);
-
-	glBindTexture(GL_TEXTURE_2D, texID);
-	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, w, h);
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, data);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	generateElementArrayBuffer(tileVerts);
 
-	delete[] data;
+	//load texture for terrain, the first frames draw with its coarse levels
+	//while the rest streams in, a quarter megabyte a frame, texture.jpg is
+	//the same picture as texture.tga at a quarter of the size on disk
+	texture.Create("texture.jpg", BlockCompressor::FAST, 256 << 10, TextureCache::shared());
 
 	glGenVertexArrays(1, &vaoHandle);
 	glBindVertexArray(vaoHandle);
@@ -63,15 +120,96 @@ bool HeightField::Create(char *hFileName, int hWidth, int hHeight)
 	return true;
 }
 
-void HeightField::Render(void)
+void HeightField::CreateUpsampled(const HeightField &source, int factor)
+{
+	hmWidth= source.hmWidth * factor;
+	hmHeight= source.hmHeight * factor;
+	heights.resize(hmWidth * hmHeight);
+	for(int x= 0; x < hmWidth; ++x)
+	{
+		for(int z= 0; z < hmHeight; ++z)
+			heights[x * hmHeight + z]= source.sampleHeight((float)x / factor, (float)z / factor);
+	}
+	buildTiles();
+	origin= source.origin;
+}
+
+void HeightField::buildTiles()
+{
+	int tilesX= (hmWidth - 2) / TILE_QUADS + 1;
+	int tilesZ= (hmHeight - 2) / TILE_QUADS + 1;
+	tiles.clear();
+	for(int tx= 0; tx < tilesX; ++tx)
+	{
+		for(int tz= 0; tz < tilesZ; ++tz)
+		{
+			Tile tile;
+			tile.gridX= tx * TILE_QUADS;
+			tile.gridZ= tz * TILE_QUADS;
+			tile.minHeight= 1e30f;
+			tile.maxHeight= -1e30f;
+			for(int x= tile.gridX; x <= tile.gridX + TILE_QUADS; ++x)
+			{
+				for(int z= tile.gridZ; z <= tile.gridZ + TILE_QUADS; ++z)
+				{
+					float h= heightAt(x, z);
+					tile.minHeight= glm::min(tile.minHeight, h);
+					tile.maxHeight= glm::max(tile.maxHeight, h);
+				}
+			}
+			tiles.push_back(tile);
+		}
+	}
+}
+
+void HeightField::Destroy()
+{
+	texture.Destroy();
+}
+
+float HeightField::heightAt(int x, int z) const
+{
+	x= x < 0 ? 0 : (x >= hmWidth ? hmWidth - 1 : x);
+	z= z < 0 ? 0 : (z >= hmHeight ? hmHeight - 1 : z);
+	return heights[x * hmHeight + z];
+}
+
+float HeightField::sampleHeight(float x, float z) const
+{
+	int x0= (int)floor(x);
+	int z0= (int)floor(z);
+	float fx= x - x0;
+	float fz= z - z0;
+
+	float h00= heightAt(x0, z0);
+	float h10= heightAt(x0 + 1, z0);
+	float h01= heightAt(x0, z0 + 1);
+	float h11= heightAt(x0 + 1, z0 + 1);
+
+	float h0= h00 + (h10 - h00) * fx;
+	float h1= h01 + (h11 - h01) * fx;
+	return h0 + (h1 - h0) * fz;
+}
+
+//the tile offsets are taken from the camera in double and only then turned
+//into floats, so the vertices never see large world coordinates
+void HeightField::Render(const mat4 &viewProjection, const dvec3 &cameraPos)
 {
 	glBindVertexArray(vaoHandle);
 	glEnableVertexAttribArray(0);
 	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+	glActiveTexture(GL_TEXTURE0);
+	texture.update();
 	prog.use();
-	glDrawElements(GL_TRIANGLE_STRIP, numOfElements, GL_UNSIGNED_INT, (void*) 0);
+	for(size_t t= 0; t < tiles.size(); ++t)
+	{
+		vec3 offset= vec3(tileOrigin(tiles[t]) - cameraPos);
+		prog.setUniform("MVP", viewProjection * glm::translate(mat4(1.0f), offset));
+		prog.setUniform("TileOrigin", glm::vec2((float)tiles[t].gridX, (float)tiles[t].gridZ));
+		glDrawElementsBaseVertex(GL_TRIANGLE_STRIP, numOfElements, GL_UNSIGNED_INT, (void*)0, (GLint)(t * tileVerts * tileVerts));
+	}
 	glDisableVertexAttribArray(0);
 	glBindVertexArray(0);
 }
@@ -92,24 +230,25 @@ void HeightField::compileAndLinkShaders()
 	}
 }
 
-void HeightField::generateElementArrayBuffer(const std::vector<vec3> Verts)
+//one triangle strip over a tile, shared by all of them
+void HeightField::generateElementArrayBuffer(int verts)
 {
 
 	std::vector<unsigned int> indices;
-	for(int y= 0; y < hmHeight - 1;  ++y)
+	for(int y= 0; y < verts - 1;  ++y)
 	{
 		if( y > 0)
 		{
-			indices.push_back(y * hmWidth);
+			indices.push_back(y * verts);
 		}
-		for(int x= 0; x < hmWidth; ++x)
+		for(int x= 0; x < verts; ++x)
 		{
-			indices.push_back(y * hmWidth + x);
-			indices.push_back((y+1) * hmWidth + x);
+			indices.push_back(y * verts + x);
+			indices.push_back((y+1) * verts + x);
 		}
-		if(y < hmHeight - 2)
+		if(y < verts - 2)
 		{
-			indices.push_back(((y+1) * hmWidth) + (hmWidth-1));
+			indices.push_back(((y+1) * verts) + (verts-1));
 		}
 	}
 
@@ -1,12 +1,28 @@
 #pragma once
 
 #include "GLSLProgram.h"
+#include "ProgressiveTexture.h"
 #include <vector>
 #include <glm\glm.hpp>
 using glm::vec3;
+using glm::dvec3;
+using glm::mat4;
 
 class HeightField
 {
+public:
+	//grid quads along each side of a render tile
+	static const int TILE_QUADS= 128;
+
+	struct Tile
+	{
+		//grid point of the tile's corner, its vertices are relative to it
+		int gridX;
+		int gridZ;
+		float minHeight;
+		float maxHeight;
+	};
+
 private:
 	int hmHeight;
 	int hmWidth;
@@ -16,17 +32,55 @@ private:
 	GLuint vertexBuffer;
 	GLuint vaoHandle;
 	GLuint elementBuffer;
-	
 
+	//cpu copy of the height grid, indexed [x * hmHeight + z]
+	std::vector<float> heights;
+
+	std::vector<Tile> tiles;
+	int tileVerts;
+	//world position of grid point (0, 0)
+	dvec3 origin;
+	//streams in over the first frames, coarse levels first
+	ProgressiveTexture texture;
+
+	//8 or 16 bit grayscale height map, sets the size from the image
+	bool loadTGAHeights(const char *fileName);
+	//cuts the grid into tiles of TILE_QUADS quads and records their height range
+	void buildTiles();
 
 public:
 	GLSLProgram prog;
 
+	//a .tga file is read as a grayscale image and brings its own size, rows
+	//along x, anything else as hWidth * hHeight raw bytes
 	bool Create(char *hFileName, int hWidth, int hHeight);
+	//factor times the size of source along each side, heights filtered
+	//bilinearly, cpu side only with no buffers or texture, for the tools
+	//and benchmarks that need a bigger map than there is on disk
+	void CreateUpsampled(const HeightField &source, int factor);
+	//stops the texture loader and frees the texture, needs the context
+	void Destroy();
 
-	void Render(void);
+	//viewProjection holds only the camera's rotation, every tile is moved by
+	//its offset from cameraPos, both in world space
+	void Render(const mat4 &viewProjection, const dvec3 &cameraPos);
 
 	void compileAndLinkShaders();
 
-	void generateElementArrayBuffer(std::vector<vec3> Verts);
+	void generateElementArrayBuffer(int verts);
+
+	void setOrigin(const dvec3 &worldOrigin) { origin= worldOrigin; }
+	const dvec3& getOrigin() const { return origin; }
+	const std::vector<Tile>& getTiles() const { return tiles; }
+	dvec3 tileOrigin(const Tile &tile) const { return origin + dvec3(tile.gridX, 0.0, tile.gridZ); }
+
+	int getWidth() const { return hmWidth; }
+	int getDepth() const { return hmHeight; }
+	const float* heightData() const { return &heights[0]; }
+
+	//height of grid point (x, z), clamped to the map
+	float heightAt(int x, int z) const;
+
+	//bilinearly filtered height at world position (x, z)
+	float sampleHeight(float x, float z) const;
 };
\ No newline at end of file
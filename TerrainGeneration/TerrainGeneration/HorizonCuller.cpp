@@ -0,0 +1,301 @@
+#include "HorizonCuller.h"
+
+#include "Timer.h"
+#include "simd.h"
+#include <math.h>
+#include <algorithm>
+
+namespace
+{
+	//corners closer to the eye plane than this can't be projected safely
+	const float MIN_W= 1e-4f;
+
+	//tiles whose heights vary by no more than this become a single block
+	const float FLAT_TILE= 2.f;
+
+	//four points through the view projection at once, out is clip x, y, z, w
+	inline void project4(const mat4 &m, const float *x, const float *y, const float *z, float out[4][4])
+	{
+#ifdef TG_SSE2
+		__m128 px= _mm_loadu_ps(x);
+		__m128 py= _mm_loadu_ps(y);
+		__m128 pz= _mm_loadu_ps(z);
+		for(int r= 0; r < 4; ++r)
+		{
+			__m128 v= _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0][r]), px), _mm_mul_ps(_mm_set1_ps(m[1][r]), py));
+			v= _mm_add_ps(v, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[2][r]), pz), _mm_set1_ps(m[3][r])));
+			_mm_storeu_ps(out[r], v);
+		}
+#else
+		for(int r= 0; r < 4; ++r)
+		{
+			for(int l= 0; l < 4; ++l)
+				out[r][l]= m[0][r] * x[l] + m[1][r] * y[l] + m[2][r] * z[l] + m[3][r];
+		}
+#endif
+	}
+
+	//distance in the ground plane from (x, z) to the rectangle, 0 inside it
+	inline float distanceXZ(float x, float z, float x0, float z0, float x1, float z1)
+	{
+		float dx= std::max(std::max(x0 - x, x - x1), 0.f);
+		float dz= std::max(std::max(z0 - z, z - z1), 0.f);
+		return sqrt(dx * dx + dz * dz);
+	}
+}
+
+HorizonCuller::HorizonCuller() : terrain(0)
+{
+	stats.objects= 0;
+	stats.frustumCulled= 0;
+	stats.occluded= 0;
+	stats.occludersUsed= 0;
+	stats.culledRatio= 0.f;
+	stats.cullMs= 0.0;
+}
+
+void HorizonCuller::Create(const HeightField &field, int blockSize, int columns)
+{
+	terrain= &field;
+	horizon.assign(std::max(columns, 4), -1e30f);
+
+	//blocks come out of the render tiles, a tile that is nearly flat is one
+	//block at its lowest height, splitting it couldn't raise any top by much
+	int width= field.getWidth();
+	int depth= field.getDepth();
+	const std::vector<HeightField::Tile> &tiles= field.getTiles();
+	blocks.clear();
+	for(size_t t= 0; t < tiles.size(); ++t)
+	{
+		const HeightField::Tile &tile= tiles[t];
+		int tileX1= std::min(tile.gridX + HeightField::TILE_QUADS, width - 1);
+		int tileZ1= std::min(tile.gridZ + HeightField::TILE_QUADS, depth - 1);
+		if(tile.maxHeight - tile.minHeight <= FLAT_TILE)
+		{
+			Block block= { (float)tile.gridX, (float)tile.gridZ, (float)tileX1, (float)tileZ1, tile.minHeight };
+			blocks.push_back(block);
+			continue;
+		}
+		for(int x= tile.gridX; x < tileX1; x+= blockSize)
+		{
+			for(int z= tile.gridZ; z < tileZ1; z+= blockSize)
+			{
+				Block block;
+				int x1= std::min(x + blockSize, tileX1);
+				int z1= std::min(z + blockSize, tileZ1);
+				block.x0= (float)x;
+				block.z0= (float)z;
+				block.x1= (float)x1;
+				block.z1= (float)z1;
+				block.top= tile.maxHeight;
+				for(int gx= x; gx <= x1; ++gx)
+				{
+					for(int gz= z; gz <= z1; ++gz)
+						block.top= std::min(block.top, field.heightAt(gx, gz));
+				}
+				blocks.push_back(block);
+			}
+		}
+	}
+}
+
+//the block is solid from its lowest point down, and anything under that lies
+//below the lowest ground, so every ray that passes under the projected top of
+//the block hits it or the ground in front of it
+//the upper hull of the four top corners is inside the true outline, which
+//keeps the horizon conservative
+bool HorizonCuller::addOccluder(const Block &block, const mat4 &viewProjection)
+{
+	float x[4]= { block.x0, block.x1, block.x0, block.x1 };
+	float y[4]= { block.top, block.top, block.top, block.top };
+	float z[4]= { block.z0, block.z0, block.z1, block.z1 };
+	float clip[4][4];
+	project4(viewProjection, x, y, z, clip);
+
+	float sx[4], sy[4];
+	for(int l= 0; l < 4; ++l)
+	{
+		if(clip[3][l] < MIN_W)
+			return false;
+		sx[l]= clip[0][l] / clip[3][l];
+		sy[l]= clip[1][l] / clip[3][l];
+	}
+
+	//upper hull, left to right
+	int order[4]= { 0, 1, 2, 3 };
+	std::sort(order, order + 4, [&](int a, int b) { return sx[a] < sx[b]; });
+	int hull[4];
+	int size= 0;
+	for(int i= 0; i < 4; ++i)
+	{
+		int p= order[i];
+		while(size >= 2)
+		{
+			int a= hull[size - 2];
+			int b= hull[size - 1];
+			float turn= (sx[b] - sx[a]) * (sy[p] - sy[a]) - (sy[b] - sy[a]) * (sx[p] - sx[a]);
+			if(turn < 0.f)
+				break;
+			--size;
+		}
+		hull[size++]= p;
+	}
+
+	//only columns the outline spans completely, the hull is concave so its
+	//lowest point over a column is at one of the column's edges
+	if(size < 2)
+		return true;
+	int columns= (int)horizon.size();
+	float scale= columns * 0.5f;
+	int first= std::max((int)ceil((sx[hull[0]] + 1.f) * scale), 0);
+	int last= std::min((int)floor((sx[hull[size - 1]] + 1.f) * scale) - 1, columns - 1);
+	int segment= 0;
+	auto upperAt= [&](float at) -> float {
+		while(segment < size - 2 && sx[hull[segment + 1]] < at)
+			++segment;
+		int a= hull[segment];
+		int b= hull[segment + 1];
+		float span= sx[b] - sx[a];
+		if(span <= 0.f)
+			return std::min(sy[a], sy[b]);
+		float t= std::min(std::max((at - sx[a]) / span, 0.f), 1.f);
+		return sy[a] + (sy[b] - sy[a]) * t;
+	};
+	for(int c= first; c <= last; ++c)
+	{
+		float left= c / scale - 1.f;
+		float right= (c + 1) / scale - 1.f;
+		float lowest= std::min(upperAt(left), upperAt(right));
+		horizon[c]= std::max(horizon[c], lowest);
+	}
+	return true;
+}
+
+void HorizonCuller::testBoxes(const std::vector<Box> &boxes, const int *indices, int count, const mat4 &viewProjection,
+	std::vector<unsigned char> &visible)
+{
+	float lo[3][4], hi[3][4];
+	for(int l= 0; l < 4; ++l)
+	{
+		const Box &box= boxes[indices[l < count ? l : 0]];
+		for(int a= 0; a < 3; ++a)
+		{
+			lo[a][l]= box.min[a];
+			hi[a][l]= box.max[a];
+		}
+	}
+
+	//screen bounds of each box and the frustum planes all its corners are outside of
+	float minX[4], maxX[4], maxY[4], minW[4];
+	int outside[4];
+	for(int l= 0; l < 4; ++l)
+	{
+		minX[l]= 1e30f;
+		maxX[l]= -1e30f;
+		maxY[l]= -1e30f;
+		minW[l]= 1e30f;
+		outside[l]= 63;
+	}
+	for(int corner= 0; corner < 8; ++corner)
+	{
+		float clip[4][4];
+		project4(viewProjection, corner & 1 ? hi[0] : lo[0], corner & 2 ? hi[1] : lo[1], corner & 4 ? hi[2] : lo[2], clip);
+		for(int l= 0; l < 4; ++l)
+		{
+			float cx= clip[0][l], cy= clip[1][l], cz= clip[2][l], cw= clip[3][l];
+			int out= (cx < -cw ? 1 : 0) | (cx > cw ? 2 : 0) | (cy < -cw ? 4 : 0) | (cy > cw ? 8 : 0) |
+				(cz < -cw ? 16 : 0) | (cz > cw ? 32 : 0);
+			outside[l]&= out;
+			minW[l]= std::min(minW[l], cw);
+			if(cw >= MIN_W)
+			{
+				minX[l]= std::min(minX[l], cx / cw);
+				maxX[l]= std::max(maxX[l], cx / cw);
+				maxY[l]= std::max(maxY[l], cy / cw);
+			}
+		}
+	}
+
+	int columns= (int)horizon.size();
+	float scale= columns * 0.5f;
+	for(int l= 0; l < count; ++l)
+	{
+		int index= indices[l];
+		if(outside[l] != 0)
+		{
+			visible[index]= 0;
+			++stats.frustumCulled;
+			continue;
+		}
+		if(minW[l] < MIN_W)
+			continue;
+
+		int first= std::max((int)floor((minX[l] + 1.f) * scale), 0);
+		int last= std::min((int)floor((maxX[l] + 1.f) * scale), columns - 1);
+		bool hidden= first <= last;
+		for(int c= first; c <= last && hidden; ++c)
+			hidden= horizon[c] >= maxY[l];
+		if(hidden)
+		{
+			visible[index]= 0;
+			++stats.occluded;
+		}
+	}
+}
+
+void HorizonCuller::cull(const std::vector<Box> &boxes, const mat4 &viewProjection, const vec3 &cameraPos,
+	std::vector<unsigned char> &visible)
+{
+	Timer timer;
+	visible.assign(boxes.size(), 1);
+	std::fill(horizon.begin(), horizon.end(), -1e30f);
+	stats.objects= (int)boxes.size();
+	stats.frustumCulled= 0;
+	stats.occluded= 0;
+	stats.occludersUsed= 0;
+
+	//the horizon only holds with the camera above the ground
+	bool occluders= terrain != 0 && cameraPos.y > terrain->sampleHeight(cameraPos.x, cameraPos.z);
+
+	//blocks by their farthest point and boxes by their nearest, so a box is
+	//only tested against blocks that are entirely in front of it
+	blockOrder.clear();
+	if(occluders)
+	{
+		for(size_t b= 0; b < blocks.size(); ++b)
+		{
+			const Block &block= blocks[b];
+			float dx= std::max(fabs(block.x0 - cameraPos.x), fabs(block.x1 - cameraPos.x));
+			float dz= std::max(fabs(block.z0 - cameraPos.z), fabs(block.z1 - cameraPos.z));
+			blockOrder.push_back(std::make_pair((float)sqrt(dx * dx + dz * dz), (int)b));
+		}
+		std::sort(blockOrder.begin(), blockOrder.end());
+	}
+	boxOrder.resize(boxes.size());
+	for(size_t b= 0; b < boxes.size(); ++b)
+	{
+		const Box &box= boxes[b];
+		boxOrder[b]= std::make_pair(distanceXZ(cameraPos.x, cameraPos.z, box.min.x, box.min.z, box.max.x, box.max.z), (int)b);
+	}
+	std::sort(boxOrder.begin(), boxOrder.end());
+
+	size_t next= 0;
+	for(size_t b= 0; b < boxOrder.size(); b+= 4)
+	{
+		while(next < blockOrder.size() && blockOrder[next].first < boxOrder[b].first)
+		{
+			if(addOccluder(blocks[blockOrder[next].second], viewProjection))
+				++stats.occludersUsed;
+			++next;
+		}
+
+		int indices[4];
+		int count= (int)std::min(boxOrder.size() - b, (size_t)4);
+		for(int l= 0; l < count; ++l)
+			indices[l]= boxOrder[b + l].second;
+		testBoxes(boxes, indices, count, viewProjection, visible);
+	}
+
+	stats.culledRatio= boxes.empty() ? 0.f : (float)(stats.frustumCulled + stats.occluded) / boxes.size();
+	stats.cullMs= timer.elapsedMs();
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "HeightField.h"
+#include <vector>
+#include <glm/glm.hpp>
+using glm::vec3;
+using glm::mat4;
+
+//occlusion horizon culling for objects standing on the height field
+//the height field's tiles are cut into blocks that are solid at least up to
+//their lowest point, their projected tops are merged front to back into a per
+//column horizon and an object whose screen box stays under the horizon built
+//from blocks nearer than it is hidden, objects are projected and tested four
+//at a time with SSE
+class HorizonCuller
+{
+public:
+	struct Box
+	{
+		vec3 min;
+		vec3 max;
+	};
+
+	struct Stats
+	{
+		int objects;
+		int frustumCulled;
+		int occluded;
+		int occludersUsed;
+		//culled objects over all objects, for the last frame
+		float culledRatio;
+		double cullMs;
+	};
+
+private:
+	struct Block
+	{
+		float x0, z0, x1, z1;
+		float top;
+	};
+
+	std::vector<Block> blocks;
+	//highest normalized device y covered by terrain in each screen column
+	std::vector<float> horizon;
+	const HeightField *terrain;
+	Stats stats;
+
+	//order the blocks and objects are visited in, rebuilt every frame
+	std::vector<std::pair<float, int> > blockOrder;
+	std::vector<std::pair<float, int> > boxOrder;
+
+	//false when the block reaches behind the camera and can't be used
+	bool addOccluder(const Block &block, const mat4 &viewProjection);
+	void testBoxes(const std::vector<Box> &boxes, const int *indices, int count, const mat4 &viewProjection,
+		std::vector<unsigned char> &visible);
+
+public:
+	HorizonCuller();
+
+	//the field's tiles are split into blocks of blockSize grid quads, flat
+	//ones are kept whole, columns is the horizon's resolution across the screen
+	void Create(const HeightField &field, int blockSize, int columns);
+
+	//visible[i] is set to 0 for every box that is outside the view or behind
+	//the terrain, to 1 otherwise, boxes and cameraPos in the field's grid space
+	void cull(const std::vector<Box> &boxes, const mat4 &viewProjection, const vec3 &cameraPos,
+		std::vector<unsigned char> &visible);
+
+	const std::vector<float>& getHorizon() const { return horizon; }
+	const Stats& getStats() const { return stats; }
+};
\ No newline at end of file
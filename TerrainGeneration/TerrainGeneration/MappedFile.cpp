@@ -0,0 +1,109 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() : data(0), length(0), file(INVALID_HANDLE_VALUE), mapping(0)
+{
+}
+
+bool MappedFile::open(const char *fileName)
+{
+	close();
+	file= CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if(file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+	mapping= CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+	if(!mapping)
+	{
+		close();
+		return false;
+	}
+	data= (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if(!data)
+	{
+		close();
+		return false;
+	}
+	length= (size_t)fileSize.QuadPart;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if(data)
+		UnmapViewOfFile(data);
+	if(mapping)
+		CloseHandle(mapping);
+	if(file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	data= 0;
+	length= 0;
+	mapping= 0;
+	file= INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile() : data(0), length(0), file(-1)
+{
+}
+
+bool MappedFile::open(const char *fileName)
+{
+	close();
+	file= ::open(fileName, O_RDONLY);
+	if(file < 0)
+		return false;
+
+	struct stat info;
+	if(fstat(file, &info) != 0 || info.st_size == 0)
+	{
+		close();
+		return false;
+	}
+	void *view= mmap(0, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	if(view == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+	data= (const unsigned char*)view;
+	length= (size_t)info.st_size;
+	//the pixels are read front to back once
+	madvise(view, length, MADV_SEQUENTIAL);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if(data)
+		munmap((void*)data, length);
+	if(file >= 0)
+		::close(file);
+	data= 0;
+	length= 0;
+	file= -1;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
\ No newline at end of file
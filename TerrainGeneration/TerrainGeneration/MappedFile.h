@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+
+//read only view of a whole file through the os page cache, nothing is copied
+//into the process until the pages are touched
+class MappedFile
+{
+private:
+	const unsigned char *data;
+	size_t length;
+#ifdef _WIN32
+	void *file;
+	void *mapping;
+#else
+	int file;
+#endif
+
+	//no copies, the destructor unmaps
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const char *fileName);
+	void close();
+
+	bool isOpen() const { return data != 0; }
+	const unsigned char* bytes() const { return data; }
+	size_t size() const { return length; }
+};
\ No newline at end of file
@@ -0,0 +1,273 @@
+#include "MeshExporter.h"
+
+#include "Timer.h"
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <iostream>
+using std::cerr;
+using std::endl;
+
+namespace
+{
+	//each block is about this many bytes of output
+	const int BLOCK_BYTES= 1 << 20;
+
+	//worst case text for one obj vertex and one obj face
+	const int OBJ_VERTEX_CHARS= 64;
+	const int OBJ_FACE_CHARS= 40;
+
+	//printf is most of the time of a text export, these only do what obj needs
+	inline char* writeInteger(char *p, unsigned long long v)
+	{
+		char digits[20];
+		int n= 0;
+		do
+		{
+			digits[n++]= (char)('0' + v % 10);
+			v/= 10;
+		} while(v);
+		while(n)
+			*p++= digits[--n];
+		return p;
+	}
+
+	//four decimals, trailing zeros dropped
+	inline char* writeFloat(char *p, float value)
+	{
+		if(value < 0.f)
+		{
+			*p++= '-';
+			value= -value;
+		}
+		unsigned long long scaled= (unsigned long long)(value * 10000.0 + 0.5);
+		p= writeInteger(p, scaled / 10000);
+		int fraction= (int)(scaled % 10000);
+		if(fraction == 0)
+			return p;
+
+		char digits[4];
+		for(int i= 3; i >= 0; --i)
+		{
+			digits[i]= (char)('0' + fraction % 10);
+			fraction/= 10;
+		}
+		int n= 4;
+		while(digits[n - 1] == '0')
+			--n;
+		*p++= '.';
+		memcpy(p, digits, n);
+		return p + n;
+	}
+}
+
+MeshExporter::MeshExporter() : blockRows(1)
+{
+	stats.vertices= 0;
+	stats.triangles= 0;
+	stats.blocks= 0;
+	stats.bytes= 0;
+	stats.exportMs= 0.0;
+}
+
+void MeshExporter::formatVertices(const HeightField &field, Format format, int firstRow, int lastRow,
+	std::vector<char> &out) const
+{
+	int columns= (int)columnAt.size();
+	int count= (lastRow - firstRow) * columns;
+	if(format == BINARY)
+	{
+		out.resize(count * 3 * sizeof(float));
+		float *v= (float*)&out[0];
+		for(int r= firstRow; r < lastRow; ++r)
+		{
+			for(int c= 0; c < columns; ++c)
+			{
+				*v++= (float)rowAt[r];
+				*v++= field.heightAt(rowAt[r], columnAt[c]);
+				*v++= (float)columnAt[c];
+			}
+		}
+		return;
+	}
+
+	out.resize(count * OBJ_VERTEX_CHARS);
+	char *p= &out[0];
+	for(int r= firstRow; r < lastRow; ++r)
+	{
+		for(int c= 0; c < columns; ++c)
+		{
+			*p++= 'v';
+			*p++= ' ';
+			p= writeInteger(p, rowAt[r]);
+			*p++= ' ';
+			p= writeFloat(p, field.heightAt(rowAt[r], columnAt[c]));
+			*p++= ' ';
+			p= writeInteger(p, columnAt[c]);
+			*p++= '\n';
+		}
+	}
+	out.resize(p - &out[0]);
+}
+
+//quad row r joins vertex rows r and r + 1, wound like the ocean mesh
+void MeshExporter::formatTriangles(Format format, int firstRow, int lastRow, std::vector<char> &out) const
+{
+	unsigned int columns= (unsigned int)columnAt.size();
+	int count= (lastRow - firstRow) * (columns - 1) * 2;
+	if(format == BINARY)
+	{
+		out.resize(count * 3 * sizeof(unsigned int));
+		unsigned int *t= (unsigned int*)&out[0];
+		for(int r= firstRow; r < lastRow; ++r)
+		{
+			for(unsigned int c= 0; c < columns - 1; ++c)
+			{
+				unsigned int i00= r * columns + c;
+				unsigned int i10= i00 + columns;
+				t[0]= i00;
+				t[1]= i00 + 1;
+				t[2]= i10;
+				t[3]= i10;
+				t[4]= i00 + 1;
+				t[5]= i10 + 1;
+				t+= 6;
+			}
+		}
+		return;
+	}
+
+	//obj counts from 1
+	out.resize(count * OBJ_FACE_CHARS);
+	char *p= &out[0];
+	for(int r= firstRow; r < lastRow; ++r)
+	{
+		for(unsigned int c= 0; c < columns - 1; ++c)
+		{
+			unsigned int i00= r * columns + c + 1;
+			unsigned int i10= i00 + columns;
+			unsigned int corners[6]= { i00, i00 + 1, i10, i10, i00 + 1, i10 + 1 };
+			for(int f= 0; f < 6; f+= 3)
+			{
+				*p++= 'f';
+				for(int k= 0; k < 3; ++k)
+				{
+					*p++= ' ';
+					p= writeInteger(p, corners[f + k]);
+				}
+				*p++= '\n';
+			}
+		}
+	}
+	out.resize(p - &out[0]);
+}
+
+bool MeshExporter::writeRows(FILE *fp, int numRows, const std::function<void(int, int, std::vector<char>&)> &format,
+	ThreadPool &pool)
+{
+	int numBlocks= (numRows + blockRows - 1) / blockRows;
+	int batch= std::max(pool.size(), 2);
+
+	//one batch is formatted while a writer thread puts the last one on disk
+	std::vector<std::vector<char> > buffers[2];
+	bool written= true;
+	std::thread writer;
+	int b= 0;
+	for(int first= 0; first < numBlocks; first+= batch)
+	{
+		int count= std::min(batch, numBlocks - first);
+		buffers[b].resize(count);
+		pool.parallelFor(0, count, [&](int i) {
+			int block= first + i;
+			format(block * blockRows, std::min((block + 1) * blockRows, numRows), buffers[b][i]);
+		});
+
+		if(writer.joinable())
+			writer.join();
+		std::vector<std::vector<char> > &ready= buffers[b];
+		writer= std::thread([&ready, &written, fp, count, this]() {
+			for(int i= 0; i < count; ++i)
+			{
+				if(!ready[i].empty() && fwrite(&ready[i][0], 1, ready[i].size(), fp) != ready[i].size())
+					written= false;
+				stats.bytes+= ready[i].size();
+			}
+		});
+		stats.blocks+= count;
+		b^= 1;
+	}
+	if(writer.joinable())
+		writer.join();
+	return written;
+}
+
+bool MeshExporter::exportMesh(const HeightField &field, const char *fileName, Format format, int step, ThreadPool &pool)
+{
+	Timer timer;
+	step= std::max(step, 1);
+	rowAt.clear();
+	columnAt.clear();
+	for(int x= 0; x < field.getWidth() - 1; x+= step)
+		rowAt.push_back(x);
+	rowAt.push_back(field.getWidth() - 1);
+	for(int z= 0; z < field.getDepth() - 1; z+= step)
+		columnAt.push_back(z);
+	columnAt.push_back(field.getDepth() - 1);
+
+	int rows= (int)rowAt.size();
+	int columns= (int)columnAt.size();
+	int rowBytes= columns * (format == OBJ ? OBJ_VERTEX_CHARS : 12);
+	blockRows= std::max(BLOCK_BYTES / rowBytes, 1);
+
+	FILE *fp= fopen(fileName, "wb");
+	if(!fp)
+	{
+		cerr<<"MeshExporter: can't open "<<fileName<<endl;
+		return false;
+	}
+
+	stats.vertices= rows * columns;
+	stats.triangles= (rows - 1) * (columns - 1) * 2;
+	stats.blocks= 0;
+	stats.bytes= 0;
+
+	bool written;
+	if(format == BINARY)
+	{
+		MeshHeader header;
+		memcpy(header.magic, "TGMB", 4);
+		header.version= 1;
+		header.columns= columns;
+		header.rows= rows;
+		header.numVertices= (unsigned int)stats.vertices;
+		header.numTriangles= (unsigned int)stats.triangles;
+		written= fwrite(&header, sizeof(header), 1, fp) == 1;
+		stats.bytes+= sizeof(header);
+	}
+	else
+	{
+		int length= fprintf(fp, "# %dx%d height field, %d vertices, %d triangles\n", field.getWidth(), field.getDepth(),
+			stats.vertices, stats.triangles);
+		written= length > 0;
+		stats.bytes+= std::max(length, 0);
+	}
+
+	written= written && writeRows(fp, rows, [&](int first, int last, std::vector<char> &out) {
+		formatVertices(field, format, first, last, out);
+	}, pool);
+	written= written && writeRows(fp, rows - 1, [&](int first, int last, std::vector<char> &out) {
+		formatTriangles(format, first, last, out);
+	}, pool);
+	written= fclose(fp) == 0 && written;
+
+	stats.exportMs= timer.elapsedMs();
+	if(!written)
+	{
+		cerr<<"MeshExporter: writing "<<fileName<<" failed"<<endl;
+		return false;
+	}
+	printf("MeshExporter: %s, %d vertices and %d triangles in %d blocks, %.1f MB in %.1f ms (%.0f MB/s) on %d threads\n",
+		fileName, stats.vertices, stats.triangles, stats.blocks, stats.bytes / 1048576.0, stats.exportMs,
+		stats.bytes / 1048576.0 / (stats.exportMs * 0.001 + 1e-9), pool.size());
+	return true;
+}
\ No newline at end of file
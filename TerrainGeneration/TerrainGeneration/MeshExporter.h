@@ -0,0 +1,65 @@
+#pragma once
+
+#include "HeightField.h"
+#include "ThreadPool.h"
+#include <stdio.h>
+#include <vector>
+#include <functional>
+
+//writes the height field as a triangle mesh for offline tools
+//rows of the grid are turned into text or binary a block at a time on the
+//pool while the previous batch of blocks goes to disk, so memory stays at a
+//couple of batches of blocks however big the map is
+//
+//the binary layout is a MeshHeader followed by columns * rows vertices of
+//three floats, x major like the grid, and then the triangles as three
+//uint32 indices each, all little endian
+class MeshExporter
+{
+public:
+	enum Format
+	{
+		BINARY,
+		OBJ
+	};
+
+	struct MeshHeader
+	{
+		char magic[4];
+		int version;
+		int columns;
+		int rows;
+		unsigned int numVertices;
+		unsigned int numTriangles;
+	};
+
+	struct Stats
+	{
+		int vertices;
+		int triangles;
+		int blocks;
+		long long bytes;
+		double exportMs;
+	};
+
+private:
+	//grid lines kept after decimation, the last row and column always stay
+	std::vector<int> rowAt;
+	std::vector<int> columnAt;
+	int blockRows;
+	Stats stats;
+
+	void formatVertices(const HeightField &field, Format format, int firstRow, int lastRow, std::vector<char> &out) const;
+	void formatTriangles(Format format, int firstRow, int lastRow, std::vector<char> &out) const;
+	//formats rows [0, numRows) in blocks and appends them to fp in order
+	bool writeRows(FILE *fp, int numRows, const std::function<void(int, int, std::vector<char>&)> &format,
+		ThreadPool &pool);
+
+public:
+	MeshExporter();
+
+	//step keeps every step'th grid line, 1 writes the full resolution mesh
+	bool exportMesh(const HeightField &field, const char *fileName, Format format, int step, ThreadPool &pool);
+
+	const Stats& getStats() const { return stats; }
+};
\ No newline at end of file
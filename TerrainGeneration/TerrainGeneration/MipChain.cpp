@@ -0,0 +1,183 @@
+#include "MipChain.h"
+
+#include "Timer.h"
+#include "simd.h"
+#include <math.h>
+#include <algorithm>
+#include <mutex>
+
+namespace
+{
+	//linear light values are encoded through a table this fine
+	const int ENCODE_STEPS= 4096;
+
+	float srgbToLinear[256];
+	GLubyte linearToSrgb[ENCODE_STEPS + 1];
+	//builds can start on several loader threads at once, and the magic
+	//statics that would make a local static table safe are missing in VS2013
+	std::once_flag tablesOnce;
+
+	void fillTables()
+	{
+		for(int i= 0; i < 256; ++i)
+		{
+			float c= i / 255.f;
+			srgbToLinear[i]= c <= 0.04045f ? c / 12.92f : pow((c + 0.055f) / 1.055f, 2.4f);
+		}
+		for(int i= 0; i <= ENCODE_STEPS; ++i)
+		{
+			float l= (float)i / ENCODE_STEPS;
+			float c= l <= 0.0031308f ? l * 12.92f : 1.055f * pow(l, 1.f / 2.4f) - 0.055f;
+			linearToSrgb[i]= (GLubyte)(c * 255.f + 0.5f);
+		}
+	}
+
+	void makeTables()
+	{
+		std::call_once(tablesOnce, fillTables);
+	}
+
+	//an 8 bit base pixel in linear light, alpha opaque for 3 byte pixels
+	inline void decode(const GLubyte *p, int bytesPerPixel, float *out)
+	{
+		out[0]= srgbToLinear[p[0]];
+		out[1]= srgbToLinear[p[1]];
+		out[2]= srgbToLinear[p[2]];
+		out[3]= bytesPerPixel == 4 ? p[3] / 255.f : 1.f;
+	}
+
+	//average of four linear rgba pixels
+	inline void average4(const float *a, const float *b, const float *c, const float *d, float *out)
+	{
+#ifdef TG_SSE2
+		__m128 sum= _mm_add_ps(_mm_add_ps(_mm_loadu_ps(a), _mm_loadu_ps(b)), _mm_add_ps(_mm_loadu_ps(c), _mm_loadu_ps(d)));
+		_mm_storeu_ps(out, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+		for(int k= 0; k < 4; ++k)
+			out[k]= (a[k] + b[k] + c[k] + d[k]) * 0.25f;
+#endif
+	}
+
+	//linear rgba to 8 bits, color through the sRGB curve and alpha straight
+	inline void encode(const float *in, GLubyte *out)
+	{
+#ifdef TG_SSE2
+		__m128 scaled= _mm_mul_ps(_mm_loadu_ps(in), _mm_setr_ps((float)ENCODE_STEPS, (float)ENCODE_STEPS, (float)ENCODE_STEPS, 255.f));
+		__m128i index= _mm_cvtps_epi32(scaled);
+		int i[4];
+		_mm_storeu_si128((__m128i*)i, index);
+		out[0]= linearToSrgb[i[0]];
+		out[1]= linearToSrgb[i[1]];
+		out[2]= linearToSrgb[i[2]];
+		out[3]= (GLubyte)i[3];
+#else
+		for(int k= 0; k < 3; ++k)
+			out[k]= linearToSrgb[(int)(in[k] * ENCODE_STEPS + 0.5f)];
+		out[3]= (GLubyte)(in[3] * 255.f + 0.5f);
+#endif
+	}
+}
+
+MipChain::MipChain()
+{
+	stats.levels= 0;
+	stats.buildMs= 0.0;
+}
+
+int MipChain::levelCount(int width, int height)
+{
+	int count= 1;
+	while(width > 1 || height > 1)
+	{
+		width= std::max(width / 2, 1);
+		height= std::max(height / 2, 1);
+		++count;
+	}
+	return count;
+}
+
+void MipChain::build(const GLubyte *base, int width, int height, int bytesPerPixel, ptrdiff_t rowStride, ThreadPool &pool)
+{
+	Timer timer;
+	makeTables();
+	levels.clear();
+
+	//level 1 is averaged straight from the base's bytes two rows at a time,
+	//so only it and the levels after it are ever held in linear light
+	int src= 0;
+	int count= levelCount(width, height);
+	levels.resize(count - 1);
+	for(int l= 1; l < count; ++l)
+	{
+		Level &level= levels[l - 1];
+		level.width= std::max(width / 2, 1);
+		level.height= std::max(height / 2, 1);
+		level.pixels.resize((size_t)level.width * level.height * 4);
+		int dst= src ^ 1;
+		linear[dst].resize((size_t)level.width * level.height * 4);
+
+		//a side that is already 1 reuses its only row or column
+		int w= width;
+		int h= height;
+		const float *in= l > 1 ? &linear[src][0] : 0;
+		float *out= &linear[dst][0];
+		pool.parallelFor(0, level.height, [&](int y) {
+			int y0= std::min(y * 2, h - 1);
+			int y1= std::min(y * 2 + 1, h - 1);
+			float *o= out + (size_t)y * level.width * 4;
+			GLubyte *p= &level.pixels[(size_t)y * level.width * 4];
+			if(!in)
+			{
+				const GLubyte *row0= base + y0 * rowStride;
+				const GLubyte *row1= base + y1 * rowStride;
+				float a[4], b[4], c[4], d[4];
+				for(int x= 0; x < level.width; ++x)
+				{
+					int x0= std::min(x * 2, w - 1) * bytesPerPixel;
+					int x1= std::min(x * 2 + 1, w - 1) * bytesPerPixel;
+					decode(row0 + x0, bytesPerPixel, a);
+					decode(row0 + x1, bytesPerPixel, b);
+					decode(row1 + x0, bytesPerPixel, c);
+					decode(row1 + x1, bytesPerPixel, d);
+					average4(a, b, c, d, o);
+					encode(o, p);
+					o+= 4;
+					p+= 4;
+				}
+				return;
+			}
+			const float *row0= in + (size_t)y0 * w * 4;
+			const float *row1= in + (size_t)y1 * w * 4;
+			for(int x= 0; x < level.width; ++x)
+			{
+				int x0= std::min(x * 2, w - 1) * 4;
+				int x1= std::min(x * 2 + 1, w - 1) * 4;
+				average4(row0 + x0, row0 + x1, row1 + x0, row1 + x1, o);
+				encode(o, p);
+				o+= 4;
+				p+= 4;
+			}
+		}, 8);
+
+		width= level.width;
+		height= level.height;
+		src= dst;
+	}
+
+	stats.levels= count;
+	stats.buildMs= timer.elapsedMs();
+}
+
+void MipChain::upload(GLenum format) const
+{
+	GLint alignment;
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	for(size_t l= 0; l < levels.size(); ++l)
+	{
+		const Level &level= levels[l];
+		glTexSubImage2D(GL_TEXTURE_2D, (GLint)l + 1, 0, 0, level.width, level.height, format, GL_UNSIGNED_BYTE,
+			&level.pixels[0]);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "GLIncludes.h"
+#include "ThreadPool.h"
+#include <stddef.h>
+#include <vector>
+
+//builds the mip levels of an 8 bit four channel texture on the cpu
+//the base is taken as sRGB, every level is averaged 2x2 from the one above
+//in linear light and only encoded back to 8 bits for upload, so distant
+//terrain doesn't darken the way a plain byte average makes it
+//channel order is left alone, BGRA in gives BGRA levels out
+class MipChain
+{
+public:
+	struct Level
+	{
+		int width;
+		int height;
+		std::vector<GLubyte> pixels;
+	};
+
+	struct Stats
+	{
+		int levels;
+		double buildMs;
+	};
+
+private:
+	//levels below the base, 1 to levelCount - 1
+	std::vector<Level> levels;
+	//linear light rgba of the level being built from and the one being
+	//built, the base itself is only ever read as bytes
+	std::vector<float> linear[2];
+	Stats stats;
+
+public:
+	MipChain();
+
+	//levels of a full chain down to 1x1
+	static int levelCount(int width, int height);
+
+	//base rows go bottom to top like GL wants them, rowStride is in bytes and
+	//may be negative, bytesPerPixel is 3 (alpha taken as opaque) or 4
+	void build(const GLubyte *base, int width, int height, int bytesPerPixel, ptrdiff_t rowStride, ThreadPool &pool);
+
+	//uploads levels 1 and on to the bound texture, which needs storage for
+	//levelCount levels, format is GL_RGBA or GL_BGRA to match the base
+	void upload(GLenum format) const;
+
+	const std::vector<Level>& getLevels() const { return levels; }
+	const Stats& getStats() const { return stats; }
+};
\ No newline at end of file
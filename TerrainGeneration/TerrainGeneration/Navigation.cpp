@@ -0,0 +1,508 @@
+#include "Navigation.h"
+
+#include "Timer.h"
+#include <math.h>
+#include <stdio.h>
+#include <queue>
+#include <algorithm>
+#include <unordered_map>
+
+namespace
+{
+	const float SQRT2= 1.41421356f;
+
+	//entrances at least this wide get a transition at each end instead of one in the middle
+	const int wideEntrance= 6;
+
+	struct Open
+	{
+		float f;
+		int id;
+
+		bool operator<(const Open &other) const { return f > other.f; }
+	};
+
+	const int neighbourX[8]= {1, -1, 0, 0, 1, 1, -1, -1};
+	const int neighbourZ[8]= {0, 0, 1, -1, 1, -1, 1, -1};
+}
+
+Navigation::Navigation() : width(0), depth(0), clusterSize(32), clustersX(0), clustersZ(0),
+	maxSlope(6.f), slopeWeight(1.f)
+{
+	stats.clusters= 0;
+	stats.nodes= 0;
+	stats.buildMs= 0.0;
+	stats.queries= 0;
+	stats.pathsFound= 0;
+	stats.queryMs= 0.0;
+	stats.queriesPerSecond= 0.0;
+}
+
+void Navigation::Create(const HeightField &field, int cSize, float mSlope, float sWeight, ThreadPool &pool)
+{
+	Timer timer;
+
+	width= field.getWidth();
+	depth= field.getDepth();
+	clusterSize= cSize;
+	maxSlope= mSlope;
+	slopeWeight= sWeight;
+	clustersX= (width + clusterSize - 1) / clusterSize;
+	clustersZ= (depth + clusterSize - 1) / clusterSize;
+
+	cellCost.assign(width * depth, 0.f);
+	computeCellCosts(field, 0, 0, width, depth, pool);
+
+	clusters.assign(clustersX * clustersZ, Cluster());
+	for(int cx= 0; cx < clustersX; ++cx)
+	{
+		for(int cz= 0; cz < clustersZ; ++cz)
+		{
+			Cluster &c= clusters[cx * clustersZ + cz];
+			c.x0= cx * clusterSize;
+			c.z0= cz * clusterSize;
+			c.x1= std::min(c.x0 + clusterSize, width);
+			c.z1= std::min(c.z0 + clusterSize, depth);
+		}
+	}
+
+	borders.assign(clusters.size() * 2, std::vector<Transition>());
+	pool.parallelFor(0, (int)borders.size(), [&](int b) { computeBorder(b / 2, b % 2); });
+
+	rebuildNodes();
+	pool.parallelFor(0, (int)clusters.size(), [&](int c) { computeClusterCosts(c); });
+
+	stats.clusters= (int)clusters.size();
+	stats.nodes= (int)nodes.size();
+	stats.buildMs= timer.elapsedMs();
+
+	printf("Navigation: %dx%d grid, %d clusters, %d abstract nodes, built in %.1f ms\n",
+		width, depth, stats.clusters, stats.nodes, stats.buildMs);
+}
+
+void Navigation::computeCellCosts(const HeightField &field, int x0, int z0, int x1, int z1, ThreadPool &pool)
+{
+	x0= std::max(x0, 0);
+	z0= std::max(z0, 0);
+	x1= std::min(x1, width);
+	z1= std::min(z1, depth);
+
+	pool.parallelFor(x0, x1, [&](int x) {
+		for(int z= z0; z < z1; ++z)
+		{
+			float sx= fabs(field.heightAt(x + 1, z) - field.heightAt(x - 1, z)) * 0.5f;
+			float sz= fabs(field.heightAt(x, z + 1) - field.heightAt(x, z - 1)) * 0.5f;
+			float slope= std::max(sx, sz);
+			cellCost[x * depth + z]= slope > maxSlope ? 0.f : 1.f + slopeWeight * slope;
+		}
+	}, 16);
+}
+
+void Navigation::computeBorder(int cluster, int side)
+{
+	std::vector<Transition> &border= borders[cluster * 2 + side];
+	border.clear();
+
+	const Cluster &c= clusters[cluster];
+	int cx= c.x0 / clusterSize;
+	int cz= c.z0 / clusterSize;
+	if((side == 0 && cx + 1 >= clustersX) || (side == 1 && cz + 1 >= clustersZ))
+		return;
+
+	//walk along the border, A on this side and B on the neighbour's
+	int length= side == 0 ? c.z1 - c.z0 : c.x1 - c.x0;
+	int runStart= -1;
+	for(int i= 0; i <= length; ++i)
+	{
+		bool open= false;
+		if(i < length)
+		{
+			int a= side == 0 ? (c.x1 - 1) * depth + c.z0 + i : (c.x0 + i) * depth + c.z1 - 1;
+			int b= side == 0 ? a + depth : a + 1;
+			open= cellCost[a] > 0.f && cellCost[b] > 0.f;
+		}
+
+		if(open && runStart < 0)
+		{
+			runStart= i;
+		}
+		else if(!open && runStart >= 0)
+		{
+			int picks[2]= {(runStart + i - 1) / 2, -1};
+			if(i - runStart >= wideEntrance)
+			{
+				picks[0]= runStart;
+				picks[1]= i - 1;
+			}
+
+			for(int p= 0; p < 2 && picks[p] >= 0; ++p)
+			{
+				Transition t;
+				t.cellA= side == 0 ? (c.x1 - 1) * depth + c.z0 + picks[p] : (c.x0 + picks[p]) * depth + c.z1 - 1;
+				t.cellB= side == 0 ? t.cellA + depth : t.cellA + 1;
+				border.push_back(t);
+			}
+			runStart= -1;
+		}
+	}
+}
+
+void Navigation::rebuildNodes()
+{
+	nodes.clear();
+	for(size_t c= 0; c < clusters.size(); ++c)
+	{
+		clusters[c].nodeCells.clear();
+		clusters[c].nodeIds.clear();
+	}
+
+	for(size_t b= 0; b < borders.size(); ++b)
+	{
+		int ca= (int)b / 2;
+		int cb= b % 2 == 0 ? ca + clustersZ : ca + 1;
+
+		for(size_t t= 0; t < borders[b].size(); ++t)
+		{
+			const Transition &tr= borders[b][t];
+			int ida= (int)nodes.size();
+			int idb= ida + 1;
+
+			Node na;
+			na.cell= tr.cellA;
+			na.cluster= ca;
+			na.local= (int)clusters[ca].nodeCells.size();
+			na.partner= idb;
+			na.partnerCost= stepCost(tr.cellA, tr.cellB);
+
+			Node nb;
+			nb.cell= tr.cellB;
+			nb.cluster= cb;
+			nb.local= (int)clusters[cb].nodeCells.size();
+			nb.partner= ida;
+			nb.partnerCost= na.partnerCost;
+
+			nodes.push_back(na);
+			nodes.push_back(nb);
+			clusters[ca].nodeCells.push_back(tr.cellA);
+			clusters[ca].nodeIds.push_back(ida);
+			clusters[cb].nodeCells.push_back(tr.cellB);
+			clusters[cb].nodeIds.push_back(idb);
+		}
+	}
+}
+
+void Navigation::computeClusterCosts(int cluster)
+{
+	Cluster &c= clusters[cluster];
+	int n= (int)c.nodeCells.size();
+	c.costs.assign(n * n, -1.f);
+
+	int cd= c.z1 - c.z0;
+	std::vector<float> dist;
+	std::vector<int> parent;
+	for(int i= 0; i < n; ++i)
+	{
+		localSearch(c, c.nodeCells[i], -1, dist, parent);
+		for(int j= 0; j < n; ++j)
+		{
+			int cell= c.nodeCells[j];
+			float d= dist[(cell / depth - c.x0) * cd + cell % depth - c.z0];
+			c.costs[i * n + j]= d < 1e30f ? d : -1.f;
+		}
+	}
+}
+
+int Navigation::clusterOf(int cell) const
+{
+	return (cell / depth / clusterSize) * clustersZ + (cell % depth) / clusterSize;
+}
+
+bool Navigation::isWalkable(int x, int z) const
+{
+	return x >= 0 && z >= 0 && x < width && z < depth && cellCost[x * depth + z] > 0.f;
+}
+
+float Navigation::stepCost(int from, int to) const
+{
+	int dx= to / depth - from / depth;
+	int dz= to % depth - from % depth;
+	float avg= (cellCost[from] + cellCost[to]) * 0.5f;
+	return dx != 0 && dz != 0 ? avg * SQRT2 : avg;
+}
+
+float Navigation::heuristic(int from, int to) const
+{
+	//octile distance, every step costs at least 1
+	int dx= abs(to / depth - from / depth);
+	int dz= abs(to % depth - from % depth);
+	return (float)(dx + dz) + (SQRT2 - 2.f) * std::min(dx, dz);
+}
+
+bool Navigation::localSearch(const Cluster &c, int start, int goal, std::vector<float> &dist, std::vector<int> &parent) const
+{
+	int cw= c.x1 - c.x0;
+	int cd= c.z1 - c.z0;
+	dist.assign(cw * cd, 1e30f);
+	parent.assign(cw * cd, -1);
+
+	std::priority_queue<Open> open;
+	int s= (start / depth - c.x0) * cd + start % depth - c.z0;
+	dist[s]= 0.f;
+	Open first= {goal >= 0 ? heuristic(start, goal) : 0.f, start};
+	open.push(first);
+
+	while(!open.empty())
+	{
+		Open cur= open.top();
+		open.pop();
+		if(cur.id == goal)
+			return true;
+
+		int x= cur.id / depth;
+		int z= cur.id % depth;
+		float g= dist[(x - c.x0) * cd + z - c.z0];
+		if(cur.f > g + (goal >= 0 ? heuristic(cur.id, goal) : 0.f) + 1e-4f)
+			continue;
+
+		for(int k= 0; k < 8; ++k)
+		{
+			int nx= x + neighbourX[k];
+			int nz= z + neighbourZ[k];
+			if(nx < c.x0 || nz < c.z0 || nx >= c.x1 || nz >= c.z1)
+				continue;
+
+			int next= nx * depth + nz;
+			if(cellCost[next] <= 0.f)
+				continue;
+			//no cutting corners past blocked cells
+			if(k >= 4 && (cellCost[nx * depth + z] <= 0.f || cellCost[x * depth + nz] <= 0.f))
+				continue;
+
+			float ng= g + stepCost(cur.id, next);
+			int li= (nx - c.x0) * cd + nz - c.z0;
+			if(ng < dist[li])
+			{
+				dist[li]= ng;
+				parent[li]= cur.id;
+				Open o= {ng + (goal >= 0 ? heuristic(next, goal) : 0.f), next};
+				open.push(o);
+			}
+		}
+	}
+	return false;
+}
+
+bool Navigation::localPath(const Cluster &c, int start, int goal, std::vector<ivec2> &path) const
+{
+	std::vector<float> dist;
+	std::vector<int> parent;
+	if(!localSearch(c, start, goal, dist, parent))
+		return false;
+
+	int cd= c.z1 - c.z0;
+	size_t first= path.size();
+	for(int cell= goal; cell != start; cell= parent[(cell / depth - c.x0) * cd + cell % depth - c.z0])
+		path.push_back(ivec2(cell / depth, cell % depth));
+	std::reverse(path.begin() + first, path.end());
+	return true;
+}
+
+bool Navigation::findPath(const Query &query, std::vector<ivec2> &path) const
+{
+	path.clear();
+	if(!isWalkable(query.startX, query.startZ) || !isWalkable(query.goalX, query.goalZ))
+		return false;
+
+	int start= query.startX * depth + query.startZ;
+	int goal= query.goalX * depth + query.goalZ;
+	path.push_back(ivec2(query.startX, query.startZ));
+	if(start == goal)
+		return true;
+
+	int cs= clusterOf(start);
+	int cg= clusterOf(goal);
+
+	//a straight local search is enough when both ends share a cluster
+	if(cs == cg && localPath(clusters[cs], start, goal, path))
+		return true;
+
+	//hook start and goal into the abstract graph
+	const Cluster &startCluster= clusters[cs];
+	const Cluster &goalCluster= clusters[cg];
+	std::vector<float> startDist, goalDist;
+	std::vector<int> parent;
+	localSearch(startCluster, start, -1, startDist, parent);
+	localSearch(goalCluster, goal, -1, goalDist, parent);
+
+	int startCd= startCluster.z1 - startCluster.z0;
+	int goalCd= goalCluster.z1 - goalCluster.z0;
+
+	//A* over the abstract nodes, start and goal get the two ids past the end
+	const int startId= (int)nodes.size();
+	const int goalId= startId + 1;
+
+	struct Visit
+	{
+		float g;
+		int parent;
+		bool closed;
+	};
+	std::unordered_map<int, Visit> visits;
+	std::priority_queue<Open> open;
+
+	Visit sv= {0.f, -1, false};
+	visits[startId]= sv;
+	Open first= {heuristic(start, goal), startId};
+	open.push(first);
+
+	bool found= false;
+	while(!open.empty())
+	{
+		Open cur= open.top();
+		open.pop();
+
+		Visit &v= visits[cur.id];
+		if(v.closed)
+			continue;
+		v.closed= true;
+		float g= v.g;
+
+		if(cur.id == goalId)
+		{
+			found= true;
+			break;
+		}
+
+		//gather the outgoing edges of this node
+		std::vector<std::pair<int, float> > edges;
+		if(cur.id == startId)
+		{
+			for(size_t i= 0; i < startCluster.nodeCells.size(); ++i)
+			{
+				int cell= startCluster.nodeCells[i];
+				float d= startDist[(cell / depth - startCluster.x0) * startCd + cell % depth - startCluster.z0];
+				if(d < 1e30f)
+					edges.push_back(std::make_pair(startCluster.nodeIds[i], d));
+			}
+		}
+		else
+		{
+			const Node &n= nodes[cur.id];
+			const Cluster &c= clusters[n.cluster];
+			int count= (int)c.nodeCells.size();
+
+			edges.push_back(std::make_pair(n.partner, n.partnerCost));
+			for(int j= 0; j < count; ++j)
+			{
+				float cost= c.costs[n.local * count + j];
+				if(j != n.local && cost >= 0.f)
+					edges.push_back(std::make_pair(c.nodeIds[j], cost));
+			}
+
+			if(n.cluster == cg)
+			{
+				float d= goalDist[(n.cell / depth - goalCluster.x0) * goalCd + n.cell % depth - goalCluster.z0];
+				if(d < 1e30f)
+					edges.push_back(std::make_pair(goalId, d));
+			}
+		}
+
+		for(size_t e= 0; e < edges.size(); ++e)
+		{
+			int next= edges[e].first;
+			float ng= g + edges[e].second;
+
+			std::unordered_map<int, Visit>::iterator it= visits.find(next);
+			if(it != visits.end() && (it->second.closed || it->second.g <= ng))
+				continue;
+
+			Visit nv= {ng, cur.id, false};
+			visits[next]= nv;
+			int cell= next == goalId ? goal : nodes[next].cell;
+			Open o= {ng + heuristic(cell, goal), next};
+			open.push(o);
+		}
+	}
+
+	if(!found)
+	{
+		path.clear();
+		return false;
+	}
+
+	std::vector<int> hops;
+	for(int id= goalId; id >= 0; id= visits[id].parent)
+		hops.push_back(id);
+	std::reverse(hops.begin(), hops.end());
+
+	//refine every hop, border crossings are a single step and everything
+	//else stays inside one cluster
+	int prevCell= start;
+	for(size_t i= 1; i < hops.size(); ++i)
+	{
+		int id= hops[i];
+		int cell= id == goalId ? goal : nodes[id].cell;
+		if(cell == prevCell)
+			continue;
+
+		int prevId= hops[i - 1];
+		if(prevId < startId && id < startId && nodes[prevId].partner == id)
+		{
+			path.push_back(ivec2(cell / depth, cell % depth));
+		}
+		else
+		{
+			int cluster= id == goalId ? cg : nodes[id].cluster;
+			if(!localPath(clusters[cluster], prevCell, cell, path))
+			{
+				path.clear();
+				return false;
+			}
+		}
+		prevCell= cell;
+	}
+	return true;
+}
+
+void Navigation::findPaths(const std::vector<Query> &queries, std::vector<std::vector<ivec2> > &paths, ThreadPool &pool)
+{
+	paths.resize(queries.size());
+
+	Timer timer;
+	std::vector<char> found(queries.size(), 0);
+	pool.parallelFor(0, (int)queries.size(), [&](int i) { found[i]= findPath(queries[i], paths[i]) ? 1 : 0; }, 4);
+	double ms= timer.elapsedMs();
+
+	stats.queries= (int)queries.size();
+	stats.pathsFound= (int)std::count(found.begin(), found.end(), 1);
+	stats.queryMs= ms;
+	stats.queriesPerSecond= ms > 0.0 ? queries.size() * 1000.0 / ms : 0.0;
+}
+
+double Navigation::benchmark(int numQueries, ThreadPool &pool)
+{
+	//fixed seed so runs are comparable
+	unsigned int seed= 12345;
+	std::vector<Query> queries;
+	//capped so a map with almost nothing walkable can't spin here forever
+	for(int attempt= 0; (int)queries.size() < numQueries && attempt < numQueries * 100; ++attempt)
+	{
+		int cells[4];
+		for(int k= 0; k < 4; ++k)
+		{
+			seed= seed * 1664525u + 1013904223u;
+			cells[k]= (int)((seed >> 8) % (unsigned int)(k % 2 == 0 ? width : depth));
+		}
+
+		Query q= {cells[0], cells[1], cells[2], cells[3]};
+		if(isWalkable(q.startX, q.startZ) && isWalkable(q.goalX, q.goalZ))
+			queries.push_back(q);
+	}
+
+	std::vector<std::vector<ivec2> > paths;
+	findPaths(queries, paths, pool);
+
+	printf("Navigation: %d queries on %dx%d (%d found) in %.1f ms, %.0f queries/s on %d threads\n",
+		stats.queries, width, depth, stats.pathsFound, stats.queryMs, stats.queriesPerSecond, pool.size());
+	return stats.queriesPerSecond;
+}
\ No newline at end of file
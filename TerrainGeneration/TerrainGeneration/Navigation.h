@@ -0,0 +1,114 @@
+#pragma once
+
+#include "HeightField.h"
+#include "ThreadPool.h"
+#include <vector>
+#include <glm/glm.hpp>
+using glm::ivec2;
+
+//hierarchical A* (HPA*) over the height field grid
+//the grid is cut into square clusters, transitions across cluster borders
+//become abstract nodes, and the cost of crossing each cluster between its
+//nodes is precomputed, so a query only searches the small abstract graph and
+//then refines each hop inside a single cluster
+class Navigation
+{
+public:
+	struct Query
+	{
+		int startX, startZ;
+		int goalX, goalZ;
+	};
+
+	struct Stats
+	{
+		int clusters;
+		int nodes;
+		double buildMs;
+		int queries;
+		int pathsFound;
+		double queryMs;
+		double queriesPerSecond;
+	};
+
+private:
+	struct Cluster
+	{
+		//cell rectangle, max exclusive
+		int x0, z0, x1, z1;
+		//cells that carry an abstract node, in a fixed border order
+		std::vector<int> nodeCells;
+		std::vector<int> nodeIds;
+		//nodeCells.size() squared path costs inside the cluster, negative when unreachable
+		std::vector<float> costs;
+	};
+
+	//pair of cells facing each other across a cluster border
+	struct Transition
+	{
+		int cellA;
+		int cellB;
+	};
+
+	struct Node
+	{
+		int cell;
+		int cluster;
+		//index into the cluster's nodeCells
+		int local;
+		//node on the other side of the border
+		int partner;
+		float partnerCost;
+	};
+
+	int width;
+	int depth;
+	int clusterSize;
+	int clustersX;
+	int clustersZ;
+	float maxSlope;
+	float slopeWeight;
+
+	//cost of entering each cell, zero where it's too steep to walk
+	std::vector<float> cellCost;
+	std::vector<Cluster> clusters;
+	//two per cluster, the border to its +x neighbour then the one to its +z neighbour
+	std::vector<std::vector<Transition> > borders;
+	std::vector<Node> nodes;
+	Stats stats;
+
+	void computeCellCosts(const HeightField &field, int x0, int z0, int x1, int z1, ThreadPool &pool);
+	void computeBorder(int cluster, int side);
+	void rebuildNodes();
+	void computeClusterCosts(int cluster);
+
+	int clusterOf(int cell) const;
+	float stepCost(int from, int to) const;
+	float heuristic(int from, int to) const;
+
+	//dijkstra inside one cluster, or A* when goal >= 0, returns false if goal wasn't reached
+	//dist and parent are indexed by cell relative to the cluster rectangle
+	bool localSearch(const Cluster &c, int start, int goal, std::vector<float> &dist, std::vector<int> &parent) const;
+	bool localPath(const Cluster &c, int start, int goal, std::vector<ivec2> &path) const;
+
+public:
+	Navigation();
+
+	//maxSlope is the steepest walkable rise per cell, slopeWeight how much
+	//steepness adds to the cost of a step
+	void Create(const HeightField &field, int clusterSize, float maxSlope, float slopeWeight, ThreadPool &pool);
+
+	//path from start to goal, both cells included, empty when there is none
+	//safe to call from several threads at once
+	bool findPath(const Query &query, std::vector<ivec2> &path) const;
+
+	//runs the queries across the pool and records the throughput in getStats
+	void findPaths(const std::vector<Query> &queries, std::vector<std::vector<ivec2> > &paths, ThreadPool &pool);
+
+	//random walkable start/goal pairs through findPaths, prints queries per second
+	double benchmark(int numQueries, ThreadPool &pool);
+
+	bool isWalkable(int x, int z) const;
+
+	const Stats& getStats() const { return stats; }
+};
\ No newline at end of file
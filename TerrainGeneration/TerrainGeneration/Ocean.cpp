@@ -0,0 +1,615 @@
+#include "Ocean.h"
+
+#include "Timer.h"
+#include "simd.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include <algorithm>
+#include <iostream>
+using std::cerr;
+using std::endl;
+
+namespace
+{
+	const float PI= 3.14159265f;
+	const float GRAVITY= 9.81f;
+
+	//frames averaged into each timing report
+	const int reportFrames= 120;
+
+#ifdef TG_SSE2
+	//sin and cos of four angles in [-pi, pi], folded into [-pi/2, pi/2]
+	//where the Taylor series is good to a few 1e-6
+	inline void sinCos(__m128 x, __m128 &s, __m128 &c)
+	{
+		const __m128 halfPi= _mm_set1_ps(PI * 0.5f);
+		const __m128 pi= _mm_set1_ps(PI);
+		__m128 high= _mm_cmpgt_ps(x, halfPi);
+		__m128 low= _mm_cmplt_ps(x, _mm_sub_ps(_mm_setzero_ps(), halfPi));
+		__m128 y= _mm_or_ps(_mm_andnot_ps(high, x), _mm_and_ps(high, _mm_sub_ps(pi, x)));
+		y= _mm_or_ps(_mm_andnot_ps(low, y), _mm_and_ps(low, _mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), pi), x)));
+		__m128 flip= _mm_and_ps(_mm_or_ps(high, low), _mm_set1_ps(-0.f));
+
+		__m128 y2= _mm_mul_ps(y, y);
+		s= _mm_add_ps(_mm_set1_ps(-1.f / 5040.f), _mm_mul_ps(y2, _mm_set1_ps(1.f / 362880.f)));
+		s= _mm_add_ps(_mm_set1_ps(1.f / 120.f), _mm_mul_ps(y2, s));
+		s= _mm_add_ps(_mm_set1_ps(-1.f / 6.f), _mm_mul_ps(y2, s));
+		s= _mm_add_ps(_mm_set1_ps(1.f), _mm_mul_ps(y2, s));
+		s= _mm_mul_ps(y, s);
+
+		c= _mm_add_ps(_mm_set1_ps(1.f / 40320.f), _mm_mul_ps(y2, _mm_set1_ps(-1.f / 3628800.f)));
+		c= _mm_add_ps(_mm_set1_ps(-1.f / 720.f), _mm_mul_ps(y2, c));
+		c= _mm_add_ps(_mm_set1_ps(1.f / 24.f), _mm_mul_ps(y2, c));
+		c= _mm_add_ps(_mm_set1_ps(-0.5f), _mm_mul_ps(y2, c));
+		c= _mm_add_ps(_mm_set1_ps(1.f), _mm_mul_ps(y2, c));
+		c= _mm_xor_ps(c, flip);
+	}
+#endif
+}
+
+Ocean::Ocean() : size(0), logSize(0), patchSize(256.f), seaLevel(0.f), choppiness(1.f), repeatPeriod(200.f),
+	maxWave(0.f), displacementTex(0), normalTex(0), terrainTex(0), vaoHandle(0), vertexBuffer(0),
+	elementBuffer(0), numOfElements(0)
+{
+	stats.frames= 0;
+	stats.spectrumMs= 0.0;
+	stats.fftMs= 0.0;
+	stats.uploadMs= 0.0;
+	stats.totalMs= 0.0;
+	totals= stats;
+}
+
+Ocean::~Ocean()
+{
+	if(vaoHandle == 0)
+		return;
+	glDeleteVertexArrays(1, &vaoHandle);
+	glDeleteBuffers(1, &vertexBuffer);
+	glDeleteBuffers(1, &elementBuffer);
+	glDeleteTextures(1, &displacementTex);
+	glDeleteTextures(1, &normalTex);
+	glDeleteTextures(1, &terrainTex);
+}
+
+void Ocean::Create(const HeightField &field, int gridSize, float pSize, float level, vec2 wind, float amplitude)
+{
+	//the FFT only does powers of two, at least one SSE lane group wide
+	size= 4;
+	logSize= 2;
+	while(size < gridSize)
+	{
+		size<<= 1;
+		++logSize;
+	}
+	patchSize= pSize;
+	seaLevel= level;
+
+	bitReverse.resize(size);
+	for(int i= 0; i < size; ++i)
+	{
+		int r= 0;
+		for(int b= 0; b < logSize; ++b)
+			r|= ((i >> b) & 1) << (logSize - 1 - b);
+		bitReverse[i]= r;
+	}
+
+	twiddleRe.resize(size / 2);
+	twiddleIm.resize(size / 2);
+	for(int j= 0; j < size / 2; ++j)
+	{
+		twiddleRe[j]= (float)cos(2.0 * PI * j / size);
+		twiddleIm[j]= (float)sin(2.0 * PI * j / size);
+	}
+
+	buildSpectrum(wind, amplitude);
+
+	for(int s= 0; s < 2; ++s)
+	{
+		specRe[s].assign(size * size, 0.f);
+		specIm[s].assign(size * size, 0.f);
+	}
+	displacement.assign(size * size * 4, 0.f);
+	normals.assign(size * size * 4, 0.f);
+
+	try
+	{
+		prog.compileShader("shaders/ocean.vert", GLSLShader::VERTEX);
+		prog.compileShader("shaders/ocean.frag", GLSLShader::FRAGMENT);
+		prog.link();
+	}
+	catch(GLSLProgramException &e)
+	{
+		cerr<<e.what()<<endl;
+		exit(EXIT_FAILURE);
+	}
+
+	//units 1 to 3 belong to the ocean, unit 0 keeps the terrain texture
+	//simulation maps tile across the whole water plane
+	GLuint textures[2];
+	glGenTextures(2, textures);
+	displacementTex= textures[0];
+	normalTex= textures[1];
+	for(int t= 0; t < 2; ++t)
+	{
+		glActiveTexture(GL_TEXTURE1 + t);
+		glBindTexture(GL_TEXTURE_2D, textures[t]);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, size, size);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	}
+
+	//terrain heights for the per pixel shoreline, rows run along x like the grid
+	glGenTextures(1, &terrainTex);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, terrainTex);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, field.getDepth(), field.getWidth());
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, field.getDepth(), field.getWidth(), GL_RED, GL_FLOAT, field.heightData());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glActiveTexture(GL_TEXTURE0);
+
+	buildMesh(field, 4);
+}
+
+void Ocean::buildSpectrum(vec2 wind, float amplitude)
+{
+	int count= size * size;
+	h0Re.resize(count);
+	h0Im.resize(count);
+	h0ConjRe.resize(count);
+	h0ConjIm.resize(count);
+	omega.resize(count);
+	invK.resize(count);
+
+	waveNumber.resize(size);
+	for(int n= 0; n < size; ++n)
+		waveNumber[n]= 2.f * PI * (n - size / 2) / patchSize;
+
+	float windSpeed= glm::length(wind);
+	vec2 windDir= windSpeed > 0.f ? wind / windSpeed : vec2(1.f, 0.f);
+	//largest wave the wind can raise, and a cutoff for the tiny ones
+	float largest= windSpeed * windSpeed / GRAVITY;
+	float smallest= largest * 0.001f;
+	float baseFrequency= 2.f * PI / repeatPeriod;
+
+	//fixed seed so the sea looks the same every run
+	std::mt19937 random(1337);
+	std::normal_distribution<float> gaussian(0.f, 1.f);
+
+	std::vector<float> phillipsRoot(count);
+	double energy= 0.0;
+	for(int n= 0; n < size; ++n)
+	{
+		for(int m= 0; m < size; ++m)
+		{
+			int i= n * size + m;
+			vec2 k(waveNumber[n], waveNumber[m]);
+			float k2= glm::dot(k, k);
+			if(k2 < 1e-12f)
+			{
+				phillipsRoot[i]= 0.f;
+				omega[i]= 0.f;
+				invK[i]= 0.f;
+				continue;
+			}
+
+			float kLen= sqrt(k2);
+			float cosWind= glm::dot(k / kLen, windDir);
+			float p= amplitude * exp(-1.f / (k2 * largest * largest)) / (k2 * k2) * cosWind * cosWind;
+			p*= exp(-k2 * smallest * smallest);
+			//waves running against the wind are much weaker
+			if(cosWind < 0.f)
+				p*= 0.07f;
+			phillipsRoot[i]= sqrt(p * 0.5f);
+
+			omega[i]= floor(sqrt(GRAVITY * kLen) / baseFrequency) * baseFrequency;
+			invK[i]= 1.f / kLen;
+		}
+	}
+
+	for(int i= 0; i < count; ++i)
+	{
+		h0Re[i]= gaussian(random) * phillipsRoot[i];
+		h0Im[i]= gaussian(random) * phillipsRoot[i];
+		energy+= 2.0 * (h0Re[i] * h0Re[i] + h0Im[i] * h0Im[i]);
+	}
+
+	//conj(h0(-k)), -k wraps onto index size - n
+	for(int n= 0; n < size; ++n)
+	{
+		for(int m= 0; m < size; ++m)
+		{
+			int mirror= ((size - n) & (size - 1)) * size + ((size - m) & (size - 1));
+			h0ConjRe[n * size + m]= h0Re[mirror];
+			h0ConjIm[n * size + m]= -h0Im[mirror];
+		}
+	}
+
+	//the heights are a sum of many random waves, so they're close to gaussian
+	//and four standard deviations covers nearly every crest
+	maxWave= 4.f * (float)sqrt(energy);
+}
+
+void Ocean::animateSpectrum(float time, ThreadPool &pool)
+{
+	float t= fmod(time, repeatPeriod);
+
+	pool.parallelFor(0, size, [&](int n) {
+		const float kx= waveNumber[n];
+		const int row= n * size;
+		float *c0Re= &specRe[0][row], *c0Im= &specIm[0][row];
+		float *c1Re= &specRe[1][row], *c1Im= &specIm[1][row];
+
+#ifdef TG_SSE2
+		const __m128 vt= _mm_set1_ps(t);
+		const __m128 vkx= _mm_set1_ps(kx);
+		const __m128 twoPi= _mm_set1_ps(2.f * PI);
+		const __m128 invTwoPi= _mm_set1_ps(0.5f / PI);
+		for(int m= 0; m < size; m+= 4)
+		{
+			//wrap the phase into [-pi, pi] before the polynomial
+			__m128 phase= _mm_mul_ps(_mm_loadu_ps(&omega[row + m]), vt);
+			phase= _mm_sub_ps(phase, _mm_mul_ps(twoPi, _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(phase, invTwoPi)))));
+			__m128 s, c;
+			sinCos(phase, s, c);
+
+			//h(k, t) = h0(k) e^(iwt) + conj(h0(-k)) e^(-iwt)
+			__m128 ar= _mm_loadu_ps(&h0Re[row + m]), ai= _mm_loadu_ps(&h0Im[row + m]);
+			__m128 br= _mm_loadu_ps(&h0ConjRe[row + m]), bi= _mm_loadu_ps(&h0ConjIm[row + m]);
+			__m128 hr= _mm_add_ps(_mm_mul_ps(_mm_add_ps(ar, br), c), _mm_mul_ps(_mm_sub_ps(bi, ai), s));
+			__m128 hi= _mm_add_ps(_mm_mul_ps(_mm_sub_ps(ar, br), s), _mm_mul_ps(_mm_add_ps(ai, bi), c));
+
+			__m128 kz= _mm_loadu_ps(&waveNumber[m]);
+			__m128 ik= _mm_loadu_ps(&invK[row + m]);
+			__m128 ux= _mm_mul_ps(vkx, ik);
+			__m128 uz= _mm_mul_ps(kz, ik);
+
+			_mm_storeu_ps(c0Re + m, hr);
+			_mm_storeu_ps(c0Im + m, hi);
+			//(-i kx/|k| h) + i (-i kz/|k| h)
+			_mm_storeu_ps(c1Re + m, _mm_add_ps(_mm_mul_ps(ux, hi), _mm_mul_ps(uz, hr)));
+			_mm_storeu_ps(c1Im + m, _mm_sub_ps(_mm_mul_ps(uz, hi), _mm_mul_ps(ux, hr)));
+		}
+#else
+		for(int m= 0; m < size; ++m)
+		{
+			int i= row + m;
+			float phase= omega[i] * t;
+			float s= sin(phase);
+			float c= cos(phase);
+
+			float hr= (h0Re[i] + h0ConjRe[i]) * c + (h0ConjIm[i] - h0Im[i]) * s;
+			float hi= (h0Re[i] - h0ConjRe[i]) * s + (h0Im[i] + h0ConjIm[i]) * c;
+			float kz= waveNumber[m];
+			float ux= kx * invK[i];
+			float uz= kz * invK[i];
+
+			c0Re[m]= hr;
+			c0Im[m]= hi;
+			c1Re[m]= ux * hi + uz * hr;
+			c1Im[m]= uz * hi - ux * hr;
+		}
+#endif
+	}, 8);
+}
+
+void Ocean::fftLanes(float *re, float *im, int stride) const
+{
+	//four independent transforms side by side, element k of lane l lives at
+	//[k * stride + l], so every butterfly is one SSE op across the lanes
+	for(int i= 0; i < size; ++i)
+	{
+		int j= bitReverse[i];
+		if(j <= i)
+			continue;
+		for(int l= 0; l < 4; ++l)
+		{
+			std::swap(re[i * stride + l], re[j * stride + l]);
+			std::swap(im[i * stride + l], im[j * stride + l]);
+		}
+	}
+
+	for(int half= 1, step= size / 2; half < size; half<<= 1, step>>= 1)
+	{
+		for(int j= 0; j < half; ++j)
+		{
+			float wr= twiddleRe[j * step];
+			float wi= twiddleIm[j * step];
+#ifdef TG_SSE2
+			__m128 vwr= _mm_set1_ps(wr);
+			__m128 vwi= _mm_set1_ps(wi);
+			for(int i= j; i < size; i+= half * 2)
+			{
+				float *ar= re + i * stride, *ai= im + i * stride;
+				float *br= ar + half * stride, *bi= ai + half * stride;
+				__m128 xr= _mm_loadu_ps(br), xi= _mm_loadu_ps(bi);
+				__m128 tr= _mm_sub_ps(_mm_mul_ps(xr, vwr), _mm_mul_ps(xi, vwi));
+				__m128 ti= _mm_add_ps(_mm_mul_ps(xr, vwi), _mm_mul_ps(xi, vwr));
+				__m128 yr= _mm_loadu_ps(ar), yi= _mm_loadu_ps(ai);
+				_mm_storeu_ps(br, _mm_sub_ps(yr, tr));
+				_mm_storeu_ps(bi, _mm_sub_ps(yi, ti));
+				_mm_storeu_ps(ar, _mm_add_ps(yr, tr));
+				_mm_storeu_ps(ai, _mm_add_ps(yi, ti));
+			}
+#else
+			for(int i= j; i < size; i+= half * 2)
+			{
+				for(int l= 0; l < 4; ++l)
+				{
+					int a= i * stride + l;
+					int b= a + half * stride;
+					float tr= re[b] * wr - im[b] * wi;
+					float ti= re[b] * wi + im[b] * wr;
+					re[b]= re[a] - tr;
+					im[b]= im[a] - ti;
+					re[a]+= tr;
+					im[a]+= ti;
+				}
+			}
+#endif
+		}
+	}
+}
+
+void Ocean::transform(ThreadPool &pool)
+{
+	const int groups= size / 4;
+
+	//2D inverse FFT of every spectrum. Along n the four lanes are four
+	//neighbouring m, already side by side in memory, so they're just copied
+	//out to keep the butterflies in cache. Along m a 4 x size block is
+	//transposed into the scratch buffer instead
+	pool.parallelFor(0, groups * 2, [&](int task) {
+		int s= task / groups;
+		int first= (task % groups) * 4;
+		float *data[2]= {&specRe[s][first], &specIm[s][first]};
+		std::vector<float> scratch(size * 8);
+		float *lanes[2]= {&scratch[0], &scratch[size * 4]};
+
+		for(int part= 0; part < 2; ++part)
+		{
+			for(int k= 0; k < size; ++k)
+				memcpy(lanes[part] + k * 4, data[part] + k * size, 4 * sizeof(float));
+		}
+
+		fftLanes(lanes[0], lanes[1], 4);
+
+		for(int part= 0; part < 2; ++part)
+		{
+			for(int k= 0; k < size; ++k)
+				memcpy(data[part] + k * size, lanes[part] + k * 4, 4 * sizeof(float));
+		}
+	});
+
+	pool.parallelFor(0, groups * 2, [&](int task) {
+		int s= task / groups;
+		int row= (task % groups) * 4 * size;
+		float *data[2]= {&specRe[s][row], &specIm[s][row]};
+		std::vector<float> scratch(size * 8);
+		float *lanes[2]= {&scratch[0], &scratch[size * 4]};
+
+		for(int part= 0; part < 2; ++part)
+		{
+			const float *src= data[part];
+			float *dst= lanes[part];
+			for(int k= 0; k < size; k+= 4)
+			{
+#ifdef TG_SSE2
+				__m128 r0= _mm_loadu_ps(src + k), r1= _mm_loadu_ps(src + size + k);
+				__m128 r2= _mm_loadu_ps(src + size * 2 + k), r3= _mm_loadu_ps(src + size * 3 + k);
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+				_mm_storeu_ps(dst + k * 4, r0);
+				_mm_storeu_ps(dst + k * 4 + 4, r1);
+				_mm_storeu_ps(dst + k * 4 + 8, r2);
+				_mm_storeu_ps(dst + k * 4 + 12, r3);
+#else
+				for(int e= 0; e < 4; ++e)
+				{
+					for(int l= 0; l < 4; ++l)
+						dst[(k + e) * 4 + l]= src[l * size + k + e];
+				}
+#endif
+			}
+		}
+
+		fftLanes(lanes[0], lanes[1], 4);
+
+		for(int part= 0; part < 2; ++part)
+		{
+			const float *src= lanes[part];
+			float *dst= data[part];
+			for(int k= 0; k < size; k+= 4)
+			{
+#ifdef TG_SSE2
+				__m128 r0= _mm_loadu_ps(src + k * 4), r1= _mm_loadu_ps(src + k * 4 + 4);
+				__m128 r2= _mm_loadu_ps(src + k * 4 + 8), r3= _mm_loadu_ps(src + k * 4 + 12);
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+				_mm_storeu_ps(dst + k, r0);
+				_mm_storeu_ps(dst + size + k, r1);
+				_mm_storeu_ps(dst + size * 2 + k, r2);
+				_mm_storeu_ps(dst + size * 3 + k, r3);
+#else
+				for(int e= 0; e < 4; ++e)
+				{
+					for(int l= 0; l < 4; ++l)
+						dst[l * size + k + e]= src[(k + e) * 4 + l];
+				}
+#endif
+			}
+		}
+	});
+}
+
+void Ocean::buildMaps(ThreadPool &pool)
+{
+	pool.parallelFor(0, size, [&](int n) {
+		for(int m= 0; m < size; ++m)
+		{
+			int i= n * size + m;
+			//the spectrum is centered on k= 0, which flips every other sample
+			float sign= ((n + m) & 1) ? -1.f : 1.f;
+
+			float *d= &displacement[i * 4];
+			d[0]= sign * specRe[1][i] * choppiness;
+			d[1]= sign * specRe[0][i];
+			d[2]= sign * specIm[1][i] * choppiness;
+		}
+	}, 8);
+
+	//normals from the displaced surface itself, so they follow the sharpened
+	//crests the horizontal displacement makes, wrapping since the patch tiles
+	const float spacing= 2.f * patchSize / size;
+	pool.parallelFor(0, size, [&](int n) {
+		const float *prevRow= &displacement[((n + size - 1) & (size - 1)) * size * 4];
+		const float *nextRow= &displacement[((n + 1) & (size - 1)) * size * 4];
+		const float *row= &displacement[n * size * 4];
+		for(int m= 0; m < size; ++m)
+		{
+			const float *prev= row + ((m + size - 1) & (size - 1)) * 4;
+			const float *next= row + ((m + 1) & (size - 1)) * 4;
+			vec3 alongX(spacing + nextRow[m * 4] - prevRow[m * 4], nextRow[m * 4 + 1] - prevRow[m * 4 + 1],
+				nextRow[m * 4 + 2] - prevRow[m * 4 + 2]);
+			vec3 alongZ(next[0] - prev[0], next[1] - prev[1], spacing + next[2] - prev[2]);
+
+			vec3 normal= glm::normalize(glm::cross(alongZ, alongX));
+			float *nrm= &normals[(n * size + m) * 4];
+			nrm[0]= normal.x;
+			nrm[1]= normal.y;
+			nrm[2]= normal.z;
+		}
+	}, 8);
+}
+
+void Ocean::buildMesh(const HeightField &field, int gridStep)
+{
+	int width= field.getWidth();
+	int depth= field.getDepth();
+	int vertsX= (width - 1) / gridStep + 1;
+	int vertsZ= (depth - 1) / gridStep + 1;
+
+	std::vector<vec3> vertices;
+	vertices.reserve(vertsX * vertsZ);
+	for(int x= 0; x < vertsX; ++x)
+	{
+		for(int z= 0; z < vertsZ; ++z)
+			vertices.push_back(vec3((float)(x * gridStep), seaLevel, (float)(z * gridStep)));
+	}
+
+	//only quads where the terrain dips below the highest crest get water,
+	//the rest of the shoreline is cut per pixel in the fragment shader
+	std::vector<GLuint> indices;
+	for(int x= 0; x < vertsX - 1; ++x)
+	{
+		for(int z= 0; z < vertsZ - 1; ++z)
+		{
+			float lowest= 1e30f;
+			for(int cx= x * gridStep; cx <= (x + 1) * gridStep; ++cx)
+			{
+				for(int cz= z * gridStep; cz <= (z + 1) * gridStep; ++cz)
+					lowest= std::min(lowest, field.heightAt(cx, cz));
+			}
+			if(lowest > seaLevel + maxWave)
+				continue;
+
+			GLuint i00= x * vertsZ + z;
+			GLuint i10= i00 + vertsZ;
+			indices.push_back(i00);
+			indices.push_back(i00 + 1);
+			indices.push_back(i10);
+			indices.push_back(i10);
+			indices.push_back(i00 + 1);
+			indices.push_back(i10 + 1);
+		}
+	}
+	numOfElements= (int)indices.size();
+
+	glGenVertexArrays(1, &vaoHandle);
+	glGenBuffers(1, &vertexBuffer);
+	glGenBuffers(1, &elementBuffer);
+
+	glBindVertexArray(vaoHandle);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vec3), &vertices[0], GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+	if(numOfElements > 0)
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+	glBindVertexArray(0);
+
+	printf("Ocean: %dx%d spectrum, %d of %d water quads below the %.1f crest line\n",
+		size, size, numOfElements / 6, (vertsX - 1) * (vertsZ - 1), seaLevel + maxWave);
+}
+
+void Ocean::update(float time, ThreadPool &pool)
+{
+	Timer timer;
+	animateSpectrum(time, pool);
+	double spectrumMs= timer.elapsedMs();
+
+	timer.reset();
+	transform(pool);
+	buildMaps(pool);
+	double fftMs= timer.elapsedMs();
+
+	timer.reset();
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, displacementTex);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, GL_RGBA, GL_FLOAT, &displacement[0]);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, normalTex);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, GL_RGBA, GL_FLOAT, &normals[0]);
+	glActiveTexture(GL_TEXTURE0);
+	double uploadMs= timer.elapsedMs();
+
+	++totals.frames;
+	totals.spectrumMs+= spectrumMs;
+	totals.fftMs+= fftMs;
+	totals.uploadMs+= uploadMs;
+	totals.totalMs+= spectrumMs + fftMs + uploadMs;
+
+	//keep averages rather than every frame, the budget is 2 ms a frame
+	if(totals.frames == reportFrames)
+	{
+		double frames= totals.frames;
+		stats.frames= totals.frames;
+		stats.spectrumMs= totals.spectrumMs / frames;
+		stats.fftMs= totals.fftMs / frames;
+		stats.uploadMs= totals.uploadMs / frames;
+		stats.totalMs= totals.totalMs / frames;
+		totals.frames= 0;
+		totals.spectrumMs= totals.fftMs= totals.uploadMs= totals.totalMs= 0.0;
+	}
+}
+
+void Ocean::Render(const mat4 &mvp, const vec3 &cameraPos)
+{
+	if(numOfElements == 0)
+		return;
+
+	prog.use();
+	prog.setUniform("MVP", mvp);
+	prog.setUniform("CameraPosition", cameraPos);
+	prog.setUniform("PatchSize", patchSize);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, displacementTex);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, normalTex);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, terrainTex);
+	glActiveTexture(GL_TEXTURE0);
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glBindVertexArray(vaoHandle);
+	glDrawElements(GL_TRIANGLES, numOfElements, GL_UNSIGNED_INT, (void*)0);
+	glBindVertexArray(0);
+	glDisable(GL_BLEND);
+}
\ No newline at end of file
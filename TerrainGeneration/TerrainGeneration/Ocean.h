@@ -0,0 +1,104 @@
+#pragma once
+
+#include "GLSLProgram.h"
+#include "HeightField.h"
+#include "ThreadPool.h"
+#include <vector>
+#include <glm/glm.hpp>
+using glm::vec2;
+using glm::vec3;
+using glm::mat4;
+
+//Tessendorf style ocean: a Phillips spectrum is animated in frequency space
+//and turned into a tiling displacement and normal map with an inverse FFT
+//every frame, then drawn as a water plane over the parts of the height field
+//that lie below sea level
+class Ocean
+{
+public:
+	struct Stats
+	{
+		int frames;
+		//averages over the frames since the last report
+		double spectrumMs;
+		double fftMs;
+		double uploadMs;
+		double totalMs;
+	};
+
+private:
+	int size;
+	int logSize;
+	float patchSize;
+	float seaLevel;
+	float choppiness;
+	//frequencies are rounded to multiples of 2 pi / repeatPeriod, so the
+	//animation loops and the phases stay small enough for float
+	float repeatPeriod;
+	float maxWave;
+
+	//initial amplitudes h0(k) and conj(h0(-k)), the angular frequency of
+	//each wave and 1/|k|, all indexed [n * size + m] like the spectra
+	std::vector<float> h0Re, h0Im;
+	std::vector<float> h0ConjRe, h0ConjIm;
+	std::vector<float> omega;
+	std::vector<float> invK;
+	//wave number along one axis for index n
+	std::vector<float> waveNumber;
+
+	//the two spectra transformed each frame, the height, and both horizontal
+	//displacements packed into one as dispX + i dispZ since they're real
+	std::vector<float> specRe[2];
+	std::vector<float> specIm[2];
+
+	//bit reversal table and the N/2 inverse FFT twiddles
+	std::vector<int> bitReverse;
+	std::vector<float> twiddleRe;
+	std::vector<float> twiddleIm;
+
+	//rgba per texel indexed [n * size + m], so s runs along z and t along x
+	//like the terrain texture, displacement is (x, height, z, 0), normals (x, y, z, 0)
+	std::vector<float> displacement;
+	std::vector<float> normals;
+
+	GLuint displacementTex;
+	GLuint normalTex;
+	GLuint terrainTex;
+	GLuint vaoHandle;
+	GLuint vertexBuffer;
+	GLuint elementBuffer;
+	int numOfElements;
+
+	Stats stats;
+	Stats totals;
+
+	void buildSpectrum(vec2 wind, float amplitude);
+	void animateSpectrum(float time, ThreadPool &pool);
+	void transform(ThreadPool &pool);
+	void fftLanes(float *re, float *im, int stride) const;
+	void buildMaps(ThreadPool &pool);
+	void buildMesh(const HeightField &field, int gridStep);
+
+public:
+	GLSLProgram prog;
+
+	Ocean();
+	~Ocean();
+
+	//gridSize is the FFT resolution, 256 or 512, patchSize how many world units
+	//one tile of the simulation covers, wind in world units per second
+	void Create(const HeightField &field, int gridSize, float patchSize, float seaLevel, vec2 wind, float amplitude);
+
+	//advances the simulation to time seconds and uploads the new maps, the
+	//timings are averaged every 120 frames into getStats
+	void update(float time, ThreadPool &pool);
+
+	void Render(const mat4 &mvp, const vec3 &cameraPos);
+
+	float getSeaLevel() const { return seaLevel; }
+	const std::vector<float>& getDisplacement() const { return displacement; }
+	const std::vector<float>& getNormals() const { return normals; }
+
+	//timing of the most recent report period, see update
+	const Stats& getStats() const { return stats; }
+};
\ No newline at end of file
@@ -0,0 +1,729 @@
+#include "Physics.h"
+
+#include "Timer.h"
+#include "simd.h"
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+
+namespace
+{
+	//penetration the solver leaves alone so resting contacts don't jitter
+	const float SLOP= 0.01f;
+	//fraction of the remaining penetration pushed out each step
+	const float BAUMGARTE= 0.2f;
+	//terrain points this far above the ground still make a contact, so fast
+	//bodies are caught the step before they would sink in
+	const float SPECULATIVE_MARGIN= 0.1f;
+
+	//bodies, pairs or points handled by one broadphase / narrowphase task
+	const int GRAIN= 256;
+
+	//squared linear and angular speed below which a body counts as resting,
+	//and how many steps in a row it has to rest before it sleeps
+	const float SLEEP_SPEED= 0.04f;
+	const int SLEEP_STEPS= 30;
+
+	inline vec3 toLocal(const mat3 &r, const vec3 &v)
+	{
+		return vec3(glm::dot(r[0], v), glm::dot(r[1], v), glm::dot(r[2], v));
+	}
+
+	//world space inverse inertia times v
+	inline vec3 applyInvInertia(const Physics::Body &body, const vec3 &v)
+	{
+		return body.orientation * (body.invInertia * toLocal(body.orientation, v));
+	}
+
+	inline vec3 boxCorner(const Physics::Body &body, int corner)
+	{
+		vec3 local((corner & 1) ? body.halfExtents.x : -body.halfExtents.x,
+			(corner & 2) ? body.halfExtents.y : -body.halfExtents.y,
+			(corner & 4) ? body.halfExtents.z : -body.halfExtents.z);
+		return body.position + body.orientation * local;
+	}
+}
+
+Physics::Physics() : terrain(0), timeStep(1.f / 60.f), accumulator(0.f), iterations(8),
+	gravity(0.f, -9.81f, 0.f), friction(0.6f)
+{
+	stats.bodies= 0;
+	stats.pairs= 0;
+	stats.contacts= 0;
+	stats.islands= 0;
+	stats.sleeping= 0;
+	stats.broadphaseMs= 0.0;
+	stats.narrowphaseMs= 0.0;
+	stats.solveMs= 0.0;
+	stats.stepMs= 0.0;
+}
+
+void Physics::Create(const HeightField &field)
+{
+	terrain= &field;
+	clear();
+}
+
+void Physics::clear()
+{
+	bodies.clear();
+	contacts.clear();
+	pairs.clear();
+	accumulator= 0.f;
+}
+
+int Physics::addSphere(const vec3 &position, float radius, float mass)
+{
+	Body body;
+	body.position= position;
+	body.velocity= vec3(0.f);
+	body.angularVelocity= vec3(0.f);
+	body.orientation= mat3(1.f);
+	body.halfExtents= vec3(radius);
+	body.invMass= mass > 0.f ? 1.f / mass : 0.f;
+	//solid sphere, I = 2/5 m r^2
+	body.invInertia= vec3(mass > 0.f ? 2.5f / (mass * radius * radius) : 0.f);
+	body.boundingRadius= radius;
+	body.shape= SPHERE;
+	body.restingSteps= 0;
+	body.asleep= false;
+	bodies.push_back(body);
+	return (int)bodies.size() - 1;
+}
+
+int Physics::addBox(const vec3 &position, const vec3 &halfExtents, float mass)
+{
+	Body body;
+	body.position= position;
+	body.velocity= vec3(0.f);
+	body.angularVelocity= vec3(0.f);
+	body.orientation= mat3(1.f);
+	body.halfExtents= halfExtents;
+	body.invMass= mass > 0.f ? 1.f / mass : 0.f;
+	//solid box, I = m/12 (h^2 + d^2) with full sizes, here in half extents
+	vec3 e2= halfExtents * halfExtents;
+	body.invInertia= mass > 0.f ? vec3(3.f / (mass * (e2.y + e2.z)), 3.f / (mass * (e2.x + e2.z)),
+		3.f / (mass * (e2.x + e2.y))) : vec3(0.f);
+	body.boundingRadius= glm::length(halfExtents);
+	body.shape= BOX;
+	body.restingSteps= 0;
+	body.asleep= false;
+	bodies.push_back(body);
+	return (int)bodies.size() - 1;
+}
+
+void Physics::broadphase(ThreadPool &pool)
+{
+	pairs.clear();
+	const int count= (int)bodies.size();
+	if(count < 2)
+		return;
+
+	float lowX= 1e30f, lowZ= 1e30f, highX= -1e30f, highZ= -1e30f, largest= 0.f;
+	for(int i= 0; i < count; ++i)
+	{
+		const vec3 &p= bodies[i].position;
+		lowX= std::min(lowX, p.x);
+		lowZ= std::min(lowZ, p.z);
+		highX= std::max(highX, p.x);
+		highZ= std::max(highZ, p.z);
+		largest= std::max(largest, bodies[i].boundingRadius);
+	}
+
+	//cells at least as wide as the biggest body, so overlapping bodies are
+	//always in neighbouring cells, and no more cells than a few per body
+	float cellSize= std::max(largest * 2.f, 0.5f);
+	int cellsX, cellsZ;
+	for(;;)
+	{
+		cellsX= (int)((highX - lowX) / cellSize) + 1;
+		cellsZ= (int)((highZ - lowZ) / cellSize) + 1;
+		if((long long)cellsX * cellsZ <= (long long)count * 4)
+			break;
+		cellSize*= 2.f;
+	}
+
+	//counting sort of the bodies by cell
+	std::vector<int> cellOf(count);
+	cellStart.assign(cellsX * cellsZ + 1, 0);
+	for(int i= 0; i < count; ++i)
+	{
+		int cx= (int)((bodies[i].position.x - lowX) / cellSize);
+		int cz= (int)((bodies[i].position.z - lowZ) / cellSize);
+		cellOf[i]= cx * cellsZ + cz;
+		++cellStart[cellOf[i] + 1];
+	}
+	for(size_t c= 1; c < cellStart.size(); ++c)
+		cellStart[c]+= cellStart[c - 1];
+	cellBodies.resize(count);
+	std::vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+	for(int i= 0; i < count; ++i)
+		cellBodies[fill[cellOf[i]]++]= i;
+
+	//each task checks a slice of bodies against the 3x3 cells around them
+	int tasks= (count + GRAIN - 1) / GRAIN;
+	std::vector<std::vector<std::pair<int, int> > > found(tasks);
+	pool.parallelFor(0, tasks, [&](int t) {
+		int end= std::min((t + 1) * GRAIN, count);
+		for(int i= t * GRAIN; i < end; ++i)
+		{
+			const Body &a= bodies[i];
+			int cx= cellOf[i] / cellsZ;
+			int cz= cellOf[i] % cellsZ;
+			for(int x= std::max(cx - 1, 0); x <= std::min(cx + 1, cellsX - 1); ++x)
+			{
+				for(int z= std::max(cz - 1, 0); z <= std::min(cz + 1, cellsZ - 1); ++z)
+				{
+					int cell= x * cellsZ + z;
+					for(int k= cellStart[cell]; k < cellStart[cell + 1]; ++k)
+					{
+						int j= cellBodies[k];
+						if(j <= i || (!isMoving(a) && !isMoving(bodies[j])))
+							continue;
+						vec3 d= bodies[j].position - a.position;
+						float r= a.boundingRadius + bodies[j].boundingRadius;
+						if(glm::dot(d, d) < r * r)
+							found[t].push_back(std::make_pair(i, j));
+					}
+				}
+			}
+		}
+	});
+
+	for(int t= 0; t < tasks; ++t)
+		pairs.insert(pairs.end(), found[t].begin(), found[t].end());
+}
+
+void Physics::addPairContacts(int ia, int ib, std::vector<Contact> &out) const
+{
+	const Body &a= bodies[ia];
+	const Body &b= bodies[ib];
+	Contact c;
+
+	if(a.shape == SPHERE && b.shape == SPHERE)
+	{
+		vec3 d= a.position - b.position;
+		float dist= glm::length(d);
+		float depth= a.halfExtents.x + b.halfExtents.x - dist;
+		if(depth <= 0.f)
+			return;
+		c.a= ia;
+		c.b= ib;
+		c.normal= dist > 1e-6f ? d / dist : vec3(0.f, 1.f, 0.f);
+		c.point= b.position + c.normal * (b.halfExtents.x - depth * 0.5f);
+		c.depth= depth;
+		out.push_back(c);
+		return;
+	}
+
+	if(a.shape == SPHERE || b.shape == SPHERE)
+	{
+		int is= a.shape == SPHERE ? ia : ib;
+		int ibox= a.shape == SPHERE ? ib : ia;
+		const Body &sphere= bodies[is];
+		const Body &box= bodies[ibox];
+
+		//closest point of the box to the sphere center, in box space
+		vec3 local= toLocal(box.orientation, sphere.position - box.position);
+		vec3 closest= glm::min(glm::max(local, -box.halfExtents), box.halfExtents);
+		vec3 d= local - closest;
+		float dist= glm::length(d);
+		float radius= sphere.halfExtents.x;
+		if(dist >= radius)
+			return;
+
+		vec3 localNormal;
+		float depth;
+		if(dist > 1e-6f)
+		{
+			localNormal= d / dist;
+			depth= radius - dist;
+		}
+		else
+		{
+			//center inside the box, push out through the nearest face
+			vec3 gap= box.halfExtents - glm::abs(local);
+			int axis= gap.x < gap.y ? (gap.x < gap.z ? 0 : 2) : (gap.y < gap.z ? 1 : 2);
+			localNormal= vec3(0.f);
+			localNormal[axis]= local[axis] < 0.f ? -1.f : 1.f;
+			depth= gap[axis] + radius;
+		}
+
+		c.a= is;
+		c.b= ibox;
+		c.normal= box.orientation * localNormal;
+		c.point= box.position + box.orientation * closest;
+		c.depth= depth;
+		out.push_back(c);
+		return;
+	}
+
+	//box against box, every corner of one that ends up inside the other
+	//pushes out through that box's nearest face
+	for(int side= 0; side < 2; ++side)
+	{
+		const Body &corners= side == 0 ? a : b;
+		const Body &solid= side == 0 ? b : a;
+		for(int k= 0; k < 8; ++k)
+		{
+			vec3 corner= boxCorner(corners, k);
+			vec3 local= toLocal(solid.orientation, corner - solid.position);
+			vec3 gap= solid.halfExtents - glm::abs(local);
+			if(gap.x <= 0.f || gap.y <= 0.f || gap.z <= 0.f)
+				continue;
+
+			int axis= gap.x < gap.y ? (gap.x < gap.z ? 0 : 2) : (gap.y < gap.z ? 1 : 2);
+			vec3 localNormal(0.f);
+			localNormal[axis]= local[axis] < 0.f ? -1.f : 1.f;
+
+			c.a= side == 0 ? ia : ib;
+			c.b= side == 0 ? ib : ia;
+			c.normal= solid.orientation * localNormal;
+			c.point= corner;
+			c.depth= gap[axis];
+			out.push_back(c);
+		}
+	}
+}
+
+void Physics::collidePairs(ThreadPool &pool)
+{
+	int tasks= ((int)pairs.size() + GRAIN - 1) / GRAIN;
+	std::vector<std::vector<Contact> > found(tasks);
+	pool.parallelFor(0, tasks, [&](int t) {
+		int end= std::min((t + 1) * GRAIN, (int)pairs.size());
+		for(int p= t * GRAIN; p < end; ++p)
+			addPairContacts(pairs[p].first, pairs[p].second, found[t]);
+	});
+
+	for(int t= 0; t < tasks; ++t)
+		contacts.insert(contacts.end(), found[t].begin(), found[t].end());
+}
+
+void Physics::collideTerrain(ThreadPool &pool)
+{
+	//every sphere is one test point with its radius, every box its eight
+	//corners with none, laid out flat so four go through SSE at once
+	std::vector<float> px, py, pz, pr;
+	std::vector<int> owner;
+	for(int i= 0; i < (int)bodies.size(); ++i)
+	{
+		const Body &body= bodies[i];
+		if(!isMoving(body))
+			continue;
+		int n= body.shape == SPHERE ? 1 : 8;
+		for(int k= 0; k < n; ++k)
+		{
+			vec3 p= body.shape == SPHERE ? body.position : boxCorner(body, k);
+			px.push_back(p.x);
+			py.push_back(p.y);
+			pz.push_back(p.z);
+			pr.push_back(body.shape == SPHERE ? body.halfExtents.x : 0.f);
+			owner.push_back(i);
+		}
+	}
+
+	//pad to a whole batch with points far above the terrain
+	while(px.size() % 4 != 0)
+	{
+		px.push_back(0.f);
+		py.push_back(1e30f);
+		pz.push_back(0.f);
+		pr.push_back(0.f);
+		owner.push_back(-1);
+	}
+
+	const int points= (int)px.size();
+	const int width= terrain->getWidth();
+	const int depth= terrain->getDepth();
+	const float *h= terrain->heightData();
+	const float maxX= width - 1.001f;
+	const float maxZ= depth - 1.001f;
+
+	int tasks= (points + GRAIN - 1) / GRAIN;
+	std::vector<std::vector<Contact> > found(tasks);
+	pool.parallelFor(0, tasks, [&](int t) {
+		int end= std::min((t + 1) * GRAIN, points);
+		for(int p= t * GRAIN; p < end; p+= 4)
+		{
+			float height[4], nx[4], ny[4], nz[4], pen[4];
+#ifdef TG_SSE2
+			__m128 x= _mm_min_ps(_mm_max_ps(_mm_loadu_ps(&px[p]), _mm_setzero_ps()), _mm_set1_ps(maxX));
+			__m128 z= _mm_min_ps(_mm_max_ps(_mm_loadu_ps(&pz[p]), _mm_setzero_ps()), _mm_set1_ps(maxZ));
+			__m128i ix= _mm_cvttps_epi32(x);
+			__m128i iz= _mm_cvttps_epi32(z);
+			__m128 fx= _mm_sub_ps(x, _mm_cvtepi32_ps(ix));
+			__m128 fz= _mm_sub_ps(z, _mm_cvtepi32_ps(iz));
+
+			//the four corners of each point's grid cell
+			int cellX[4], cellZ[4];
+			_mm_storeu_si128((__m128i*)cellX, ix);
+			_mm_storeu_si128((__m128i*)cellZ, iz);
+			float c00[4], c10[4], c01[4], c11[4];
+			for(int l= 0; l < 4; ++l)
+			{
+				const float *cell= h + cellX[l] * depth + cellZ[l];
+				c00[l]= cell[0];
+				c01[l]= cell[1];
+				c10[l]= cell[depth];
+				c11[l]= cell[depth + 1];
+			}
+			__m128 h00= _mm_loadu_ps(c00), h10= _mm_loadu_ps(c10);
+			__m128 h01= _mm_loadu_ps(c01), h11= _mm_loadu_ps(c11);
+
+			//bilinear height and its gradient across the cell
+			__m128 dx0= _mm_sub_ps(h10, h00);
+			__m128 dx1= _mm_sub_ps(h11, h01);
+			__m128 dz0= _mm_sub_ps(h01, h00);
+			__m128 dz1= _mm_sub_ps(h11, h10);
+			__m128 h0= _mm_add_ps(h00, _mm_mul_ps(dx0, fx));
+			__m128 h1= _mm_add_ps(h01, _mm_mul_ps(dx1, fx));
+			__m128 vh= _mm_add_ps(h0, _mm_mul_ps(_mm_sub_ps(h1, h0), fz));
+			__m128 gx= _mm_add_ps(dx0, _mm_mul_ps(_mm_sub_ps(dx1, dx0), fz));
+			__m128 gz= _mm_add_ps(dz0, _mm_mul_ps(_mm_sub_ps(dz1, dz0), fx));
+
+			//normal (-gx, 1, -gz) normalized, and the distance of the point
+			//below the tangent plane less its radius
+			__m128 one= _mm_set1_ps(1.f);
+			__m128 inv= _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(one, _mm_add_ps(_mm_mul_ps(gx, gx), _mm_mul_ps(gz, gz)))));
+			__m128 vnx= _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(gx, inv));
+			__m128 vnz= _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(gz, inv));
+			__m128 vpen= _mm_sub_ps(_mm_loadu_ps(&pr[p]), _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&py[p]), vh), inv));
+
+			int hits= _mm_movemask_ps(_mm_cmpgt_ps(vpen, _mm_set1_ps(-SPECULATIVE_MARGIN)));
+			if(hits == 0)
+				continue;
+			_mm_storeu_ps(height, vh);
+			_mm_storeu_ps(nx, vnx);
+			_mm_storeu_ps(ny, inv);
+			_mm_storeu_ps(nz, vnz);
+			_mm_storeu_ps(pen, vpen);
+#else
+			int hits= 0;
+			for(int l= 0; l < 4; ++l)
+			{
+				float x= std::min(std::max(px[p + l], 0.f), maxX);
+				float z= std::min(std::max(pz[p + l], 0.f), maxZ);
+				int cx= (int)x;
+				int cz= (int)z;
+				float fx= x - cx;
+				float fz= z - cz;
+				const float *cell= h + cx * depth + cz;
+				float dx0= cell[depth] - cell[0];
+				float dx1= cell[depth + 1] - cell[1];
+				float dz0= cell[1] - cell[0];
+				float dz1= cell[depth + 1] - cell[depth];
+				float h0= cell[0] + dx0 * fx;
+				float h1= cell[1] + dx1 * fx;
+				float gx= dx0 + (dx1 - dx0) * fz;
+				float gz= dz0 + (dz1 - dz0) * fx;
+				float inv= 1.f / sqrt(1.f + gx * gx + gz * gz);
+				height[l]= h0 + (h1 - h0) * fz;
+				nx[l]= -gx * inv;
+				ny[l]= inv;
+				nz[l]= -gz * inv;
+				pen[l]= pr[p + l] - (py[p + l] - height[l]) * inv;
+				if(pen[l] > -SPECULATIVE_MARGIN)
+					hits|= 1 << l;
+			}
+			if(hits == 0)
+				continue;
+#endif
+			for(int l= 0; l < 4; ++l)
+			{
+				if(!(hits & (1 << l)) || owner[p + l] < 0)
+					continue;
+				Contact c;
+				c.a= owner[p + l];
+				c.b= -1;
+				c.normal= vec3(nx[l], ny[l], nz[l]);
+				c.point= vec3(px[p + l], py[p + l], pz[p + l]) - c.normal * pr[p + l];
+				c.depth= pen[l];
+				found[t].push_back(c);
+			}
+		}
+	});
+
+	for(int t= 0; t < tasks; ++t)
+		contacts.insert(contacts.end(), found[t].begin(), found[t].end());
+}
+
+void Physics::buildIslands()
+{
+	const int count= (int)bodies.size();
+
+	//anything awake touching a sleeping body wakes it, after this every
+	//contact is between moving bodies or against something static
+	for(size_t c= 0; c < contacts.size(); ++c)
+	{
+		int a= contacts[c].a;
+		int b= contacts[c].b;
+		if(b < 0)
+			continue;
+		if(bodies[a].asleep && isMoving(bodies[b]))
+		{
+			bodies[a].asleep= false;
+			bodies[a].restingSteps= 0;
+		}
+		else if(bodies[b].asleep && isMoving(bodies[a]))
+		{
+			bodies[b].asleep= false;
+			bodies[b].restingSteps= 0;
+		}
+	}
+
+	//union find over the body pairs in contact, static bodies and the
+	//terrain never join islands since nothing they touch can move them
+	std::vector<int> parent(count);
+	for(int i= 0; i < count; ++i)
+		parent[i]= i;
+
+	auto root= [&](int i) -> int {
+		while(parent[i] != i)
+		{
+			parent[i]= parent[parent[i]];
+			i= parent[i];
+		}
+		return i;
+	};
+
+	for(size_t c= 0; c < contacts.size(); ++c)
+	{
+		int a= contacts[c].a;
+		int b= contacts[c].b;
+		if(b < 0 || bodies[a].invMass == 0.f || bodies[b].invMass == 0.f)
+			continue;
+		int ra= root(a);
+		int rb= root(b);
+		if(ra != rb)
+			parent[ra]= rb;
+	}
+
+	//number the islands that have contacts and bucket the contacts by island
+	islandOf.assign(count, -1);
+	std::vector<int> contactIsland(contacts.size());
+	int islands= 0;
+	for(size_t c= 0; c < contacts.size(); ++c)
+	{
+		int body= bodies[contacts[c].a].invMass != 0.f ? contacts[c].a : contacts[c].b;
+		int r= root(body);
+		if(islandOf[r] < 0)
+			islandOf[r]= islands++;
+		contactIsland[c]= islandOf[r];
+	}
+
+	islandStart.assign(islands + 1, 0);
+	for(size_t c= 0; c < contacts.size(); ++c)
+		++islandStart[contactIsland[c] + 1];
+	for(int i= 1; i <= islands; ++i)
+		islandStart[i]+= islandStart[i - 1];
+	islandContacts.resize(contacts.size());
+	std::vector<int> fill(islandStart.begin(), islandStart.end() - 1);
+	for(size_t c= 0; c < contacts.size(); ++c)
+		islandContacts[fill[contactIsland[c]]++]= (int)c;
+	constraints.resize(contacts.size());
+
+	stats.islands= islands;
+}
+
+void Physics::solveIsland(int island)
+{
+	const int first= islandStart[island];
+	const int last= islandStart[island + 1];
+	const float invStep= 1.f / timeStep;
+
+	//the terrain as a body that never moves
+	Body ground;
+	ground.invMass= 0.f;
+	ground.invInertia= vec3(0.f);
+	ground.velocity= vec3(0.f);
+	ground.angularVelocity= vec3(0.f);
+
+	for(int i= first; i < last; ++i)
+	{
+		const Contact &contact= contacts[islandContacts[i]];
+		Constraint &c= constraints[i];
+		const Body &a= bodies[contact.a];
+		const Body &b= contact.b >= 0 ? bodies[contact.b] : ground;
+		vec3 rA= contact.point - a.position;
+		vec3 rB= contact.b >= 0 ? contact.point - b.position : vec3(0.f);
+
+		const vec3 &n= contact.normal;
+		vec3 tangent= glm::normalize(fabs(n.x) > 0.57f ? vec3(n.y, -n.x, 0.f) : vec3(0.f, n.z, -n.y));
+		c.a= contact.a;
+		c.b= contact.b;
+		c.axis[0]= n;
+		c.axis[1]= tangent;
+		c.axis[2]= glm::cross(n, tangent);
+
+		for(int k= 0; k < 3; ++k)
+		{
+			c.armA[k]= glm::cross(rA, c.axis[k]);
+			c.armB[k]= glm::cross(rB, c.axis[k]);
+			c.turnA[k]= applyInvInertia(a, c.armA[k]);
+			c.turnB[k]= applyInvInertia(b, c.armB[k]);
+			float kInv= a.invMass + b.invMass + glm::dot(c.armA[k], c.turnA[k]) + glm::dot(c.armB[k], c.turnB[k]);
+			c.mass[k]= kInv > 0.f ? 1.f / kInv : 0.f;
+			c.impulse[k]= 0.f;
+		}
+
+		//a gap may close this step but no further, penetration is pushed out a bit at a time
+		float depth= contact.depth;
+		c.bias= depth < 0.f ? depth * invStep : BAUMGARTE * invStep * std::max(depth - SLOP, 0.f);
+	}
+
+	for(int it= 0; it < iterations; ++it)
+	{
+		for(int i= first; i < last; ++i)
+		{
+			Constraint &c= constraints[i];
+			Body &a= bodies[c.a];
+			Body &b= c.b >= 0 ? bodies[c.b] : ground;
+
+			//friction first, limited by the normal impulse of the last pass,
+			//then the normal which may only push
+			for(int k= 2; k >= 0; --k)
+			{
+				float speed= glm::dot(a.velocity - b.velocity, c.axis[k]) + glm::dot(a.angularVelocity, c.armA[k])
+					- glm::dot(b.angularVelocity, c.armB[k]);
+				float total;
+				if(k == 0)
+				{
+					total= std::max(c.impulse[0] + (c.bias - speed) * c.mass[0], 0.f);
+				}
+				else
+				{
+					float limit= friction * c.impulse[0];
+					total= glm::clamp(c.impulse[k] - speed * c.mass[k], -limit, limit);
+				}
+				float lambda= total - c.impulse[k];
+				c.impulse[k]= total;
+
+				a.velocity+= c.axis[k] * (lambda * a.invMass);
+				a.angularVelocity+= c.turnA[k] * lambda;
+				b.velocity-= c.axis[k] * (lambda * b.invMass);
+				b.angularVelocity-= c.turnB[k] * lambda;
+			}
+		}
+	}
+}
+
+void Physics::integrate(ThreadPool &pool)
+{
+	const float dt= timeStep;
+	const float angularDamping= 1.f / (1.f + dt * 0.5f);
+	pool.parallelFor(0, (int)bodies.size(), [&](int i) {
+		Body &body= bodies[i];
+		if(!isMoving(body))
+			return;
+
+		body.position+= body.velocity * dt;
+		body.angularVelocity*= angularDamping;
+
+		//rotate the axes, then pull them back to orthonormal
+		mat3 &r= body.orientation;
+		for(int k= 0; k < 3; ++k)
+			r[k]+= glm::cross(body.angularVelocity, r[k]) * dt;
+		r[0]= glm::normalize(r[0]);
+		r[1]= glm::normalize(r[1] - r[0] * glm::dot(r[0], r[1]));
+		r[2]= glm::cross(r[0], r[1]);
+
+		bool resting= glm::dot(body.velocity, body.velocity) < SLEEP_SPEED
+			&& glm::dot(body.angularVelocity, body.angularVelocity) < SLEEP_SPEED;
+		body.restingSteps= resting ? body.restingSteps + 1 : 0;
+		if(body.restingSteps > SLEEP_STEPS)
+		{
+			body.asleep= true;
+			body.velocity= vec3(0.f);
+			body.angularVelocity= vec3(0.f);
+		}
+	}, GRAIN);
+}
+
+void Physics::step(ThreadPool &pool)
+{
+	Timer total;
+
+	for(size_t i= 0; i < bodies.size(); ++i)
+	{
+		if(isMoving(bodies[i]))
+			bodies[i].velocity+= gravity * timeStep;
+	}
+
+	Timer timer;
+	broadphase(pool);
+	stats.broadphaseMs= timer.elapsedMs();
+
+	timer.reset();
+	contacts.clear();
+	collidePairs(pool);
+	collideTerrain(pool);
+	stats.narrowphaseMs= timer.elapsedMs();
+
+	//islands never share a moving body, so they can be solved side by side
+	timer.reset();
+	buildIslands();
+	pool.parallelFor(0, stats.islands, [&](int island) { solveIsland(island); }, 16);
+	integrate(pool);
+	stats.solveMs= timer.elapsedMs();
+
+	stats.bodies= (int)bodies.size();
+	stats.sleeping= 0;
+	for(size_t i= 0; i < bodies.size(); ++i)
+		stats.sleeping+= bodies[i].asleep ? 1 : 0;
+	stats.pairs= (int)pairs.size();
+	stats.contacts= (int)contacts.size();
+	stats.stepMs= total.elapsedMs();
+}
+
+void Physics::update(float frameTime, ThreadPool &pool)
+{
+	accumulator= std::min(accumulator + frameTime, timeStep * 4.f);
+	while(accumulator >= timeStep)
+	{
+		step(pool);
+		accumulator-= timeStep;
+	}
+}
+
+double Physics::benchmark(int numBodies, int numSteps, ThreadPool &pool)
+{
+	clear();
+
+	//a square of mixed spheres and boxes in the middle of the map, close
+	//enough that they pile into each other as they land
+	const int side= (int)ceil(sqrt((double)numBodies));
+	const float spacing= 2.5f;
+	const float originX= terrain->getWidth() * 0.5f - side * spacing * 0.5f;
+	const float originZ= terrain->getDepth() * 0.5f - side * spacing * 0.5f;
+	unsigned int seed= 4321;
+	for(int i= 0; i < numBodies; ++i)
+	{
+		seed= seed * 1664525u + 1013904223u;
+		float size= 0.4f + (seed >> 8) % 1000 * 0.0006f;
+		float x= originX + (i % side) * spacing;
+		float z= originZ + (i / side) * spacing;
+		vec3 position(x, terrain->sampleHeight(x, z) + 3.f + (i % 5), z);
+		if(i % 2 == 0)
+			addSphere(position, size, 1.f);
+		else
+			addBox(position, vec3(size, size * 0.6f, size * 0.8f), 1.f);
+	}
+
+	double broad= 0.0, narrow= 0.0, solve= 0.0, total= 0.0;
+	for(int s= 0; s < numSteps; ++s)
+	{
+		step(pool);
+		broad+= stats.broadphaseMs;
+		narrow+= stats.narrowphaseMs;
+		solve+= stats.solveMs;
+		total+= stats.stepMs;
+	}
+
+	double steps= std::max(numSteps, 1);
+	printf("Physics: %d bodies, %d steps, %.2f ms/step (broadphase %.2f, narrowphase %.2f, solve %.2f), "
+		"last step %d pairs %d contacts %d islands %d asleep on %d threads\n",
+		stats.bodies, numSteps, total / steps, broad / steps, narrow / steps, solve / steps,
+		stats.pairs, stats.contacts, stats.islands, stats.sleeping, pool.size());
+	return total / steps;
+}
\ No newline at end of file
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "HeightField.h"
+#include "ThreadPool.h"
+#include <vector>
+#include <glm/glm.hpp>
+using glm::vec3;
+using glm::mat3;
+
+//lightweight rigid body physics for spheres and boxes over the height field
+//bodies are paired with a uniform grid, terrain contacts are generated four
+//points at a time with SSE, and every island of touching bodies is solved
+//with sequential impulses on its own pool task at a fixed time step
+class Physics
+{
+public:
+	enum Shape
+	{
+		SPHERE,
+		BOX
+	};
+
+	struct Body
+	{
+		vec3 position;
+		vec3 velocity;
+		vec3 angularVelocity;
+		//columns are the body axes in world space
+		mat3 orientation;
+		//radius in x for spheres
+		vec3 halfExtents;
+		float invMass;
+		//body space diagonal of the inverse inertia tensor
+		vec3 invInertia;
+		float boundingRadius;
+		Shape shape;
+		//bodies that stay slow for long enough are put to sleep and skipped
+		//until something awake touches them
+		int restingSteps;
+		bool asleep;
+	};
+
+	struct Stats
+	{
+		int bodies;
+		int pairs;
+		int contacts;
+		int islands;
+		int sleeping;
+		double broadphaseMs;
+		double narrowphaseMs;
+		double solveMs;
+		double stepMs;
+	};
+
+private:
+	//normal points from b towards a, b is -1 for the terrain
+	struct Contact
+	{
+		int a;
+		int b;
+		vec3 point;
+		vec3 normal;
+		float depth;
+
+	};
+
+	//a contact prepared for the solver, along the normal and the two
+	//friction directions: the arm crossed with each, and that turned by the
+	//inverse inertia, so the iterations are only dot products
+	struct Constraint
+	{
+		int a;
+		int b;
+		vec3 axis[3];
+		vec3 armA[3], armB[3];
+		vec3 turnA[3], turnB[3];
+		float mass[3];
+		float impulse[3];
+		float bias;
+	};
+
+	const HeightField *terrain;
+	std::vector<Body> bodies;
+	float timeStep;
+	float accumulator;
+	int iterations;
+	vec3 gravity;
+	float friction;
+
+	//broadphase grid, rebuilt every step over the bodies' footprint
+	std::vector<int> cellStart;
+	std::vector<int> cellBodies;
+	std::vector<std::pair<int, int> > pairs;
+
+	std::vector<Contact> contacts;
+	std::vector<int> islandOf;
+	//contact indices grouped by island, island i owns islandStart[i] to
+	//islandStart[i + 1] of these and of the constraints
+	std::vector<int> islandContacts;
+	std::vector<int> islandStart;
+	std::vector<Constraint> constraints;
+
+	Stats stats;
+
+	void broadphase(ThreadPool &pool);
+	void collidePairs(ThreadPool &pool);
+	void collideTerrain(ThreadPool &pool);
+	void buildIslands();
+	void solveIsland(int island);
+	void integrate(ThreadPool &pool);
+
+	void addPairContacts(int a, int b, std::vector<Contact> &out) const;
+
+	bool isMoving(const Body &body) const { return body.invMass != 0.f && !body.asleep; }
+
+public:
+	Physics();
+
+	void Create(const HeightField &field);
+
+	void clear();
+	int addSphere(const vec3 &position, float radius, float mass);
+	int addBox(const vec3 &position, const vec3 &halfExtents, float mass);
+
+	//runs as many fixed steps as frameTime covers, at most four so a long
+	//frame can't snowball into longer and longer ones
+	void update(float frameTime, ThreadPool &pool);
+
+	void step(ThreadPool &pool);
+
+	//drops numBodies spheres and boxes over the map, runs numSteps fixed
+	//steps and prints the average time of each phase
+	double benchmark(int numBodies, int numSteps, ThreadPool &pool);
+
+	const std::vector<Body>& getBodies() const { return bodies; }
+	const Stats& getStats() const { return stats; }
+};
\ No newline at end of file
@@ -0,0 +1,471 @@
+#include "PlanetTerrain.h"
+
+#include <math.h>
+#include <queue>
+#include <algorithm>
+#include <iostream>
+using std::cerr;
+using std::endl;
+
+#include <glm/gtc/matrix_transform.hpp>
+using glm::vec3;
+using glm::vec4;
+
+namespace
+{
+	//cube face normal, then the s and t axes with s x t == normal so the
+	//tile grids come out counter clockwise seen from space
+	const double faceAxes[6][3][3]=
+	{
+		{{ 1, 0, 0}, {0, 0, -1}, {0, 1, 0}},
+		{{-1, 0, 0}, {0, 0, 1}, {0, 1, 0}},
+		{{0, 1, 0}, {1, 0, 0}, {0, 0, -1}},
+		{{0, -1, 0}, {1, 0, 0}, {0, 0, 1}},
+		{{0, 0, 1}, {1, 0, 0}, {0, 1, 0}},
+		{{0, 0, -1}, {-1, 0, 0}, {0, 1, 0}}
+	};
+
+	//world units covered by one height field texel on the surface
+	const double unitsPerTexel= 50.0;
+
+	//position and sphere direction
+	const int floatsPerVertex= 6;
+
+	//same as GL_MIRRORED_REPEAT, in texels
+	double mirrored(double c, double size)
+	{
+		c= fmod(fabs(c), 2.0 * size);
+		return c < size ? c : 2.0 * size - c;
+	}
+
+	struct Candidate
+	{
+		double priority;
+		int face, level, x, y;
+
+		bool operator<(const Candidate &other) const { return priority < other.priority; }
+	};
+}
+
+PlanetTerrain::PlanetTerrain() : field(NULL), pool(NULL), planetRadius(1.0), heightScale(1.0), texelsPerUnit(1.0),
+	elementBuffer(0), sampler(0), numOfElements(0), frame(0), maxDrawNodes(768), maxResidentTiles(2048),
+	maxBuildsPerFrame(32), splitThreshold(2.0)
+{
+	stats.nodesVisited= 0;
+	stats.nodesResident= 0;
+	stats.drawCalls= 0;
+	stats.frustumCulled= 0;
+	stats.horizonCulled= 0;
+	stats.tilesBuilt= 0;
+}
+
+PlanetTerrain::~PlanetTerrain()
+{
+	for(std::map<unsigned long long, Tile>::iterator it= tiles.begin(); it != tiles.end(); ++it)
+	{
+		glDeleteVertexArrays(1, &it->second.vaoHandle);
+		glDeleteBuffers(1, &it->second.vertexBuffer);
+	}
+	if(elementBuffer != 0)
+		glDeleteBuffers(1, &elementBuffer);
+	if(sampler != 0)
+		glDeleteSamplers(1, &sampler);
+}
+
+unsigned long long PlanetTerrain::keyOf(const NodeId &id)
+{
+	return ((unsigned long long)(id.face * 32 + id.level) << 40) |
+		((unsigned long long)id.x << 20) | (unsigned long long)id.y;
+}
+
+dvec3 PlanetTerrain::cubeToSphere(int face, double s, double t) const
+{
+	const double (*axes)[3]= faceAxes[face];
+	dvec3 p(axes[0][0] + axes[1][0] * s + axes[2][0] * t,
+		axes[0][1] + axes[1][1] * s + axes[2][1] * t,
+		axes[0][2] + axes[1][2] * s + axes[2][2] * t);
+	return glm::normalize(p);
+}
+
+double PlanetTerrain::elevation(const dvec3 &dir) const
+{
+	//mirrored repeat keeps the height field continuous across its own edges
+	//and the triplanar blend keeps it continuous across the cube edges
+	double w= field->getWidth();
+	double d= field->getDepth();
+
+	double wx= dir.x * dir.x * dir.x * dir.x;
+	double wy= dir.y * dir.y * dir.y * dir.y;
+	double wz= dir.z * dir.z * dir.z * dir.z;
+	double sum= wx + wy + wz;
+
+	double h= 0.0;
+	h+= wx * field->sampleHeight((float)mirrored(dir.y * texelsPerUnit, w), (float)mirrored(dir.z * texelsPerUnit, d));
+	h+= wy * field->sampleHeight((float)mirrored(dir.x * texelsPerUnit, w), (float)mirrored(dir.z * texelsPerUnit, d));
+	h+= wz * field->sampleHeight((float)mirrored(dir.x * texelsPerUnit, w), (float)mirrored(dir.y * texelsPerUnit, d));
+	return h / sum * heightScale;
+}
+
+double PlanetTerrain::altitude(const dvec3 &cameraPos) const
+{
+	double dist= glm::length(cameraPos);
+	return dist - (planetRadius + elevation(cameraPos / dist));
+}
+
+bool PlanetTerrain::Create(const HeightField &hField, double radius, double hScale, ThreadPool &threadPool)
+{
+	field= &hField;
+	pool= &threadPool;
+	planetRadius= radius;
+	heightScale= hScale;
+	texelsPerUnit= radius / unitsPerTexel;
+
+	generateElementArrayBuffer();
+
+	//the texture is shared with the flat height field, which wants plain repeat
+	glGenSamplers(1, &sampler);
+	glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
+	glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
+	glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	try
+	{
+		prog.compileShader("shaders/planet.vert", GLSLShader::VERTEX);
+		prog.compileShader("shaders/planet.frag", GLSLShader::FRAGMENT);
+		prog.link();
+	}
+	catch(GLSLProgramException &e)
+	{
+		cerr<<e.what()<<endl;
+		exit(EXIT_FAILURE);
+	}
+
+	//the six roots stay resident so there is always something to draw
+	std::vector<TileBuild> roots(6);
+	for(int f= 0; f < 6; ++f)
+	{
+		roots[f].id.face= f;
+		roots[f].id.level= 0;
+		roots[f].id.x= 0;
+		roots[f].id.y= 0;
+	}
+	pool->parallelFor(0, 6, [&](int i) { buildTile(roots[i]); });
+	for(int f= 0; f < 6; ++f)
+		uploadTile(roots[f]);
+
+	return true;
+}
+
+void PlanetTerrain::generateElementArrayBuffer()
+{
+	const int n= TILE_VERTS;
+	std::vector<GLuint> indices;
+
+	for(int j= 0; j < n - 1; ++j)
+	{
+		for(int i= 0; i < n - 1; ++i)
+		{
+			GLuint a= j * n + i;
+			indices.push_back(a);
+			indices.push_back(a + 1);
+			indices.push_back(a + n + 1);
+			indices.push_back(a);
+			indices.push_back(a + n + 1);
+			indices.push_back(a + n);
+		}
+	}
+
+	//skirts hang below each border to hide the cracks between levels
+	//skirt vertex k of border b hangs under the matching grid vertex, see buildTile
+	for(int b= 0; b < 4; ++b)
+	{
+		for(int k= 0; k < n - 1; ++k)
+		{
+			GLuint g0, g1;
+			switch(b)
+			{
+			case 0: g0= k; g1= k + 1; break;
+			case 1: g0= (n - 1) * n + k; g1= g0 + 1; break;
+			case 2: g0= k * n; g1= g0 + n; break;
+			default: g0= k * n + n - 1; g1= g0 + n; break;
+			}
+			GLuint s0= n * n + b * n + k;
+			indices.push_back(g0);
+			indices.push_back(s0);
+			indices.push_back(g1);
+			indices.push_back(g1);
+			indices.push_back(s0);
+			indices.push_back(s0 + 1);
+		}
+	}
+
+	glGenBuffers(1, &elementBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+
+	numOfElements= (int)indices.size();
+}
+
+void PlanetTerrain::buildTile(TileBuild &build) const
+{
+	const int n= TILE_VERTS;
+	double size= 2.0 / (1 << build.id.level);
+	double s0= -1.0 + build.id.x * size;
+	double t0= -1.0 + build.id.y * size;
+
+	dvec3 centerDir= cubeToSphere(build.id.face, s0 + size * 0.5, t0 + size * 0.5);
+	build.center= centerDir * (planetRadius + elevation(centerDir));
+
+	//world positions in double, stored relative to the center as float
+	std::vector<dvec3> dirs(n * n);
+	std::vector<double> radii(n * n);
+	for(int j= 0; j < n; ++j)
+	{
+		for(int i= 0; i < n; ++i)
+		{
+			dvec3 dir= cubeToSphere(build.id.face, s0 + size * i / (n - 1), t0 + size * j / (n - 1));
+			dirs[j * n + i]= dir;
+			radii[j * n + i]= planetRadius + elevation(dir);
+		}
+	}
+
+	double skirtDepth= size * planetRadius * 0.02 + heightScale * 8.0;
+	double maxDist= 0.0;
+
+	build.vertices.resize((n * n + 4 * n) * floatsPerVertex);
+	float *v= &build.vertices[0];
+	for(int k= 0; k < n * n + 4 * n; ++k)
+	{
+		int g;
+		double r;
+		if(k < n * n)
+		{
+			g= k;
+			r= radii[g];
+		}
+		else
+		{
+			int b= (k - n * n) / n;
+			int e= (k - n * n) % n;
+			switch(b)
+			{
+			case 0: g= e; break;
+			case 1: g= (n - 1) * n + e; break;
+			case 2: g= e * n; break;
+			default: g= e * n + n - 1; break;
+			}
+			r= radii[g] - skirtDepth;
+		}
+
+		dvec3 rel= dirs[g] * r - build.center;
+		maxDist= std::max(maxDist, glm::length(rel));
+
+		v[0]= (float)rel.x;
+		v[1]= (float)rel.y;
+		v[2]= (float)rel.z;
+		v[3]= (float)dirs[g].x;
+		v[4]= (float)dirs[g].y;
+		v[5]= (float)dirs[g].z;
+		v+= floatsPerVertex;
+	}
+	build.radius= (float)maxDist;
+}
+
+void PlanetTerrain::uploadTile(TileBuild &build)
+{
+	Tile tile;
+	tile.center= build.center;
+	tile.radius= build.radius;
+	tile.lastUsedFrame= frame;
+
+	glGenVertexArrays(1, &tile.vaoHandle);
+	glBindVertexArray(tile.vaoHandle);
+
+	glGenBuffers(1, &tile.vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, tile.vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, build.vertices.size() * sizeof(float), &build.vertices[0], GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, floatsPerVertex * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, floatsPerVertex * sizeof(float), (void*)(3 * sizeof(float)));
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+
+	glBindVertexArray(0);
+
+	tiles[keyOf(build.id)]= tile;
+}
+
+void PlanetTerrain::evictTiles()
+{
+	if((int)tiles.size() <= maxResidentTiles)
+		return;
+
+	//least recently used first, roots and this frame's tiles are never evicted
+	std::vector<std::pair<int, unsigned long long> > candidates;
+	for(std::map<unsigned long long, Tile>::iterator it= tiles.begin(); it != tiles.end(); ++it)
+	{
+		int level= (int)((it->first >> 40) & 31);
+		if(level > 0 && it->second.lastUsedFrame < frame)
+			candidates.push_back(std::make_pair(it->second.lastUsedFrame, it->first));
+	}
+
+	size_t excess= tiles.size() - maxResidentTiles;
+	if(excess > candidates.size())
+		excess= candidates.size();
+	std::partial_sort(candidates.begin(), candidates.begin() + excess, candidates.end());
+
+	for(size_t i= 0; i < excess; ++i)
+	{
+		Tile &tile= tiles[candidates[i].second];
+		glDeleteVertexArrays(1, &tile.vaoHandle);
+		glDeleteBuffers(1, &tile.vertexBuffer);
+		tiles.erase(candidates[i].second);
+	}
+}
+
+void PlanetTerrain::update(const dvec3 &cameraPos, const mat4 &viewProjection)
+{
+	++frame;
+	drawList.clear();
+	buildRequests.clear();
+	stats.nodesVisited= 0;
+	stats.frustumCulled= 0;
+	stats.horizonCulled= 0;
+
+	//frustum planes in camera relative space
+	vec4 planes[6];
+	for(int i= 0; i < 3; ++i)
+	{
+		vec4 row(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+		vec4 w(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+		planes[i * 2]= w + row;
+		planes[i * 2 + 1]= w - row;
+	}
+
+	//the horizon of the bare sphere, heights are never negative
+	double camDist= glm::length(cameraPos);
+	double camHorizon= camDist > planetRadius ? sqrt(camDist * camDist - planetRadius * planetRadius) : 0.0;
+
+	//most important split first, so the budget goes where the error is largest
+	std::priority_queue<Candidate> queue;
+	for(int f= 0; f < 6; ++f)
+	{
+		Candidate root= {0.0, f, 0, 0, 0};
+		queue.push(root);
+	}
+	int planned= 6;
+
+	while(!queue.empty())
+	{
+		Candidate c= queue.top();
+		queue.pop();
+		++stats.nodesVisited;
+
+		NodeId id= {c.face, c.level, c.x, c.y};
+		Tile &tile= tiles[keyOf(id)];
+		tile.lastUsedFrame= frame;
+
+		dvec3 rel= tile.center - cameraPos;
+		vec3 relf= vec3(rel);
+
+		bool culled= false;
+		for(int p= 0; p < 6 && !culled; ++p)
+		{
+			float len= sqrt(planes[p].x * planes[p].x + planes[p].y * planes[p].y + planes[p].z * planes[p].z);
+			float dist= planes[p].x * relf.x + planes[p].y * relf.y + planes[p].z * relf.z + planes[p].w;
+			culled= dist < -tile.radius * len;
+		}
+		if(culled)
+		{
+			++stats.frustumCulled;
+			--planned;
+			continue;
+		}
+
+		//hidden if even its highest point can't see over the curve of the planet
+		double dist= glm::length(rel);
+		if(camHorizon > 0.0)
+		{
+			double top= glm::length(tile.center) + tile.radius;
+			double tileHorizon= sqrt(std::max(0.0, top * top - planetRadius * planetRadius));
+			if(dist - tile.radius > camHorizon + tileHorizon)
+			{
+				++stats.horizonCulled;
+				--planned;
+				continue;
+			}
+		}
+
+		double size= planetRadius * 2.0 / (1 << id.level);
+		double error= size / std::max(dist - tile.radius, size * 1e-3);
+		if(error > splitThreshold && id.level < MAX_LEVEL && planned + 3 <= maxDrawNodes)
+		{
+			NodeId children[4];
+			bool ready= true;
+			for(int k= 0; k < 4; ++k)
+			{
+				NodeId child= {id.face, id.level + 1, id.x * 2 + (k & 1), id.y * 2 + (k >> 1)};
+				children[k]= child;
+				if(tiles.find(keyOf(child)) == tiles.end())
+				{
+					ready= false;
+					if((int)buildRequests.size() < maxBuildsPerFrame)
+						buildRequests.push_back(child);
+				}
+			}
+
+			//until all four children exist the parent keeps standing in for them
+			if(ready)
+			{
+				for(int k= 0; k < 4; ++k)
+				{
+					const Tile &ct= tiles[keyOf(children[k])];
+					double childDist= glm::length(ct.center - cameraPos);
+					Candidate cc= {size * 0.5 / std::max(childDist - ct.radius, size * 5e-4),
+						children[k].face, children[k].level, children[k].x, children[k].y};
+					queue.push(cc);
+				}
+				planned+= 3;
+				continue;
+			}
+		}
+
+		drawList.push_back(id);
+	}
+
+	//build the missing tiles in parallel, the gl side has to stay on this thread
+	std::vector<TileBuild> builds(buildRequests.size());
+	for(size_t i= 0; i < builds.size(); ++i)
+		builds[i].id= buildRequests[i];
+	pool->parallelFor(0, (int)builds.size(), [&](int i) { buildTile(builds[i]); });
+	for(size_t i= 0; i < builds.size(); ++i)
+		uploadTile(builds[i]);
+
+	evictTiles();
+
+	stats.tilesBuilt= (int)builds.size();
+	stats.nodesResident= (int)tiles.size();
+	stats.drawCalls= (int)drawList.size();
+}
+
+void PlanetTerrain::Render(const dvec3 &cameraPos, const mat4 &viewProjection)
+{
+	prog.use();
+	prog.setUniform("TexScale", (float)(texelsPerUnit / field->getWidth()));
+	glBindSampler(0, sampler);
+
+	for(size_t i= 0; i < drawList.size(); ++i)
+	{
+		const Tile &tile= tiles[keyOf(drawList[i])];
+
+		//the subtraction happens in double, only the small difference goes to the gpu
+		vec3 offset= vec3(tile.center - cameraPos);
+		prog.setUniform("MVP", viewProjection * glm::translate(mat4(1.0f), offset));
+
+		glBindVertexArray(tile.vaoHandle);
+		glDrawElements(GL_TRIANGLES, numOfElements, GL_UNSIGNED_INT, (void*)0);
+	}
+	glBindVertexArray(0);
+	glBindSampler(0, 0);
+}
\ No newline at end of file
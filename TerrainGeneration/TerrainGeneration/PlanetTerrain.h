@@ -0,0 +1,114 @@
+#pragma once
+
+#include "GLSLProgram.h"
+#include "HeightField.h"
+#include "ThreadPool.h"
+#include <vector>
+#include <map>
+#include <glm/glm.hpp>
+using glm::dvec3;
+using glm::mat4;
+
+//whole planet built from six quadtree faces of a cube projected onto a sphere
+//every node is a small height field tile whose vertices are stored relative to
+//the node center, and nodes are drawn relative to the camera in double
+//precision so nothing jitters at planetary radii
+class PlanetTerrain
+{
+public:
+	//vertices along each tile edge
+	static const int TILE_VERTS= 33;
+	static const int MAX_LEVEL= 18;
+
+	struct Stats
+	{
+		int nodesVisited;
+		int nodesResident;
+		int drawCalls;
+		int frustumCulled;
+		int horizonCulled;
+		int tilesBuilt;
+	};
+
+private:
+	struct Tile
+	{
+		GLuint vaoHandle;
+		GLuint vertexBuffer;
+		//world position of the tile center
+		dvec3 center;
+		//bounding sphere radius around center
+		float radius;
+		int lastUsedFrame;
+	};
+
+	struct NodeId
+	{
+		int face;
+		int level;
+		int x;
+		int y;
+	};
+
+	//cpu side result of building a tile on the pool
+	struct TileBuild
+	{
+		NodeId id;
+		dvec3 center;
+		float radius;
+		std::vector<float> vertices;
+	};
+
+	const HeightField *field;
+	ThreadPool *pool;
+	double planetRadius;
+	double heightScale;
+	//height field texels per unit of the unit sphere
+	double texelsPerUnit;
+
+	std::map<unsigned long long, Tile> tiles;
+	std::vector<NodeId> drawList;
+	std::vector<NodeId> buildRequests;
+	GLuint elementBuffer;
+	GLuint sampler;
+	int numOfElements;
+	int frame;
+	Stats stats;
+
+	//caps that keep node and draw counts bounded wherever the camera is
+	int maxDrawNodes;
+	int maxResidentTiles;
+	int maxBuildsPerFrame;
+	double splitThreshold;
+
+	static unsigned long long keyOf(const NodeId &id);
+	dvec3 cubeToSphere(int face, double s, double t) const;
+	double elevation(const dvec3 &dir) const;
+	void buildTile(TileBuild &build) const;
+	void uploadTile(TileBuild &build);
+	void generateElementArrayBuffer();
+	void evictTiles();
+
+public:
+	GLSLProgram prog;
+
+	PlanetTerrain();
+	~PlanetTerrain();
+
+	//heightScale is world units per height field step
+	bool Create(const HeightField &field, double radius, double heightScale, ThreadPool &pool);
+
+	//picks the nodes to draw for this camera and builds a few missing tiles
+	//viewProjection holds only the camera rotation and projection, no translation
+	void update(const dvec3 &cameraPos, const mat4 &viewProjection);
+
+	void Render(const dvec3 &cameraPos, const mat4 &viewProjection);
+
+	//height of cameraPos above the surface directly below it
+	double altitude(const dvec3 &cameraPos) const;
+
+	double getRadius() const { return planetRadius; }
+	double getMaxElevation() const { return 255.0 * heightScale; }
+
+	const Stats& getStats() const { return stats; }
+};
\ No newline at end of file
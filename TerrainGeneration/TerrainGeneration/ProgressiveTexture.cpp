@@ -0,0 +1,138 @@
+#include "ProgressiveTexture.h"
+
+#include <stdio.h>
+#include <iostream>
+using std::cerr;
+using std::endl;
+
+ProgressiveTexture::ProgressiveTexture() : texID(0), bytesPerFrame(0), storageCreated(false), complete(false),
+	width(0), height(0), glFormat(0), readyLevel(0), failed(false)
+{
+	stats.levels= 0;
+	stats.baseLevel= 0;
+	stats.frames= 0;
+	stats.uploadedBytes= 0;
+	stats.firstLevelMs= 0.0;
+	stats.completeMs= 0.0;
+}
+
+ProgressiveTexture::~ProgressiveTexture()
+{
+	//Destroy should have run while the context was still there
+	if(loader.joinable())
+		loader.join();
+}
+
+void ProgressiveTexture::Create(const char *fileName, BlockCompressor::Quality quality, size_t bytesPerFrame,
+	TextureCache &cache)
+{
+	this->fileName= fileName;
+	this->bytesPerFrame= bytesPerFrame;
+	clock.reset();
+
+	//something to sample while the loader works
+	const GLubyte grey[4]= { 128, 128, 128, 255 };
+	glGenTextures(1, &texID);
+	glBindTexture(GL_TEXTURE_2D, texID);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+	loader= std::thread(&ProgressiveTexture::load, this, &cache, quality);
+}
+
+void ProgressiveTexture::Destroy()
+{
+	if(loader.joinable())
+		loader.join();
+	if(texID)
+		glDeleteTextures(1, &texID);
+	texID= 0;
+	image.clear();
+}
+
+void ProgressiveTexture::load(TextureCache *cache, BlockCompressor::Quality quality)
+{
+	try
+	{
+		cache->prepare(fileName.c_str(), quality, image, [this](int level) { levelReady(level); });
+	}
+	catch(TGAIO::IOException &e)
+	{
+		cerr<<"ProgressiveTexture: "<<e.what()<<endl;
+		std::unique_lock<std::mutex> lock(readyMutex);
+		failed= true;
+	}
+}
+
+//runs on the loader, the layout is read once with the first level
+void ProgressiveTexture::levelReady(int level)
+{
+	std::unique_lock<std::mutex> lock(readyMutex);
+	if(failed)
+		return;
+	if(levels.empty() && !TextureCache::describe(image.bytes(), image.size(), width, height, glFormat, levels))
+	{
+		cerr<<"ProgressiveTexture: "<<fileName<<" came back damaged"<<endl;
+		levels.clear();
+		failed= true;
+		return;
+	}
+	readyLevel= level;
+}
+
+bool ProgressiveTexture::update()
+{
+	glBindTexture(GL_TEXTURE_2D, texID);
+	if(complete || texID == 0)
+		return complete;
+	++stats.frames;
+
+	int ready, count;
+	{
+		std::unique_lock<std::mutex> lock(readyMutex);
+		ready= readyLevel;
+		count= (int)levels.size();
+	}
+	//levels is only written with the first level, so it is safe to read from here on
+	if(ready >= count)
+		return false;
+
+	if(!storageCreated)
+	{
+		glTexStorage2D(GL_TEXTURE_2D, count, glFormat, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, count - 1);
+		storageCreated= true;
+		stats.levels= count;
+		stats.baseLevel= count;
+	}
+
+	//coarse to fine, always at least one level so a big base can't stall it
+	size_t sent= 0;
+	while(stats.baseLevel > ready)
+	{
+		const TextureCache::LevelInfo &level= levels[stats.baseLevel - 1];
+		if(sent > 0 && sent + level.bytes > bytesPerFrame)
+			break;
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, stats.baseLevel - 1, 0, 0, level.width, level.height, glFormat,
+			(GLsizei)level.bytes, image.bytes() + level.offset);
+		sent+= level.bytes;
+		--stats.baseLevel;
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, stats.baseLevel);
+	if(stats.uploadedBytes == 0 && sent > 0)
+		stats.firstLevelMs= clock.elapsedMs();
+	stats.uploadedBytes+= sent;
+
+	if(stats.baseLevel == 0)
+	{
+		complete= true;
+		stats.completeMs= clock.elapsedMs();
+		printf("ProgressiveTexture: %s first level after %.1f ms, all %d levels (%.1f MB) after %.1f ms over %d frames\n",
+			fileName.c_str(), stats.firstLevelMs, stats.levels, stats.uploadedBytes / 1048576.0, stats.completeMs,
+			stats.frames);
+	}
+	return complete;
+}
\ No newline at end of file
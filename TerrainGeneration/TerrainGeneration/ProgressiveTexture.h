@@ -0,0 +1,73 @@
+#pragma once
+
+#include "TextureCache.h"
+#include "Timer.h"
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+
+//a texture that is usable from the first frame and sharpens as it loads
+//a loader thread gets the mip chain from the texture cache, reading it or
+//building it smallest level first, and update() uploads whatever levels are
+//ready a few at a time, with the base level clamped to the finest level on
+//the gpu so sampling never touches one that isn't there yet
+//until the first level arrives the texture is a single grey texel
+class ProgressiveTexture
+{
+public:
+	struct Stats
+	{
+		int levels;
+		//finest level uploaded so far, levels when none is
+		int baseLevel;
+		int frames;
+		size_t uploadedBytes;
+		//from Create to the first real level and to the full chain on the gpu
+		double firstLevelMs;
+		double completeMs;
+	};
+
+private:
+	GLuint texID;
+	std::string fileName;
+	size_t bytesPerFrame;
+	bool storageCreated;
+	bool complete;
+	Timer clock;
+	Stats stats;
+
+	//shared with the loader, image only grows before the first level is
+	//ready, after that only levels not yet ready are written
+	std::thread loader;
+	std::mutex readyMutex;
+	TextureCache::Image image;
+	GLint width;
+	GLint height;
+	GLenum glFormat;
+	std::vector<TextureCache::LevelInfo> levels;
+	//levels readyLevel on are complete in image, levels.size() when none is
+	int readyLevel;
+	bool failed;
+
+	void load(TextureCache *cache, BlockCompressor::Quality quality);
+	void levelReady(int level);
+
+public:
+	ProgressiveTexture();
+	~ProgressiveTexture();
+
+	//starts loading fileName and returns at once, at least one level and
+	//about bytesPerFrame more go to the gpu on each update
+	void Create(const char *fileName, BlockCompressor::Quality quality, size_t bytesPerFrame, TextureCache &cache);
+	//waits for the loader and frees the texture, needs the context
+	void Destroy();
+
+	//once a frame on the gl thread, true once the whole chain is uploaded
+	//leaves the texture bound to the active unit
+	bool update();
+
+	GLuint getTexture() const { return texID; }
+	bool isComplete() const { return complete; }
+	const Stats& getStats() const { return stats; }
+};
\ No newline at end of file
@@ -0,0 +1,508 @@
+#include "PyramidBuilder.h"
+
+#include "Timer.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+using std::cerr;
+using std::endl;
+
+namespace
+{
+	//the source is far past 2GB at 32k x 32k x 2 bytes
+	bool seekTo(FILE *fp, long long offset)
+	{
+#ifdef _WIN32
+		return _fseeki64(fp, offset, SEEK_SET) == 0;
+#else
+		return fseeko(fp, (off_t)offset, SEEK_SET) == 0;
+#endif
+	}
+
+	//size and time stand in for the source's contents, hashing gigabytes on
+	//every run would take longer than checking the tiles
+	bool sourceInfo(const char *fileName, long long &size, long long &modified)
+	{
+#ifdef _WIN32
+		struct _stat64 info;
+		if(_stat64(fileName, &info) != 0)
+			return false;
+#else
+		struct stat info;
+		if(stat(fileName, &info) != 0)
+			return false;
+#endif
+		size= (long long)info.st_size;
+		modified= (long long)info.st_mtime;
+		return true;
+	}
+
+	bool sameBuild(const PyramidBuilder::Manifest &a, const PyramidBuilder::Manifest &b)
+	{
+		return a.source == b.source && a.sourceSize == b.sourceSize && a.sourceModified == b.sourceModified &&
+			a.width == b.width && a.depth == b.depth && a.sampleBytes == b.sampleBytes && a.tileSize == b.tileSize &&
+			a.levels == b.levels;
+	}
+
+	void makeDirectory(const std::string &dir)
+	{
+		//fails harmlessly when it's already there
+#ifdef _WIN32
+		_mkdir(dir.c_str());
+#else
+		mkdir(dir.c_str(), 0755);
+#endif
+	}
+
+	inline float decode(const unsigned char *data, size_t index, int sampleBytes)
+	{
+		if(sampleBytes == 1)
+			return data[index];
+		return (float)(data[index * 2] | data[index * 2 + 1] << 8);
+	}
+
+	inline void encode(unsigned char *data, size_t index, int sampleBytes, float value)
+	{
+		float top= sampleBytes == 1 ? 255.f : 65535.f;
+		int v= (int)(std::min(std::max(value, 0.f), top) + 0.5f);
+		if(sampleBytes == 1)
+		{
+			data[index]= (unsigned char)v;
+			return;
+		}
+		data[index * 2]= (unsigned char)(v & 0xFF);
+		data[index * 2 + 1]= (unsigned char)(v >> 8);
+	}
+
+	//the [1 3 3 1] / 8 tap that halves a level, output i reads inputs 2i - 1 to 2i + 2
+	inline float filter(float a, float b, float c, float d)
+	{
+		return (a + 3.f * b + 3.f * c + d) * 0.125f;
+	}
+}
+
+PyramidBuilder::PyramidBuilder() : width(0), depth(0), sampleBytes(1), tileSize(256), numLevels(0)
+{
+	stats.levels= 0;
+	stats.tilesWritten= 0;
+	stats.tilesSkipped= 0;
+	stats.bytesRead= 0;
+	stats.bytesWritten= 0;
+	stats.buildMs= 0.0;
+}
+
+int PyramidBuilder::levelWidth(int level) const
+{
+	return std::max((width + (1 << level) - 1) >> level, 1);
+}
+
+int PyramidBuilder::levelDepth(int level) const
+{
+	return std::max((depth + (1 << level) - 1) >> level, 1);
+}
+
+int PyramidBuilder::tilesDown(int level) const
+{
+	return (levelWidth(level) + tileSize - 1) / tileSize;
+}
+
+int PyramidBuilder::tilesAcross(int level) const
+{
+	return (levelDepth(level) + tileSize - 1) / tileSize;
+}
+
+std::string PyramidBuilder::tilePath(const std::string &dir, int level, int tx, int tz)
+{
+	char name[64];
+	sprintf(name, "/level%d_%d_%d.raw", level, tx, tz);
+	return dir + name;
+}
+
+bool PyramidBuilder::tileExists(int level, int tx, int tz) const
+{
+	FILE *fp= fopen(tilePath(directory, level, tx, tz).c_str(), "rb");
+	if(!fp)
+		return false;
+	fseek(fp, 0, SEEK_END);
+	long size= ftell(fp);
+	fclose(fp);
+	return size == (long)tileSize * tileSize * sampleBytes;
+}
+
+bool PyramidBuilder::writeTile(int level, int tx, int tz, const std::vector<float> &samples)
+{
+	std::vector<unsigned char> data(samples.size() * sampleBytes);
+	for(size_t i= 0; i < samples.size(); ++i)
+		encode(&data[0], i, sampleBytes, samples[i]);
+
+	//the tile only gets its real name once it's all on disk
+	std::string path= tilePath(directory, level, tx, tz);
+	std::string temp= path + ".tmp";
+	FILE *fp= fopen(temp.c_str(), "wb");
+	if(!fp)
+	{
+		cerr<<"Pyramid: can't write "<<temp<<endl;
+		return false;
+	}
+	bool written= fwrite(&data[0], 1, data.size(), fp) == data.size();
+	written= fclose(fp) == 0 && written;
+	if(!written || rename(temp.c_str(), path.c_str()) != 0)
+	{
+		cerr<<"Pyramid: can't write "<<path<<endl;
+		remove(temp.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool PyramidBuilder::readTile(const std::string &dir, int level, int tx, int tz, int tileSize, int sampleBytes,
+	std::vector<float> &samples)
+{
+	std::vector<unsigned char> data(tileSize * tileSize * sampleBytes);
+	FILE *fp= fopen(tilePath(dir, level, tx, tz).c_str(), "rb");
+	if(!fp)
+		return false;
+	bool complete= fread(&data[0], 1, data.size(), fp) == data.size();
+	fclose(fp);
+	if(!complete)
+		return false;
+
+	samples.resize(tileSize * tileSize);
+	for(int i= 0; i < tileSize * tileSize; ++i)
+		samples[i]= decode(&data[0], i, sampleBytes);
+	return true;
+}
+
+//level 0 is read tileSize rows of the source at a time and cut into tiles
+bool PyramidBuilder::buildBase(const char *sourceFile, ThreadPool &pool)
+{
+	FILE *fp= fopen(sourceFile, "rb");
+	if(!fp)
+	{
+		cerr<<"Pyramid: can't open "<<sourceFile<<endl;
+		return false;
+	}
+
+	std::vector<unsigned char> strip;
+	int across= tilesAcross(0);
+	for(int tx= 0; tx < tilesDown(0); ++tx)
+	{
+		std::vector<int> missing;
+		for(int tz= 0; tz < across; ++tz)
+		{
+			if(!tileExists(0, tx, tz))
+				missing.push_back(tz);
+		}
+		stats.tilesSkipped+= across - (int)missing.size();
+		if(missing.empty())
+			continue;
+
+		int x0= tx * tileSize;
+		int rows= std::min(tileSize, width - x0);
+		strip.resize((size_t)rows * depth * sampleBytes);
+		if(!seekTo(fp, (long long)x0 * depth * sampleBytes) || fread(&strip[0], 1, strip.size(), fp) != strip.size())
+		{
+			cerr<<"Pyramid: "<<sourceFile<<" is shorter than "<<width<<"x"<<depth<<endl;
+			fclose(fp);
+			return false;
+		}
+		stats.bytesRead+= strip.size();
+
+		//tiles past the edge of the map repeat its last row and column
+		std::vector<char> written(missing.size(), 0);
+		pool.parallelFor(0, (int)missing.size(), [&](int i) {
+			int tz= missing[i];
+			std::vector<float> samples(tileSize * tileSize);
+			for(int lx= 0; lx < tileSize; ++lx)
+			{
+				size_t row= (size_t)std::min(lx, rows - 1) * depth;
+				for(int lz= 0; lz < tileSize; ++lz)
+					samples[lx * tileSize + lz]= decode(&strip[0], row + std::min(tz * tileSize + lz, depth - 1), sampleBytes);
+			}
+			written[i]= writeTile(0, tx, tz, samples);
+		});
+
+		for(size_t i= 0; i < written.size(); ++i)
+		{
+			if(!written[i])
+			{
+				fclose(fp);
+				return false;
+			}
+		}
+		stats.tilesWritten+= (int)missing.size();
+	}
+	fclose(fp);
+	return true;
+}
+
+bool PyramidBuilder::loadStrip(int level, int row, Strip &strip, ThreadPool &pool)
+{
+	int stripDepth= levelDepth(level);
+	int rows= std::min(tileSize, levelWidth(level) - row * tileSize);
+	strip.row= row;
+	strip.samples.resize((size_t)tileSize * stripDepth);
+
+	std::vector<char> loaded(tilesAcross(level), 0);
+	pool.parallelFor(0, tilesAcross(level), [&](int tz) {
+		std::vector<float> samples;
+		if(!readTile(directory, level, row, tz, tileSize, sampleBytes, samples))
+			return;
+		int columns= std::min(tileSize, stripDepth - tz * tileSize);
+		for(int lx= 0; lx < rows; ++lx)
+			std::copy(&samples[lx * tileSize], &samples[lx * tileSize] + columns, &strip.samples[(size_t)lx * stripDepth + tz * tileSize]);
+		loaded[tz]= 1;
+	});
+
+	for(size_t tz= 0; tz < loaded.size(); ++tz)
+	{
+		if(!loaded[tz])
+		{
+			cerr<<"Pyramid: tile "<<tilePath(directory, level, row, (int)tz)<<" is missing"<<endl;
+			strip.row= -1;
+			return false;
+		}
+	}
+	stats.bytesRead+= (long long)loaded.size() * tileSize * tileSize * sampleBytes;
+	return true;
+}
+
+//every row of output tiles needs the input rows 2x - 1 to 2x + 2 below it,
+//which is at most four strips of input tiles, so those are kept and only
+//the two new ones are read for the next row
+bool PyramidBuilder::buildLevel(int level, ThreadPool &pool)
+{
+	int below= level - 1;
+	int inWidth= levelWidth(below);
+	int inDepth= levelDepth(below);
+	int outWidth= levelWidth(level);
+	int outDepth= levelDepth(level);
+	int across= tilesAcross(level);
+
+	Strip strips[4];
+	for(int s= 0; s < 4; ++s)
+		strips[s].row= -1;
+
+	for(int tx= 0; tx < tilesDown(level); ++tx)
+	{
+		std::vector<int> missing;
+		for(int tz= 0; tz < across; ++tz)
+		{
+			if(!tileExists(level, tx, tz))
+				missing.push_back(tz);
+		}
+		stats.tilesSkipped+= across - (int)missing.size();
+		if(missing.empty())
+			continue;
+
+		int firstRow= std::max(2 * tx - 1, 0);
+		int lastRow= std::min(2 * tx + 2, tilesDown(below) - 1);
+		for(int row= firstRow; row <= lastRow; ++row)
+		{
+			bool cached= false;
+			for(int s= 0; s < 4; ++s)
+				cached= cached || strips[s].row == row;
+			if(cached)
+				continue;
+			//reuse a strip this row and later ones won't need
+			int slot= 0;
+			while(strips[slot].row >= firstRow)
+				++slot;
+			if(!loadStrip(below, row, strips[slot], pool))
+				return false;
+		}
+
+		//input rows this tile row filters, clamped to the level below
+		int firstX= 2 * tx * tileSize - 1;
+		std::vector<const float*> inputRows(2 * tileSize + 2);
+		for(int k= 0; k < 2 * tileSize + 2; ++k)
+		{
+			int x= std::min(std::max(firstX + k, 0), inWidth - 1);
+			int s= 0;
+			while(strips[s].row != x / tileSize)
+				++s;
+			inputRows[k]= &strips[s].samples[(size_t)(x % tileSize) * inDepth];
+		}
+
+		std::vector<char> written(missing.size(), 0);
+		pool.parallelFor(0, (int)missing.size(), [&](int i) {
+			int tz= missing[i];
+			//filter along z first, then down the rows along x
+			std::vector<float> halfZ((2 * tileSize + 2) * tileSize);
+			for(int k= 0; k < 2 * tileSize + 2; ++k)
+			{
+				const float *in= inputRows[k];
+				for(int lz= 0; lz < tileSize; ++lz)
+				{
+					int z= 2 * std::min(tz * tileSize + lz, outDepth - 1);
+					halfZ[k * tileSize + lz]= filter(in[std::max(z - 1, 0)], in[std::min(z, inDepth - 1)],
+						in[std::min(z + 1, inDepth - 1)], in[std::min(z + 2, inDepth - 1)]);
+				}
+			}
+
+			std::vector<float> samples(tileSize * tileSize);
+			for(int lx= 0; lx < tileSize; ++lx)
+			{
+				int k= 2 * (std::min(tx * tileSize + lx, outWidth - 1) - tx * tileSize) + 1;
+				const float *p= &halfZ[k * tileSize];
+				for(int lz= 0; lz < tileSize; ++lz)
+					samples[lx * tileSize + lz]= filter(p[lz - tileSize], p[lz], p[lz + tileSize], p[lz + 2 * tileSize]);
+			}
+			written[i]= writeTile(level, tx, tz, samples);
+		});
+
+		for(size_t i= 0; i < written.size(); ++i)
+		{
+			if(!written[i])
+				return false;
+		}
+		stats.tilesWritten+= (int)missing.size();
+	}
+	return true;
+}
+
+void PyramidBuilder::removeTiles(const Manifest &manifest) const
+{
+	for(int level= 0; level < manifest.levels; ++level)
+	{
+		int w= std::max((manifest.width + (1 << level) - 1) >> level, 1);
+		int d= std::max((manifest.depth + (1 << level) - 1) >> level, 1);
+		for(int tx= 0; tx < (w + manifest.tileSize - 1) / manifest.tileSize; ++tx)
+		{
+			for(int tz= 0; tz < (d + manifest.tileSize - 1) / manifest.tileSize; ++tz)
+				remove(tilePath(directory, level, tx, tz).c_str());
+		}
+	}
+}
+
+bool PyramidBuilder::writeManifest(const Manifest &manifest) const
+{
+	std::string path= directory + "/pyramid.txt";
+	std::string temp= path + ".tmp";
+	FILE *fp= fopen(temp.c_str(), "w");
+	if(!fp)
+		return false;
+	fprintf(fp, "source %s\nsourceSize %lld\nsourceModified %lld\n", manifest.source.c_str(), manifest.sourceSize,
+		manifest.sourceModified);
+	fprintf(fp, "width %d\ndepth %d\nsampleBytes %d\ntileSize %d\nlevels %d\ncomplete %d\n", manifest.width,
+		manifest.depth, manifest.sampleBytes, manifest.tileSize, manifest.levels, manifest.complete ? 1 : 0);
+	bool written= fclose(fp) == 0;
+	remove(path.c_str());
+	return written && rename(temp.c_str(), path.c_str()) == 0;
+}
+
+bool PyramidBuilder::readManifest(const std::string &dir, Manifest &manifest)
+{
+	FILE *fp= fopen((dir + "/pyramid.txt").c_str(), "r");
+	if(!fp)
+		return false;
+	manifest.source.clear();
+	manifest.sourceSize= -1;
+	manifest.sourceModified= -1;
+	manifest.width= manifest.depth= manifest.sampleBytes= manifest.tileSize= manifest.levels= 0;
+	int complete= 0;
+	char line[1024];
+	while(fgets(line, sizeof(line), fp))
+	{
+		line[strcspn(line, "\r\n")]= 0;
+		char key[32];
+		long long value;
+		if(strncmp(line, "source ", 7) == 0)
+			manifest.source= line + 7;
+		else if(sscanf(line, "%31s %lld", key, &value) == 2)
+		{
+			if(strcmp(key, "sourceSize") == 0)
+				manifest.sourceSize= value;
+			else if(strcmp(key, "sourceModified") == 0)
+				manifest.sourceModified= value;
+			else if(strcmp(key, "width") == 0)
+				manifest.width= (int)value;
+			else if(strcmp(key, "depth") == 0)
+				manifest.depth= (int)value;
+			else if(strcmp(key, "sampleBytes") == 0)
+				manifest.sampleBytes= (int)value;
+			else if(strcmp(key, "tileSize") == 0)
+				manifest.tileSize= (int)value;
+			else if(strcmp(key, "levels") == 0)
+				manifest.levels= (int)value;
+			else if(strcmp(key, "complete") == 0)
+				complete= (int)value;
+		}
+	}
+	fclose(fp);
+	manifest.complete= complete != 0;
+	return manifest.width > 0 && manifest.depth > 0 && manifest.tileSize > 0 && manifest.levels > 0 &&
+		(manifest.sampleBytes == 1 || manifest.sampleBytes == 2);
+}
+
+bool PyramidBuilder::build(const char *sourceFile, int w, int d, int bytes, const char *outputDir,
+	int tiles, ThreadPool &pool)
+{
+	Timer timer;
+	directory= outputDir;
+	width= w;
+	depth= d;
+	sampleBytes= bytes == 2 ? 2 : 1;
+	tileSize= tiles;
+	numLevels= 1;
+	while(std::max(levelWidth(numLevels - 1), levelDepth(numLevels - 1)) > tileSize)
+		++numLevels;
+
+	stats.levels= numLevels;
+	stats.tilesWritten= 0;
+	stats.tilesSkipped= 0;
+	stats.bytesRead= 0;
+	stats.bytesWritten= 0;
+
+	Manifest manifest;
+	manifest.source= sourceFile;
+	manifest.width= width;
+	manifest.depth= depth;
+	manifest.sampleBytes= sampleBytes;
+	manifest.tileSize= tileSize;
+	manifest.levels= numLevels;
+	manifest.complete= false;
+	if(!sourceInfo(sourceFile, manifest.sourceSize, manifest.sourceModified))
+	{
+		cerr<<"Pyramid: can't open "<<sourceFile<<endl;
+		return false;
+	}
+
+	//tiles of any other source or layout are stale, the ones under the new
+	//layout's names go too so none of them can pass for already built
+	makeDirectory(directory);
+	Manifest previous;
+	bool hasPrevious= readManifest(directory, previous);
+	if(!hasPrevious || !sameBuild(previous, manifest))
+	{
+		if(hasPrevious)
+			removeTiles(previous);
+		removeTiles(manifest);
+	}
+
+	bool built= writeManifest(manifest);
+	if(!built)
+		cerr<<"Pyramid: can't write the manifest in "<<directory<<endl;
+	built= built && buildBase(sourceFile, pool);
+	for(int level= 1; built && level < numLevels; ++level)
+		built= buildLevel(level, pool);
+	manifest.complete= true;
+	if(built && !writeManifest(manifest))
+	{
+		cerr<<"Pyramid: can't write the manifest in "<<directory<<endl;
+		built= false;
+	}
+
+	stats.bytesWritten= (long long)stats.tilesWritten * tileSize * tileSize * sampleBytes;
+	stats.buildMs= timer.elapsedMs();
+	printf("Pyramid: %d levels of %dx%d tiles, %d written, %d already on disk, %.1f MB read, %.1f MB written in %.1f ms on %d threads\n",
+		numLevels, tileSize, tileSize, stats.tilesWritten, stats.tilesSkipped, stats.bytesRead / 1048576.0,
+		stats.bytesWritten / 1048576.0, stats.buildMs, pool.size());
+	return built;
+}
\ No newline at end of file
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "ThreadPool.h"
+#include <string>
+#include <vector>
+
+//builds a tiled level of detail pyramid out of a raw height map that is too
+//big to load, level 0 is the source cut into tiles and every level above is
+//the one below halved with a [1 3 3 1] filter
+//only a few strips of tile rows are ever in memory, tiles are written to a
+//temporary file and renamed when complete, so an interrupted build picks up
+//where it stopped
+//pyramid.txt in the output directory records the source's size and time
+//and the tile layout before the first tile is written, tiles are only kept
+//from an earlier build when all of it still matches
+class PyramidBuilder
+{
+public:
+	struct Manifest
+	{
+		std::string source;
+		long long sourceSize;
+		long long sourceModified;
+		int width;
+		int depth;
+		int sampleBytes;
+		int tileSize;
+		int levels;
+		//false while the build that wrote it is still running, or was cut short
+		bool complete;
+	};
+
+	struct Stats
+	{
+		int levels;
+		int tilesWritten;
+		int tilesSkipped;
+		long long bytesRead;
+		long long bytesWritten;
+		double buildMs;
+	};
+
+private:
+	std::string directory;
+	int width;
+	int depth;
+	int sampleBytes;
+	int tileSize;
+	int numLevels;
+
+	Stats stats;
+
+	//a strip of tile rows loaded from the level below, indexed [x * stripDepth + z]
+	struct Strip
+	{
+		int row;
+		std::vector<float> samples;
+	};
+
+	int levelWidth(int level) const;
+	int levelDepth(int level) const;
+	int tilesAcross(int level) const;
+	int tilesDown(int level) const;
+
+	bool tileExists(int level, int tx, int tz) const;
+	//tile samples indexed [x * tileSize + z], padded past the level's edge
+	bool writeTile(int level, int tx, int tz, const std::vector<float> &samples);
+
+	bool buildBase(const char *sourceFile, ThreadPool &pool);
+	bool buildLevel(int level, ThreadPool &pool);
+	bool loadStrip(int level, int row, Strip &strip, ThreadPool &pool);
+	//deletes every tile the manifest describes
+	void removeTiles(const Manifest &manifest) const;
+	bool writeManifest(const Manifest &manifest) const;
+
+public:
+	PyramidBuilder();
+
+	//sourceFile holds width * depth samples of sampleBytes (1 or 2, little
+	//endian) in x major order like heightField.raw, the tiles are written to
+	//outputDir in the same format
+	bool build(const char *sourceFile, int width, int depth, int sampleBytes, const char *outputDir,
+		int tileSize, ThreadPool &pool);
+
+	//file of tile (tx, tz) of a level, and a reader for it
+	static std::string tilePath(const std::string &dir, int level, int tx, int tz);
+	static bool readTile(const std::string &dir, int level, int tx, int tz, int tileSize, int sampleBytes,
+		std::vector<float> &samples);
+	//false if dir has no manifest or it can't be parsed
+	static bool readManifest(const std::string &dir, Manifest &manifest);
+
+	int getLevels() const { return numLevels; }
+	const Stats& getStats() const { return stats; }
+};
\ No newline at end of file
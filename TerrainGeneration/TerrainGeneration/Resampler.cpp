@@ -0,0 +1,294 @@
+#include "Resampler.h"
+
+#include "tgaio.h"
+#include "Timer.h"
+#include "simd.h"
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+namespace
+{
+	const double PI= 3.14159265358979323846;
+
+	//half width of each filter in output pixels
+	double support(Resampler::Filter filter)
+	{
+		return filter == Resampler::LANCZOS3 ? 3.0 : 2.0;
+	}
+
+	double weight(Resampler::Filter filter, double x)
+	{
+		x= fabs(x);
+		if(filter == Resampler::LANCZOS3)
+		{
+			if(x < 1e-8)
+				return 1.0;
+			if(x >= 3.0)
+				return 0.0;
+			return 3.0 * sin(PI * x) * sin(PI * x / 3.0) / (PI * PI * x * x);
+		}
+		const double B= 1.0 / 3.0;
+		const double C= 1.0 / 3.0;
+		if(x < 1.0)
+			return ((12.0 - 9.0 * B - 6.0 * C) * x * x * x + (-18.0 + 12.0 * B + 6.0 * C) * x * x + (6.0 - 2.0 * B)) / 6.0;
+		if(x < 2.0)
+			return ((-B - 6.0 * C) * x * x * x + (6.0 * B + 30.0 * C) * x * x + (-12.0 * B - 48.0 * C) * x + (8.0 * B + 24.0 * C)) / 6.0;
+		return 0.0;
+	}
+
+	//source range and scale of the filter for output pixel i, shrinking
+	//widens the filter so every source pixel still counts
+	void footprint(Resampler::Filter filter, int srcSize, int dstSize, int i, double &center, double &scale, int &lo, int &hi)
+	{
+		double ratio= (double)srcSize / dstSize;
+		scale= std::max(ratio, 1.0);
+		center= (i + 0.5) * ratio - 0.5;
+		double reach= support(filter) * scale;
+		lo= (int)ceil(center - reach);
+		hi= (int)floor(center + reach);
+	}
+
+	//four 8 bit channels to floats
+	inline void addPixel(const GLubyte *p, float w, float *acc)
+	{
+		for(int k= 0; k < 4; ++k)
+			acc[k]+= p[k] * w;
+	}
+}
+
+Resampler::Resampler()
+{
+	stats.tapsX= 0;
+	stats.tapsY= 0;
+	stats.weightsMs= 0.0;
+	stats.horizontalMs= 0.0;
+	stats.verticalMs= 0.0;
+	stats.resizeMs= 0.0;
+}
+
+void Resampler::buildKernel(Filter filter, int srcSize, int dstSize, Kernel &kernel)
+{
+	//weights of each output summed into the source pixels they land on
+	std::vector<std::vector<double> > rows(dstSize);
+	std::vector<int> first(dstSize);
+	int taps= 1;
+	for(int i= 0; i < dstSize; ++i)
+	{
+		double center, scale;
+		int lo, hi;
+		footprint(filter, srcSize, dstSize, i, center, scale, lo, hi);
+		int from= std::min(std::max(lo, 0), srcSize - 1);
+		int to= std::min(std::max(hi, 0), srcSize - 1);
+		std::vector<double> &row= rows[i];
+		row.assign(to - from + 1, 0.0);
+		double sum= 0.0;
+		for(int j= lo; j <= hi; ++j)
+		{
+			double w= weight(filter, (j - center) / scale);
+			row[std::min(std::max(j, 0), srcSize - 1) - from]+= w;
+			sum+= w;
+		}
+		for(size_t k= 0; k < row.size(); ++k)
+			row[k]/= sum;
+		first[i]= from;
+		taps= std::max(taps, (int)row.size());
+	}
+
+	//padded to the longest, shifted left where that would run off the end
+	taps= std::min(taps, srcSize);
+	kernel.taps= taps;
+	kernel.first.resize(dstSize);
+	kernel.weights.assign((size_t)dstSize * taps, 0.f);
+	for(int i= 0; i < dstSize; ++i)
+	{
+		int shift= std::max(first[i] + taps - srcSize, 0);
+		kernel.first[i]= first[i] - shift;
+		for(size_t k= 0; k < rows[i].size(); ++k)
+			kernel.weights[(size_t)i * taps + shift + k]= (float)rows[i][k];
+	}
+}
+
+void Resampler::resize(const GLubyte *src, int srcWidth, int srcHeight, int dstWidth, int dstHeight, Filter filter,
+	ThreadPool &pool, std::vector<GLubyte> &out)
+{
+	Timer total;
+	Timer timer;
+	buildKernel(filter, srcWidth, dstWidth, kernelX);
+	buildKernel(filter, srcHeight, dstHeight, kernelY);
+	stats.tapsX= kernelX.taps;
+	stats.tapsY= kernelY.taps;
+	stats.weightsMs= timer.elapsedMs();
+
+	//along x, every source row to dstWidth float pixels
+	timer.reset();
+	horizontal.resize((size_t)srcHeight * dstWidth * 4);
+	const Kernel &kx= kernelX;
+	pool.parallelFor(0, srcHeight, [&](int y) {
+		const GLubyte *row= src + (size_t)y * srcWidth * 4;
+		float *o= &horizontal[(size_t)y * dstWidth * 4];
+		for(int x= 0; x < dstWidth; ++x)
+		{
+			const GLubyte *p= row + kx.first[x] * 4;
+			const float *w= &kx.weights[(size_t)x * kx.taps];
+#ifdef TG_SSE2
+			__m128i zero= _mm_setzero_si128();
+			__m128 acc= _mm_setzero_ps();
+			for(int t= 0; t < kx.taps; ++t)
+			{
+				__m128i bytes= _mm_cvtsi32_si128(*(const int*)(p + t * 4));
+				__m128 pixel= _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero));
+				acc= _mm_add_ps(acc, _mm_mul_ps(pixel, _mm_set1_ps(w[t])));
+			}
+			_mm_storeu_ps(o, acc);
+#else
+			o[0]= o[1]= o[2]= o[3]= 0.f;
+			for(int t= 0; t < kx.taps; ++t)
+				addPixel(p + t * 4, w[t], o);
+#endif
+			o+= 4;
+		}
+	}, 8);
+	stats.horizontalMs= timer.elapsedMs();
+
+	//along y, whole rows at a time, two pixels per step
+	timer.reset();
+	out.resize((size_t)dstWidth * dstHeight * 4);
+	const Kernel &ky= kernelY;
+	int floats= dstWidth * 4;
+	pool.parallelFor(0, dstHeight, [&](int y) {
+		const float *rows= &horizontal[(size_t)ky.first[y] * floats];
+		const float *w= &ky.weights[(size_t)y * ky.taps];
+		GLubyte *o= &out[(size_t)y * floats];
+		int i= 0;
+#ifdef TG_SSE2
+		for(; i + 8 <= floats; i+= 8)
+		{
+			__m128 a= _mm_setzero_ps();
+			__m128 b= _mm_setzero_ps();
+			for(int t= 0; t < ky.taps; ++t)
+			{
+				const float *r= rows + (size_t)t * floats + i;
+				__m128 wt= _mm_set1_ps(w[t]);
+				a= _mm_add_ps(a, _mm_mul_ps(_mm_loadu_ps(r), wt));
+				b= _mm_add_ps(b, _mm_mul_ps(_mm_loadu_ps(r + 4), wt));
+			}
+			//round, then saturate to 0-255 through the packs
+			__m128i words= _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+			_mm_storel_epi64((__m128i*)(o + i), _mm_packus_epi16(words, words));
+		}
+#endif
+		for(; i < floats; ++i)
+		{
+			float acc= 0.f;
+			for(int t= 0; t < ky.taps; ++t)
+				acc+= rows[(size_t)t * floats + i] * w[t];
+			o[i]= (GLubyte)std::min(std::max(acc + 0.5f, 0.f), 255.f);
+		}
+	}, 8);
+	stats.verticalMs= timer.elapsedMs();
+	stats.resizeMs= total.elapsedMs();
+}
+
+void Resampler::resizeNaive(const GLubyte *src, int srcWidth, int srcHeight, int dstWidth, int dstHeight,
+	Filter filter, std::vector<GLubyte> &out)
+{
+	std::vector<float> rows((size_t)srcHeight * dstWidth * 4);
+	for(int y= 0; y < srcHeight; ++y)
+	{
+		for(int x= 0; x < dstWidth; ++x)
+		{
+			for(int c= 0; c < 4; ++c)
+			{
+				double center, scale;
+				int lo, hi;
+				footprint(filter, srcWidth, dstWidth, x, center, scale, lo, hi);
+				double acc= 0.0, sum= 0.0;
+				for(int j= lo; j <= hi; ++j)
+				{
+					double w= weight(filter, (j - center) / scale);
+					int sx= std::min(std::max(j, 0), srcWidth - 1);
+					acc+= src[((size_t)y * srcWidth + sx) * 4 + c] * w;
+					sum+= w;
+				}
+				rows[((size_t)y * dstWidth + x) * 4 + c]= (float)(acc / sum);
+			}
+		}
+	}
+
+	out.resize((size_t)dstWidth * dstHeight * 4);
+	for(int y= 0; y < dstHeight; ++y)
+	{
+		for(int x= 0; x < dstWidth; ++x)
+		{
+			for(int c= 0; c < 4; ++c)
+			{
+				double center, scale;
+				int lo, hi;
+				footprint(filter, srcHeight, dstHeight, y, center, scale, lo, hi);
+				double acc= 0.0, sum= 0.0;
+				for(int j= lo; j <= hi; ++j)
+				{
+					double w= weight(filter, (j - center) / scale);
+					int sy= std::min(std::max(j, 0), srcHeight - 1);
+					acc+= rows[((size_t)sy * dstWidth + x) * 4 + c] * w;
+					sum+= w;
+				}
+				double v= floor(acc / sum + 0.5);
+				out[((size_t)y * dstWidth + x) * 4 + c]= (GLubyte)std::min(std::max(v, 0.0), 255.0);
+			}
+		}
+	}
+}
+
+double Resampler::benchmark(const char *fileName, int runs, ThreadPool &pool)
+{
+	int width, height;
+	GLubyte *src;
+	try
+	{
+		src= TGAIO::read(fileName, width, height);
+	}
+	catch(TGAIO::IOException &e)
+	{
+		printf("Resampler: benchmark of %s failed: %s\n", fileName, e.what());
+		return -1.0;
+	}
+
+	runs= std::max(runs, 1);
+	Resampler resampler;
+	std::vector<GLubyte> fast, slow;
+	double best= 0.0;
+	for(int shift= 1; shift <= 2; ++shift)
+	{
+		int w= std::max(width >> shift, 1);
+		int h= std::max(height >> shift, 1);
+		for(int f= 0; f < 2; ++f)
+		{
+			Filter filter= f == 0 ? LANCZOS3 : MITCHELL;
+			best= 1e30;
+			double weights= 0.0;
+			for(int r= 0; r < runs; ++r)
+			{
+				resampler.resize(src, width, height, w, h, filter, pool, fast);
+				best= std::min(best, resampler.stats.resizeMs);
+				weights+= resampler.stats.weightsMs;
+			}
+			Timer timer;
+			resizeNaive(src, width, height, w, h, filter, slow);
+			double naiveMs= timer.elapsedMs();
+
+			//the tables round the weights to float, so allow a step either way
+			int worst= 0;
+			for(size_t i= 0; i < fast.size(); ++i)
+				worst= std::max(worst, abs((int)fast[i] - (int)slow[i]));
+			printf("Resampler: %s %dx%d to %dx%d %s, %d x %d taps, %.2f ms (weights %.2f) vs %.1f ms naive, "
+				"%.0fx faster on %d threads, max difference %d%s\n",
+				fileName, width, height, w, h, filter == LANCZOS3 ? "lanczos3" : "mitchell",
+				resampler.stats.tapsX, resampler.stats.tapsY, best, weights / runs, naiveMs,
+				naiveMs / (best + 1e-9), pool.size(), worst, worst > 1 ? " MISMATCH" : "");
+		}
+	}
+	delete[] src;
+	return best;
+}
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "GLIncludes.h"
+#include "ThreadPool.h"
+#include <vector>
+
+//separable resizing of 8 bit four channel images, the buffers TGAIO::read
+//hands back, for making smaller copies of textures for low memory targets
+//the weights of both passes are worked out once per size into tables, the
+//rows then only multiply and add, four channels of a pixel per SSE register
+//values are filtered as stored, not in linear light, and alpha isn't
+//premultiplied, for straight halving MipChain is the better fit
+class Resampler
+{
+public:
+	enum Filter
+	{
+		LANCZOS3,
+		//B= C= 1/3, softer than lanczos but without its ringing
+		MITCHELL
+	};
+
+	struct Stats
+	{
+		//source pixels each output pixel reads along x and along y
+		int tapsX;
+		int tapsY;
+		double weightsMs;
+		double horizontalMs;
+		double verticalMs;
+		double resizeMs;
+	};
+
+private:
+	//weights for one axis, output i reads taps source pixels from first[i]
+	//on with weights[i * taps], every output has the same number of taps
+	//so the inner loops have a fixed length, edges are clamped into the
+	//weights of the first and last pixel
+	struct Kernel
+	{
+		int taps;
+		std::vector<int> first;
+		std::vector<float> weights;
+	};
+
+	Kernel kernelX;
+	Kernel kernelY;
+	//rows of the source already resized along x, rgba floats
+	std::vector<float> horizontal;
+	Stats stats;
+
+	static void buildKernel(Filter filter, int srcSize, int dstSize, Kernel &kernel);
+
+public:
+	Resampler();
+
+	//out is resized to dstWidth * dstHeight * 4 bytes, the channel order is
+	//left alone
+	void resize(const GLubyte *src, int srcWidth, int srcHeight, int dstWidth, int dstHeight, Filter filter,
+		ThreadPool &pool, std::vector<GLubyte> &out);
+
+	//the same filter with every weight recomputed per tap and per channel,
+	//the reference the table version is checked against
+	static void resizeNaive(const GLubyte *src, int srcWidth, int srcHeight, int dstWidth, int dstHeight,
+		Filter filter, std::vector<GLubyte> &out);
+
+	//times both filters against the naive version on a TGA shrunk to half
+	//and to a quarter, prints the report and returns the best ms of the last
+	//one timed, the quarter size mitchell, negative if the file can't be read
+	static double benchmark(const char *fileName, int runs, ThreadPool &pool);
+
+	const Stats& getStats() const { return stats; }
+};
\ No newline at end of file
@@ -0,0 +1,282 @@
+#include "ScreenCapture.h"
+
+#include "tgaio.h"
+#include "Timer.h"
+#include <algorithm>
+#include <iostream>
+using std::cerr;
+using std::endl;
+
+ScreenCapture::ScreenCapture() : stopping(false), verbose(true)
+{
+	stats.requested= 0;
+	stats.written= 0;
+	stats.dropped= 0;
+	stats.lastFrameMs= 0.0;
+	stats.maxFrameMs= 0.0;
+	stats.lastWriteMs= 0.0;
+}
+
+ScreenCapture::~ScreenCapture()
+{
+	//Destroy should have run while the context was still there
+	stopWriters();
+}
+
+void ScreenCapture::stopWriters()
+{
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		stopping= true;
+	}
+	queueReady.notify_all();
+	for(size_t i= 0; i < writers.size(); ++i)
+		writers[i].join();
+	writers.clear();
+}
+
+void ScreenCapture::Create(int ringSize, int width, int height, int numWriters)
+{
+	slots.resize(std::max(ringSize, 1));
+	size_t size= (size_t)std::max(width, 0) * std::max(height, 0) * 4;
+	for(size_t i= 0; i < slots.size(); ++i)
+	{
+		Slot &slot= slots[i];
+		glGenBuffers(1, &slot.buffer);
+		if(size > 0)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+			glBufferData(GL_PIXEL_PACK_BUFFER, size, 0, GL_STREAM_READ);
+		}
+		slot.size= size;
+		slot.fence= 0;
+		slot.width= 0;
+		slot.height= 0;
+		slot.pixels= 0;
+		slot.writeMs= 0.0;
+		slot.state= FREE;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	stopping= false;
+	for(int i= 0; i < std::max(numWriters, 1); ++i)
+		writers.push_back(std::thread(&ScreenCapture::writerLoop, this));
+}
+
+void ScreenCapture::writerLoop()
+{
+	while(true)
+	{
+		int index;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			while(queue.empty() && !stopping)
+				queueReady.wait(lock);
+			if(queue.empty())
+				return;
+			index= queue.front();
+			queue.pop_front();
+		}
+
+		Slot &slot= slots[index];
+		Timer timer;
+		try
+		{
+			TGAIO::write(slot.pixels, slot.width, slot.height, slot.fileName.c_str());
+		}
+		catch(TGAIO::IOException &e)
+		{
+			cerr<<"ScreenCapture: "<<e.what()<<endl;
+		}
+
+		std::unique_lock<std::mutex> lock(queueMutex);
+		slot.writeMs= timer.elapsedMs();
+		slot.state= WRITTEN;
+		slotWritten.notify_all();
+	}
+}
+
+bool ScreenCapture::request(const char *fileName, int width, int height)
+{
+	Timer timer;
+	++stats.requested;
+	int index= -1;
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		for(size_t i= 0; i < slots.size() && index < 0; ++i)
+		{
+			if(slots[i].state == FREE)
+				index= (int)i;
+		}
+	}
+	if(index < 0 || width <= 0 || height <= 0)
+	{
+		++stats.dropped;
+		return false;
+	}
+
+	Slot &slot= slots[index];
+	size_t size= (size_t)width * height * 4;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	//only after the window was resized
+	if(size != slot.size)
+	{
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, 0, GL_STREAM_READ);
+		slot.size= size;
+	}
+	//with a pack buffer bound the read only queues a copy on the gpu
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot.fence= glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.width= width;
+	slot.height= height;
+	slot.fileName= fileName;
+	slot.state= READING;
+
+	stats.lastFrameMs= timer.elapsedMs();
+	stats.maxFrameMs= std::max(stats.maxFrameMs, stats.lastFrameMs);
+	return true;
+}
+
+void ScreenCapture::startWrite(int index)
+{
+	Slot &slot= slots[index];
+	glDeleteSync(slot.fence);
+	slot.fence= 0;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	slot.pixels= (GLubyte*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.size, GL_MAP_READ_BIT);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	if(!slot.pixels)
+	{
+		cerr<<"ScreenCapture: can't map the pixels of "<<slot.fileName<<endl;
+		slot.state= FREE;
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(queueMutex);
+	slot.state= WRITING;
+	queue.push_back(index);
+	queueReady.notify_one();
+}
+
+void ScreenCapture::finishWrite(int index)
+{
+	Slot &slot= slots[index];
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot.pixels= 0;
+	slot.state= FREE;
+	++stats.written;
+	stats.lastWriteMs= slot.writeMs;
+	if(verbose)
+		printf("ScreenCapture: wrote %s (%d x %d) in %.1f ms off the render thread\n", slot.fileName.c_str(), slot.width,
+			slot.height, slot.writeMs);
+}
+
+void ScreenCapture::update()
+{
+	Timer timer;
+	bool busy= false;
+	for(size_t i= 0; i < slots.size(); ++i)
+	{
+		Slot &slot= slots[i];
+		SlotState state;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			state= slot.state;
+		}
+		if(state == READING)
+		{
+			//a zero timeout only polls
+			GLenum result= glClientWaitSync(slot.fence, 0, 0);
+			if(result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+				startWrite((int)i);
+			busy= true;
+		}
+		else if(state == WRITTEN)
+		{
+			finishWrite((int)i);
+			busy= true;
+		}
+	}
+	if(busy)
+	{
+		stats.lastFrameMs= timer.elapsedMs();
+		stats.maxFrameMs= std::max(stats.maxFrameMs, stats.lastFrameMs);
+	}
+}
+
+bool ScreenCapture::hasFreeSlot()
+{
+	std::unique_lock<std::mutex> lock(queueMutex);
+	for(size_t i= 0; i < slots.size(); ++i)
+	{
+		if(slots[i].state == FREE)
+			return true;
+	}
+	return false;
+}
+
+bool ScreenCapture::waitForSlot(double maxMs)
+{
+	Timer timer;
+	while(true)
+	{
+		update();
+		if(hasFreeSlot())
+			return true;
+		double left= maxMs - timer.elapsedMs();
+		if(left <= 0.0)
+			return false;
+
+		//a read still on the gpu is waited for there, otherwise for a writer
+		int reading= -1;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			for(size_t i= 0; i < slots.size() && reading < 0; ++i)
+			{
+				if(slots[i].state == READING)
+					reading= (int)i;
+			}
+		}
+		if(reading >= 0)
+		{
+			glClientWaitSync(slots[reading].fence, GL_SYNC_FLUSH_COMMANDS_BIT, (GLuint64)(left * 1e6));
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(queueMutex);
+		slotWritten.wait_for(lock, std::chrono::microseconds((long long)(left * 1000.0)), [this]() {
+			for(size_t i= 0; i < slots.size(); ++i)
+			{
+				if(slots[i].state == WRITTEN)
+					return true;
+			}
+			return false;
+		});
+	}
+}
+
+void ScreenCapture::Destroy()
+{
+	//reads still on the gpu are waited for, a second at most each
+	for(size_t i= 0; i < slots.size(); ++i)
+	{
+		if(slots[i].state == READING)
+		{
+			glClientWaitSync(slots[i].fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			startWrite((int)i);
+		}
+	}
+
+	stopWriters();
+
+	for(size_t i= 0; i < slots.size(); ++i)
+	{
+		if(slots[i].state == WRITTEN)
+			finishWrite((int)i);
+		glDeleteBuffers(1, &slots[i].buffer);
+	}
+	slots.clear();
+	queue.clear();
+}
\ No newline at end of file
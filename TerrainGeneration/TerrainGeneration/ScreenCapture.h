@@ -0,0 +1,94 @@
+#pragma once
+
+#include "GLIncludes.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//screenshots without stalling the frame
+//request() only queues a read of the back buffer into a pixel buffer object
+//and drops a fence behind it, update() maps the buffer once the gpu has
+//passed the fence and a writer thread encodes the TGA straight from the
+//mapping, the buffer goes back into the ring when the file is on disk
+//with more than one writer the files are encoded in parallel
+class ScreenCapture
+{
+public:
+	struct Stats
+	{
+		int requested;
+		int written;
+		//requests made while every buffer in the ring was busy
+		int dropped;
+		//render thread time of the last and slowest request or update
+		double lastFrameMs;
+		double maxFrameMs;
+		double lastWriteMs;
+	};
+
+private:
+	enum SlotState
+	{
+		FREE,
+		READING,
+		WRITING,
+		WRITTEN
+	};
+
+	struct Slot
+	{
+		GLuint buffer;
+		size_t size;
+		GLsync fence;
+		int width;
+		int height;
+		std::string fileName;
+		GLubyte *pixels;
+		double writeMs;
+		SlotState state;
+	};
+
+	std::vector<Slot> slots;
+	Stats stats;
+
+	//slots waiting for the writer, and the state shared with it
+	std::deque<int> queue;
+	std::mutex queueMutex;
+	std::condition_variable queueReady;
+	std::condition_variable slotWritten;
+	bool stopping;
+	std::vector<std::thread> writers;
+	bool verbose;
+
+	void writerLoop();
+	void stopWriters();
+	bool hasFreeSlot();
+	void startWrite(int index);
+	void finishWrite(int index);
+
+public:
+	ScreenCapture();
+	~ScreenCapture();
+
+	//ringSize buffers can be in flight at once, numWriters files are
+	//encoded at the same time, every buffer gets its storage here for
+	//captures of width x height, only a capture of another size reallocates
+	void Create(int ringSize, int width, int height, int numWriters= 1);
+	//waits for everything in flight and frees the buffers, needs the context
+	void Destroy();
+
+	//queues a capture of the current back buffer, false if the ring is full
+	bool request(const char *fileName, int width, int height);
+	//once a frame, hands finished reads to the writer and recycles buffers
+	void update();
+	//blocks for at most maxMs until a buffer is free, false if none came
+	bool waitForSlot(double maxMs);
+
+	//print a line for every file written
+	void setVerbose(bool on) { verbose= on; }
+
+	const Stats& getStats() const { return stats; }
+};
\ No newline at end of file
@@ -0,0 +1,8 @@
+#version 430
+
+layout (location = 0) out vec4 FragColor;
+
+void main()
+{
+	FragColor= vec4(0.1, 0.1, 0.1, 1.0);
+}
\ No newline at end of file
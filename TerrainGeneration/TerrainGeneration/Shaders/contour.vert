@@ -0,0 +1,11 @@
+#version 430
+
+layout (location = 0) in vec3 VertexPosition;
+
+uniform mat4 MVP;
+
+void main()
+{
+	//lift the lines off the surface so they don't fight with it in the depth buffer
+	gl_Position= MVP * vec4(VertexPosition + vec3(0.0, 0.5, 0.0), 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#version 430
+
+in vec3 Position;
+in vec2 TexCoord;
+
+layout (binding = 2) uniform sampler2D Normals;
+layout (binding = 3) uniform sampler2D Terrain;
+
+uniform vec3 CameraPosition;
+
+layout (location = 0) out vec4 FragColor;
+
+void main()
+{
+	//cut the water off wherever the terrain pokes through it
+	vec2 terrainCoord= (Position.zx + 0.5) / vec2(textureSize(Terrain, 0));
+	float waterDepth= Position.y - texture(Terrain, terrainCoord).r;
+	if(waterDepth <= 0.0)
+		discard;
+
+	vec3 n= normalize(texture(Normals, TexCoord).xyz);
+	vec3 v= normalize(CameraPosition - Position);
+	vec3 l= normalize(vec3(0.3, 0.8, 0.5));
+
+	float fresnel= 0.02 + 0.98 * pow(1.0 - max(dot(n, v), 0.0), 5.0);
+	vec3 color= mix(vec3(0.0, 0.12, 0.22), vec3(0.55, 0.7, 0.85), fresnel);
+	color+= vec3(pow(max(dot(reflect(-l, n), v), 0.0), 200.0));
+
+	//shallow water fades into the terrain underneath
+	float alpha= max(clamp(waterDepth / 6.0, 0.2, 0.9), fresnel);
+	FragColor= vec4(color, alpha);
+}
\ No newline at end of file
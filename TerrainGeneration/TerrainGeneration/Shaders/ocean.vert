@@ -0,0 +1,19 @@
+#version 430
+
+layout (location = 0) in vec3 VertexPosition;
+
+out vec3 Position;
+out vec2 TexCoord;
+
+layout (binding = 1) uniform sampler2D Displacement;
+
+uniform mat4 MVP;
+uniform float PatchSize;
+
+void main()
+{
+	//the simulation maps run s along z and t along x, like the terrain
+	TexCoord= VertexPosition.zx / PatchSize;
+	Position= VertexPosition + textureLod(Displacement, TexCoord, 0.0).xyz;
+	gl_Position= MVP * vec4(Position, 1.0);
+}
\ No newline at end of file
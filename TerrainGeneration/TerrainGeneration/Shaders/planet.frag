@@ -0,0 +1,21 @@
+#version 430
+
+in vec3 Direction;
+
+layout (binding = 0) uniform sampler2D Tex1;
+
+//texture repeats per unit of the unit sphere
+uniform float TexScale;
+
+layout (location = 0) out vec4 FragColor;
+
+void main()
+{
+	//same triplanar blend the cpu uses for the heights
+	vec3 w= Direction * Direction;
+	w= w * w;
+	w/= w.x + w.y + w.z;
+
+	vec3 p= Direction * TexScale;
+	FragColor= texture(Tex1, p.yz) * w.x + texture(Tex1, p.xz) * w.y + texture(Tex1, p.xy) * w.z;
+}
\ No newline at end of file
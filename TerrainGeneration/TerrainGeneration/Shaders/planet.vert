@@ -0,0 +1,15 @@
+#version 430
+
+//relative to the tile center, MVP carries the camera relative offset
+layout (location = 0) in vec3 VertexPosition;
+layout (location = 1) in vec3 VertexDirection;
+
+out vec3 Direction;
+
+uniform mat4 MVP;
+
+void main()
+{
+	Direction= VertexDirection;
+	gl_Position= MVP * vec4(VertexPosition,1.0);
+}
\ No newline at end of file
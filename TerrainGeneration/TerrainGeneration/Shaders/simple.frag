@@ -3,6 +3,10 @@
 in vec3 Position;
 
 layout (binding = 0) uniform sampler2D Tex1;
+//line of sight mask, s along z and t along x like the height grid
+layout (binding = 4) uniform sampler2D Visibility;
+
+uniform bool ShowVisibility;
 
 layout (location = 0) out vec4 FragColor;
 
@@ -12,4 +16,11 @@ void main()
 	vec2 TexCoord= vec2(Position.x/1024, Position.z/1024);
 	
 	FragColor= texture(Tex1, TexCoord);
+
+	//cells no observer can see are shaded down
+	if(ShowVisibility)
+	{
+		float seen= texture(Visibility, (Position.zx + 0.5) / vec2(textureSize(Visibility, 0))).r;
+		FragColor.rgb*= mix(0.3, 1.0, seen);
+	}
 }
\ No newline at end of file
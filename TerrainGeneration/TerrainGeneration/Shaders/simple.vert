@@ -1,5 +1,6 @@
 #version 430
 
+//relative to the tile corner, MVP carries the camera relative offset
 layout (location = 0) in vec3 VertexPosition;
 
 out vec3 Position;
@@ -7,9 +8,11 @@ out vec3 Position;
 uniform mat4 ModelViewMatrix;
 uniform mat3 NormalMatrix;
 uniform mat4 MVP;
+//grid point of the tile corner, zero for meshes in grid coordinates
+uniform vec2 TileOrigin;
 
 void main()
 {
-	Position= VertexPosition;
+	Position= VertexPosition + vec3(TileOrigin.x, 0.0, TileOrigin.y);
 	gl_Position= MVP * vec4(VertexPosition,1.0);
 }
\ No newline at end of file
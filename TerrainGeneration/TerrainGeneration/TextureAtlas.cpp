@@ -0,0 +1,255 @@
+#include "TextureAtlas.h"
+
+#include "tgaio.h"
+#include "MipChain.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+using std::cerr;
+using std::endl;
+
+TextureAtlas::TextureAtlas() : pageSize(0), mipLevels(1), gutter(0), texture(0)
+{
+	stats.images= 0;
+	stats.pages= 0;
+	stats.efficiency= 0.f;
+	stats.packMs= 0.0;
+	stats.buildMs= 0.0;
+}
+
+void TextureAtlas::Create(int size, int levels)
+{
+	pageSize= size;
+	mipLevels= std::max(std::min(levels, MipChain::levelCount(size, size)), 1);
+	//at level l a gutter of 2^(levels-1) pixels is still 2^(levels-1-l) wide
+	gutter= 1 << (mipLevels - 1);
+	entries.clear();
+	images.clear();
+}
+
+void TextureAtlas::Destroy()
+{
+	if(texture)
+		glDeleteTextures(1, &texture);
+	texture= 0;
+}
+
+int TextureAtlas::add(const char *name, const GLubyte *rgba, int width, int height)
+{
+	Entry entry;
+	entry.name= name;
+	entry.page= -1;
+	entry.x= 0;
+	entry.y= 0;
+	entry.width= width;
+	entry.height= height;
+	entry.uv= vec4(0.f);
+	entries.push_back(entry);
+	images.push_back(std::vector<GLubyte>(rgba, rgba + (size_t)width * height * 4));
+	return (int)entries.size() - 1;
+}
+
+int TextureAtlas::addFile(const char *fileName)
+{
+	try
+	{
+		int width, height;
+		GLubyte *data= TGAIO::read(fileName, width, height);
+		int index= add(fileName, data, width, height);
+		delete[] data;
+		return index;
+	}
+	catch(TGAIO::IOException &e)
+	{
+		cerr<<"TextureAtlas: "<<e.what()<<endl;
+		return -1;
+	}
+}
+
+bool TextureAtlas::findPosition(const std::vector<Skyline> &skyline, int width, int height, int &bestIndex,
+	int &bestX, int &bestY) const
+{
+	bestIndex= -1;
+	int bestTop= pageSize + 1;
+	int bestWidth= pageSize + 1;
+	for(size_t i= 0; i < skyline.size(); ++i)
+	{
+		int x= skyline[i].x;
+		if(x + width > pageSize)
+			break;
+		//the cell rests on the highest segment it spans
+		int y= 0;
+		int left= width;
+		for(size_t j= i; left > 0; ++j)
+		{
+			y= std::max(y, skyline[j].y);
+			left-= skyline[j].width;
+		}
+		int top= y + height;
+		if(top <= pageSize && (top < bestTop || (top == bestTop && skyline[i].width < bestWidth)))
+		{
+			bestIndex= (int)i;
+			bestX= x;
+			bestY= y;
+			bestTop= top;
+			bestWidth= skyline[i].width;
+		}
+	}
+	return bestIndex >= 0;
+}
+
+void TextureAtlas::place(std::vector<Skyline> &skyline, int index, int x, int y, int width, int height)
+{
+	Skyline segment= { x, y + height, width };
+	skyline.insert(skyline.begin() + index, segment);
+
+	//segments now under the new one shrink or go
+	for(size_t i= index + 1; i < skyline.size(); )
+	{
+		int end= skyline[i - 1].x + skyline[i - 1].width;
+		if(skyline[i].x >= end)
+			break;
+		int overlap= end - skyline[i].x;
+		skyline[i].x+= overlap;
+		skyline[i].width-= overlap;
+		if(skyline[i].width <= 0)
+			skyline.erase(skyline.begin() + i);
+		else
+			break;
+	}
+	//neighbours at the same height become one segment
+	for(size_t i= 0; i + 1 < skyline.size(); )
+	{
+		if(skyline[i].y == skyline[i + 1].y)
+		{
+			skyline[i].width+= skyline[i + 1].width;
+			skyline.erase(skyline.begin() + i + 1);
+		}
+		else
+			++i;
+	}
+}
+
+//the image and its gutter, every gutter pixel repeats the nearest edge pixel
+void TextureAtlas::blit(const Entry &entry, const std::vector<GLubyte> &image)
+{
+	std::vector<GLubyte> &page= pages[entry.page];
+	for(int y= -gutter; y < entry.height + gutter; ++y)
+	{
+		int sy= std::min(std::max(y, 0), entry.height - 1);
+		GLubyte *out= &page[((size_t)(entry.y + y) * pageSize + entry.x - gutter) * 4];
+		const GLubyte *row= &image[(size_t)sy * entry.width * 4];
+		for(int x= -gutter; x < 0; ++x, out+= 4)
+			memcpy(out, row, 4);
+		memcpy(out, row, entry.width * 4);
+		out+= entry.width * 4;
+		for(int x= 0; x < gutter; ++x, out+= 4)
+			memcpy(out, row + (entry.width - 1) * 4, 4);
+	}
+}
+
+void TextureAtlas::build(ThreadPool &pool)
+{
+	Timer timer;
+
+	//tallest first packs tightest on a skyline
+	std::vector<int> order(entries.size());
+	for(size_t i= 0; i < order.size(); ++i)
+		order[i]= (int)i;
+	std::sort(order.begin(), order.end(), [&](int a, int b) {
+		if(entries[a].height != entries[b].height)
+			return entries[a].height > entries[b].height;
+		return entries[a].width > entries[b].width;
+	});
+
+	//cells hold the image and its gutter, rounded up to the coarsest mip
+	int align= gutter;
+	skylines.clear();
+	long long usedPixels= 0;
+	for(size_t o= 0; o < order.size(); ++o)
+	{
+		Entry &entry= entries[order[o]];
+		int cellWidth= (entry.width + 2 * gutter + align - 1) / align * align;
+		int cellHeight= (entry.height + 2 * gutter + align - 1) / align * align;
+		entry.page= -1;
+		if(cellWidth > pageSize || cellHeight > pageSize)
+		{
+			cerr<<"TextureAtlas: "<<entry.name<<" is bigger than a page"<<endl;
+			continue;
+		}
+
+		int index, x, y;
+		for(size_t p= 0; p < skylines.size() && entry.page < 0; ++p)
+		{
+			if(findPosition(skylines[p], cellWidth, cellHeight, index, x, y))
+			{
+				place(skylines[p], index, x, y, cellWidth, cellHeight);
+				entry.page= (int)p;
+			}
+		}
+		if(entry.page < 0)
+		{
+			Skyline floor= { 0, 0, pageSize };
+			skylines.push_back(std::vector<Skyline>(1, floor));
+			findPosition(skylines.back(), cellWidth, cellHeight, index, x, y);
+			place(skylines.back(), index, x, y, cellWidth, cellHeight);
+			entry.page= (int)skylines.size() - 1;
+		}
+		entry.x= x + gutter;
+		entry.y= y + gutter;
+		entry.uv= vec4((float)entry.x / pageSize, (float)entry.y / pageSize, (float)(entry.x + entry.width) / pageSize,
+			(float)(entry.y + entry.height) / pageSize);
+		usedPixels+= (long long)entry.width * entry.height;
+	}
+	stats.packMs= timer.elapsedMs();
+
+	//cells never overlap, so the images are copied in parallel
+	pages.assign(skylines.size(), std::vector<GLubyte>((size_t)pageSize * pageSize * 4, 0));
+	pool.parallelFor(0, (int)entries.size(), [&](int i) {
+		if(entries[i].page >= 0)
+			blit(entries[i], images[i]);
+	});
+
+	if(texture)
+		glDeleteTextures(1, &texture);
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, mipLevels, GL_RGBA8, pageSize, pageSize, std::max((int)pages.size(), 1));
+	for(size_t p= 0; p < pages.size(); ++p)
+	{
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, (GLint)p, pageSize, pageSize, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+			&pages[p][0]);
+		MipChain mips;
+		mips.build(&pages[p][0], pageSize, pageSize, 4, pageSize * 4, pool);
+		for(int l= 1; l < mipLevels; ++l)
+		{
+			const MipChain::Level &level= mips.getLevels()[l - 1];
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, 0, 0, (GLint)p, level.width, level.height, 1, GL_RGBA,
+				GL_UNSIGNED_BYTE, &level.pixels[0]);
+		}
+	}
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, mipLevels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, mipLevels - 1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	pages.clear();
+
+	stats.images= (int)entries.size();
+	stats.pages= (int)skylines.size();
+	stats.efficiency= skylines.empty() ? 0.f : (float)((double)usedPixels / ((double)skylines.size() * pageSize * pageSize));
+	stats.buildMs= timer.elapsedMs();
+	printf("TextureAtlas: %d images on %d %dx%d pages, %.1f%% of the pages used, packed in %.2f ms, built in %.1f ms\n",
+		stats.images, stats.pages, pageSize, pageSize, stats.efficiency * 100.f, stats.packMs, stats.buildMs);
+}
+
+const TextureAtlas::Entry* TextureAtlas::find(const std::string &name) const
+{
+	for(size_t i= 0; i < entries.size(); ++i)
+	{
+		if(entries[i].name == name)
+			return &entries[i];
+	}
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "GLIncludes.h"
+#include "ThreadPool.h"
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+using glm::vec4;
+
+//packs many small rgba images into the layers of one 2D array texture so
+//they can all be drawn with a single bind
+//images are placed with a skyline packer, each in a cell aligned to the
+//coarsest mip used and surrounded by a gutter of its own edge pixels, so
+//no mip level ever filters one image into its neighbour
+class TextureAtlas
+{
+public:
+	struct Entry
+	{
+		std::string name;
+		//layer of the array texture, -1 if the image didn't fit a page
+		int page;
+		int x;
+		int y;
+		int width;
+		int height;
+		//u0, v0, u1, v1 of the image on its page
+		vec4 uv;
+	};
+
+	struct Stats
+	{
+		int images;
+		int pages;
+		//image pixels over page pixels
+		float efficiency;
+		double packMs;
+		double buildMs;
+	};
+
+private:
+	struct Skyline
+	{
+		int x;
+		int y;
+		int width;
+	};
+
+	int pageSize;
+	int mipLevels;
+	int gutter;
+	std::vector<Entry> entries;
+	std::vector<std::vector<GLubyte> > images;
+	std::vector<std::vector<Skyline> > skylines;
+	std::vector<std::vector<GLubyte> > pages;
+	GLuint texture;
+	Stats stats;
+
+	//lowest place a cell fits on the page's skyline, false if it doesn't
+	bool findPosition(const std::vector<Skyline> &skyline, int width, int height, int &bestIndex, int &bestX,
+		int &bestY) const;
+	void place(std::vector<Skyline> &skyline, int index, int x, int y, int width, int height);
+	void blit(const Entry &entry, const std::vector<GLubyte> &image);
+
+public:
+	TextureAtlas();
+
+	//square pages of pageSize, mipLevels levels will be uploaded
+	void Create(int pageSize, int mipLevels);
+	//frees the array texture, needs the context
+	void Destroy();
+
+	//the image is copied, returns its index in the entry table
+	int add(const char *name, const GLubyte *rgba, int width, int height);
+	//loads a TGA file through TGAIO, -1 if it can't be read
+	int addFile(const char *fileName);
+
+	//packs everything added, fills the pages and uploads them with their mips
+	void build(ThreadPool &pool);
+
+	//the uv remap table, in the order images were added
+	const std::vector<Entry>& getEntries() const { return entries; }
+	const Entry* find(const std::string &name) const;
+	GLuint getTexture() const { return texture; }
+	const Stats& getStats() const { return stats; }
+};
\ No newline at end of file
@@ -0,0 +1,269 @@
+#include "TextureCache.h"
+
+#include "MipChain.h"
+#include "jpegio.h"
+#include "ThreadPool.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+#include <atomic>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+using std::cerr;
+using std::endl;
+
+namespace
+{
+	//bump when the processing changes, old files then stop matching
+	const int CACHE_VERSION= 1;
+
+	const unsigned long long FNV_OFFSET= 14695981039346656037ULL;
+	const unsigned long long FNV_PRIME= 1099511628211ULL;
+
+	unsigned long long fnv1a(const unsigned char *data, size_t size, unsigned long long hash)
+	{
+		for(size_t i= 0; i < size; ++i)
+		{
+			hash^= data[i];
+			hash*= FNV_PRIME;
+		}
+		return hash;
+	}
+
+	//numbers the temporary files, so two stores of the same file don't
+	//write into each other
+	std::atomic<unsigned int> tempCount(0);
+
+	void makeDirectory(const std::string &dir)
+	{
+		//fails harmlessly when it's already there
+#ifdef _WIN32
+		_mkdir(dir.c_str());
+#else
+		mkdir(dir.c_str(), 0755);
+#endif
+	}
+}
+
+TextureCache::TextureCache(const std::string &directory) : directory(directory)
+{
+	stats.hits= 0;
+	stats.misses= 0;
+	stats.hitMs= 0.0;
+	stats.missMs= 0.0;
+	stats.savedMs= 0.0;
+}
+
+TextureCache& TextureCache::shared()
+{
+	//first use happens on the main thread during Init
+	static TextureCache cache("texcache");
+	return cache;
+}
+
+unsigned long long TextureCache::hashFile(const char *fileName, BlockCompressor::Quality quality)
+{
+	MappedFile file;
+	if(!file.open(fileName))
+		return 0;
+	unsigned long long hash= fnv1a(file.bytes(), file.size(), FNV_OFFSET);
+	int options[2]= { CACHE_VERSION, (int)quality };
+	return fnv1a((const unsigned char*)options, sizeof(options), hash);
+}
+
+std::string TextureCache::cachePath(unsigned long long key) const
+{
+	char name[32];
+	sprintf(name, "%016llx.tgc", key);
+	return directory + "/" + name;
+}
+
+void TextureCache::build(const char *fileName, unsigned long long key, BlockCompressor::Quality quality,
+	std::vector<GLubyte> &image, const std::function<void(int)> &ready)
+{
+	Timer timer;
+	int width, height;
+	//JPEG sources are told apart by their first bytes, anything else is taken as TGA
+	GLubyte *data= JPEGIO::isJPEG(fileName) ? JPEGIO::read(fileName, width, height) : TGAIO::read(fileName, width, height);
+
+	MipChain mips;
+	mips.build(data, width, height, 4, width * 4, ThreadPool::shared());
+
+	//BC1 unless some pixel isn't opaque
+	BlockCompressor::Format format= BlockCompressor::BC1;
+	for(int i= 0; i < width * height && format == BlockCompressor::BC1; ++i)
+	{
+		if(data[i * 4 + 3] != 0xFF)
+			format= BlockCompressor::BC3;
+	}
+
+	//the level table goes in first so each level has its place before any is compressed
+	int levels= MipChain::levelCount(width, height);
+	std::vector<size_t> offsets(levels);
+	size_t size= sizeof(FileHeader) + levels * sizeof(LevelHeader);
+	image.assign(size, 0);
+	for(int l= 0; l < levels; ++l)
+	{
+		LevelHeader level;
+		level.width= l == 0 ? width : mips.getLevels()[l - 1].width;
+		level.height= l == 0 ? height : mips.getLevels()[l - 1].height;
+		level.bytes= (unsigned int)BlockCompressor::compressedSize(level.width, level.height, format);
+		offsets[l]= size;
+		size+= level.bytes;
+		memcpy(&image[sizeof(FileHeader) + l * sizeof(LevelHeader)], &level, sizeof(level));
+	}
+	image.resize(size, 0);
+
+	FileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "TGTC", 4);
+	header.version= CACHE_VERSION;
+	header.key= key;
+	header.width= width;
+	header.height= height;
+	header.glFormat= BlockCompressor::glFormat(format);
+	header.levels= levels;
+	memcpy(&image[0], &header, sizeof(header));
+
+	BlockCompressor compressor;
+	std::vector<GLubyte> blocks;
+	for(int l= levels - 1; l >= 0; --l)
+	{
+		const GLubyte *pixels= data;
+		int w= width;
+		int h= height;
+		if(l > 0)
+		{
+			pixels= &mips.getLevels()[l - 1].pixels[0];
+			w= mips.getLevels()[l - 1].width;
+			h= mips.getLevels()[l - 1].height;
+		}
+		compressor.compress(pixels, w, h, format, quality, ThreadPool::shared(), blocks);
+		memcpy(&image[offsets[l]], &blocks[0], blocks.size());
+		if(l == 0)
+		{
+			header.buildMs= (float)timer.elapsedMs();
+			memcpy(&image[0], &header, sizeof(header));
+		}
+		if(ready)
+			ready(l);
+	}
+	delete[] data;
+}
+
+//written under a temporary name first so a crash never leaves half a file
+void TextureCache::store(const std::string &path, const std::vector<GLubyte> &image) const
+{
+	makeDirectory(directory);
+	char suffix[32];
+	sprintf(suffix, ".%u.tmp", ++tempCount);
+	std::string temp= path + suffix;
+	FILE *fp= fopen(temp.c_str(), "wb");
+	bool written= fp && fwrite(&image[0], 1, image.size(), fp) == image.size();
+	written= fp && fclose(fp) == 0 && written;
+	remove(path.c_str());
+	if(!written || rename(temp.c_str(), path.c_str()) != 0)
+	{
+		cerr<<"TextureCache: can't write "<<path<<endl;
+		remove(temp.c_str());
+	}
+}
+
+TextureCache::Stats TextureCache::getStats() const
+{
+	std::lock_guard<std::mutex> lock(statsMutex);
+	return stats;
+}
+
+bool TextureCache::describe(const GLubyte *image, size_t size, GLint &width, GLint &height, GLenum &glFormat,
+	std::vector<LevelInfo> &levels)
+{
+	FileHeader header;
+	if(size < sizeof(header))
+		return false;
+	memcpy(&header, image, sizeof(header));
+	if(memcmp(header.magic, "TGTC", 4) != 0 || header.version != CACHE_VERSION || header.levels < 1 || header.levels > 32)
+		return false;
+
+	size_t offset= sizeof(FileHeader) + header.levels * sizeof(LevelHeader);
+	levels.resize(header.levels);
+	for(int l= 0; l < header.levels; ++l)
+	{
+		if(offset > size)
+			return false;
+		LevelHeader level;
+		memcpy(&level, image + sizeof(FileHeader) + l * sizeof(LevelHeader), sizeof(level));
+		levels[l].width= level.width;
+		levels[l].height= level.height;
+		levels[l].offset= offset;
+		levels[l].bytes= level.bytes;
+		offset+= level.bytes;
+	}
+	if(offset > size)
+		return false;
+
+	width= header.width;
+	height= header.height;
+	glFormat= header.glFormat;
+	return true;
+}
+
+void TextureCache::prepare(const char *fileName, BlockCompressor::Quality quality, Image &image,
+	const std::function<void(int)> &ready)
+{
+	Timer timer;
+	unsigned long long key= hashFile(fileName, quality);
+	std::string path= cachePath(key);
+
+	//a hit keeps the file mapped and is uploaded from the mapping
+	image.clear();
+	MappedFile &file= image.file;
+	if(key != 0 && file.open(path.c_str()))
+	{
+		GLint width, height;
+		GLenum glFormat;
+		std::vector<LevelInfo> levels;
+		FileHeader header;
+		bool valid= describe(file.bytes(), file.size(), width, height, glFormat, levels);
+		if(valid)
+		{
+			memcpy(&header, file.bytes(), sizeof(header));
+			valid= header.key == key;
+		}
+		if(valid)
+		{
+			//touched here so the uploads on the gl thread don't fault the pages in
+			volatile unsigned int sum= 0;
+			for(size_t i= 0; i < file.size(); i+= 4096)
+				sum+= file.bytes()[i];
+			double ms= timer.elapsedMs();
+			{
+				std::lock_guard<std::mutex> lock(statsMutex);
+				++stats.hits;
+				stats.hitMs+= ms;
+				stats.savedMs+= header.buildMs - ms;
+			}
+			printf("TextureCache: %s hit %s in %.1f ms, built in %.1f ms\n", fileName, path.c_str(), ms, header.buildMs);
+			if(ready)
+				ready(0);
+			return;
+		}
+		cerr<<"TextureCache: ignoring damaged "<<path<<endl;
+	}
+	file.close();
+
+	build(fileName, key, quality, image.built, ready);
+	store(path, image.built);
+
+	double ms= timer.elapsedMs();
+	{
+		std::lock_guard<std::mutex> lock(statsMutex);
+		++stats.misses;
+		stats.missMs+= ms;
+	}
+	printf("TextureCache: %s miss, built %s (%.1f MB) in %.1f ms\n", fileName, path.c_str(), image.size() / 1048576.0, ms);
+}
\ No newline at end of file
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "GLIncludes.h"
+#include "BlockCompressor.h"
+#include "MappedFile.h"
+#include "tgaio.h"
+#include <string>
+#include <vector>
+#include <functional>
+#include <mutex>
+
+//keeps textures on disk the way they go to the gpu, mip chain built and
+//block compressed, in files named after a hash of the source file's bytes
+//and the processing options, so a changed source or setting just misses
+//a hit maps the file and uploads the levels straight from the mapping
+class TextureCache
+{
+public:
+	//where one level sits in a cache file image
+	struct LevelInfo
+	{
+		int width;
+		int height;
+		size_t offset;
+		unsigned int bytes;
+	};
+
+	//a cache file image, the mapped file itself on a hit and built in memory
+	//on a miss, bytes() doesn't move once prepare has filled in the header
+	class Image
+	{
+	private:
+		MappedFile file;
+		std::vector<GLubyte> built;
+
+		//no copies, the mapping goes with the object
+		Image(const Image&);
+		Image& operator=(const Image&);
+
+		friend class TextureCache;
+
+	public:
+		Image() { }
+
+		const GLubyte* bytes() const { return file.isOpen() ? file.bytes() : (built.empty() ? 0 : &built[0]); }
+		size_t size() const { return file.isOpen() ? file.size() : built.size(); }
+		void clear() { file.close(); std::vector<GLubyte>().swap(built); }
+	};
+
+	struct Stats
+	{
+		int hits;
+		int misses;
+		//time spent loading from the cache and building on misses
+		double hitMs;
+		double missMs;
+		//build time recorded in the files that were hit, less the time the hits took
+		double savedMs;
+	};
+
+private:
+	//file layout, a header, one LevelHeader per level, then the level data
+	struct FileHeader
+	{
+		char magic[4];
+		int version;
+		unsigned long long key;
+		int width;
+		int height;
+		unsigned int glFormat;
+		int levels;
+		float buildMs;
+		int reserved;
+	};
+
+	struct LevelHeader
+	{
+		int width;
+		int height;
+		unsigned int bytes;
+	};
+
+	std::string directory;
+	//prepare runs on loader threads, so the stats are only touched under the lock
+	mutable std::mutex statsMutex;
+	Stats stats;
+
+	static unsigned long long hashFile(const char *fileName, BlockCompressor::Quality quality);
+	std::string cachePath(unsigned long long key) const;
+
+	//decodes, mips and compresses the source into a complete cache file image,
+	//the levels are compressed smallest first and ready is told after each
+	void build(const char *fileName, unsigned long long key, BlockCompressor::Quality quality, std::vector<GLubyte> &image,
+		const std::function<void(int)> &ready);
+	void store(const std::string &path, const std::vector<GLubyte> &image) const;
+
+public:
+	explicit TextureCache(const std::string &directory);
+
+	//cache used by everything that doesn't bring its own, kept in texcache/
+	static TextureCache& shared();
+
+	//the cache file image for a TGA or baseline JPEG file without touching GL,
+	//so it can run on a loader thread, mapped from the cache or built and
+	//written back, the levels are uploaded straight from image
+	//ready(first), if given, is called whenever levels first on are complete,
+	//the header is filled in before the first call and image never moves
+	//after it, throws TGAIO::IOException if a miss can't read the source
+	//safe to call from several threads at once, even for the same file
+	void prepare(const char *fileName, BlockCompressor::Quality quality, Image &image,
+		const std::function<void(int)> &ready);
+
+	//size, format and levels of a cache file image, false if it's damaged
+	static bool describe(const GLubyte *image, size_t size, GLint &width, GLint &height, GLenum &glFormat,
+		std::vector<LevelInfo> &levels);
+
+	//a copy, prepare may be updating them on another thread
+	Stats getStats() const;
+};
\ No newline at end of file
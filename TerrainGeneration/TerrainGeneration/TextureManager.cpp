@@ -0,0 +1,287 @@
+#include "TextureManager.h"
+
+#include "Timer.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+using std::cerr;
+using std::endl;
+
+TextureManager::TextureManager() : cache(0), budget(0), minSize(64), frame(0), verbose(false)
+{
+	memset(&stats, 0, sizeof(stats));
+	clearChurn();
+}
+
+void TextureManager::clearChurn()
+{
+	memset(&churn, 0, sizeof(churn));
+}
+
+void TextureManager::Create(size_t budgetBytes, int minSize, TextureCache &cache)
+{
+	this->cache= &cache;
+	this->minSize= minSize;
+	budget= budgetBytes;
+	frame= 0;
+}
+
+void TextureManager::Destroy()
+{
+	for(size_t t= 0; t < textures.size(); ++t)
+	{
+		if(textures[t].texID)
+			glDeleteTextures(1, &textures[t].texID);
+	}
+	textures.clear();
+	memset(&stats, 0, sizeof(stats));
+	clearChurn();
+}
+
+size_t TextureManager::bytesFrom(const Texture &texture, int topLevel) const
+{
+	size_t bytes= 0;
+	for(size_t l= topLevel; l < texture.levels.size(); ++l)
+		bytes+= texture.levels[l].bytes;
+	return bytes;
+}
+
+void TextureManager::makeResident(Texture &texture, int topLevel)
+{
+	GLuint texID= 0;
+	size_t bytes= 0;
+	int count= (int)texture.levels.size() - topLevel;
+	if(count > 0)
+	{
+		const TextureCache::LevelInfo &top= texture.levels[topLevel];
+		glGenTextures(1, &texID);
+		glBindTexture(GL_TEXTURE_2D, texID);
+		glTexStorage2D(GL_TEXTURE_2D, count, texture.glFormat, top.width, top.height);
+		for(int l= 0; l < count; ++l)
+		{
+			const TextureCache::LevelInfo &level= texture.levels[topLevel + l];
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, l, 0, 0, level.width, level.height, texture.glFormat,
+				(GLsizei)level.bytes, texture.image->bytes() + level.offset);
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		bytes= bytesFrom(texture, topLevel);
+		churn.uploadedBytes+= bytes;
+	}
+	if(texture.texID)
+	{
+		glDeleteTextures(1, &texture.texID);
+		churn.freedBytes+= texture.bytes;
+	}
+	stats.residentBytes= stats.residentBytes - texture.bytes + bytes;
+	texture.texID= texID;
+	texture.bytes= bytes;
+	texture.topLevel= topLevel;
+}
+
+bool TextureManager::shrinkOne(size_t excess)
+{
+	//oldest first, the bigger of two as old
+	Texture *victim= 0;
+	for(size_t t= 0; t < textures.size(); ++t)
+	{
+		Texture &texture= textures[t];
+		if(texture.texID == 0 || texture.lastUsed == frame)
+			continue;
+		if(!victim || texture.lastUsed < victim->lastUsed || (texture.lastUsed == victim->lastUsed && texture.bytes > victim->bytes))
+			victim= &texture;
+	}
+	if(!victim)
+		return false;
+
+	//just as many levels as it takes, all of them past the floor
+	int top= victim->topLevel + 1;
+	while(top < victim->floorLevel && victim->bytes - bytesFrom(*victim, top) < excess)
+		++top;
+	if(top <= victim->floorLevel && victim->bytes - bytesFrom(*victim, top) >= excess)
+	{
+		makeResident(*victim, top);
+		++churn.downgraded;
+	}
+	else
+	{
+		makeResident(*victim, (int)victim->levels.size());
+		++churn.evicted;
+	}
+	return true;
+}
+
+TextureManager::Handle TextureManager::load(const char *fileName, BlockCompressor::Quality quality)
+{
+	Texture texture;
+	texture.fileName= fileName;
+	texture.texID= 0;
+	texture.bytes= 0;
+	texture.lastUsed= frame;
+	texture.image= std::make_shared<TextureCache::Image>();
+	GLint width, height;
+	try
+	{
+		cache->prepare(fileName, quality, *texture.image, std::function<void(int)>());
+	}
+	catch(TGAIO::IOException &e)
+	{
+		cerr<<"TextureManager: "<<e.what()<<endl;
+		return -1;
+	}
+	if(!TextureCache::describe(texture.image->bytes(), texture.image->size(), width, height, texture.glFormat, texture.levels))
+	{
+		cerr<<"TextureManager: "<<fileName<<" came back damaged"<<endl;
+		return -1;
+	}
+
+	int count= (int)texture.levels.size();
+	texture.floorLevel= count - 1;
+	for(int l= 0; l < count; ++l)
+	{
+		if(std::max(texture.levels[l].width, texture.levels[l].height) <= minSize)
+		{
+			texture.floorLevel= l;
+			break;
+		}
+	}
+
+	//the finest level that still fits, minSize if none does
+	int top= 0;
+	while(top < texture.floorLevel && stats.residentBytes + bytesFrom(texture, top) > budget)
+		++top;
+	texture.topLevel= count;
+	textures.push_back(texture);
+	GLint bound;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+	makeResident(textures.back(), top);
+	glBindTexture(GL_TEXTURE_2D, bound);
+	return (Handle)textures.size() - 1;
+}
+
+GLuint TextureManager::bind(Handle handle)
+{
+	Texture &texture= textures[handle];
+	texture.lastUsed= frame;
+	if(texture.texID == 0)
+	{
+		makeResident(texture, texture.floorLevel);
+		++churn.restored;
+	}
+	glBindTexture(GL_TEXTURE_2D, texture.texID);
+	return texture.texID;
+}
+
+void TextureManager::endFrame()
+{
+	GLint bound;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+
+	//textures used this frame win back as many levels as fit, at the cost
+	//of the ones that weren't
+	for(size_t t= 0; t < textures.size(); ++t)
+	{
+		Texture &texture= textures[t];
+		if(texture.lastUsed != frame || texture.texID == 0 || texture.topLevel == 0)
+			continue;
+		size_t others= stats.residentBytes - texture.bytes;
+		while(others + bytesFrom(texture, 0) > budget && shrinkOne(others + bytesFrom(texture, 0) - budget))
+			others= stats.residentBytes - texture.bytes;
+		int top= 0;
+		while(top < texture.topLevel && others + bytesFrom(texture, top) > budget)
+			++top;
+		if(top < texture.topLevel)
+		{
+			//a texture upgraded in place of the bound one keeps its binding
+			bool wasBound= (GLint)texture.texID == bound;
+			makeResident(texture, top);
+			if(wasBound)
+				bound= texture.texID;
+			++churn.upgraded;
+		}
+	}
+	while(stats.residentBytes > budget && shrinkOne(stats.residentBytes - budget))
+	{
+	}
+	glBindTexture(GL_TEXTURE_2D, bound);
+
+	size_t residentBytes= stats.residentBytes;
+	stats= churn;
+	stats.frame= frame;
+	stats.budgetBytes= budget;
+	stats.residentBytes= residentBytes;
+	stats.textures= (int)textures.size();
+	for(size_t t= 0; t < textures.size(); ++t)
+	{
+		if(textures[t].texID)
+			++stats.resident;
+	}
+	stats.overBudget= residentBytes > budget;
+	if(verbose && (stats.uploadedBytes > 0 || stats.freedBytes > 0 || stats.overBudget))
+	{
+		printf("TextureManager: frame %d, %.1f of %.1f MB in %d of %d textures, uploaded %.1f MB freed %.1f MB "
+			"(%d evicted, %d downgraded, %d upgraded, %d restored)%s\n",
+			frame, residentBytes / 1048576.0, budget / 1048576.0, stats.resident, stats.textures,
+			stats.uploadedBytes / 1048576.0, stats.freedBytes / 1048576.0, stats.evicted, stats.downgraded,
+			stats.upgraded, stats.restored, stats.overBudget ? ", over budget" : "");
+	}
+	clearChurn();
+	++frame;
+}
+
+void TextureManager::benchmark(const char *fileName, int count, int frames, TextureCache &cache)
+{
+	Timer timer;
+	//everything goes in at the floor until the budget is known
+	TextureManager manager;
+	manager.Create(0, 64, cache);
+	std::vector<Handle> handles;
+	for(int i= 0; i < count; ++i)
+	{
+		Handle handle= manager.load(fileName, BlockCompressor::FAST);
+		if(handle < 0)
+		{
+			manager.Destroy();
+			return;
+		}
+		handles.push_back(handle);
+	}
+	size_t full= manager.bytesFrom(manager.textures[0], 0);
+	manager.setBudget(full * count / 4);
+	double loadMs= timer.elapsedMs();
+
+	//a window of an eighth of the set moves on by one texture every few frames
+	timer.reset();
+	int window= std::max(count / 8, 1);
+	size_t uploaded= 0, freed= 0;
+	int evicted= 0, downgraded= 0, upgraded= 0, restored= 0, overBudget= 0;
+	size_t peak= 0;
+	GLint bound;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+	for(int f= 0; f < frames; ++f)
+	{
+		int first= f / 4;
+		for(int w= 0; w < window; ++w)
+			manager.bind(handles[(first + w) % count]);
+		manager.endFrame();
+		const Stats &s= manager.getStats();
+		uploaded+= s.uploadedBytes;
+		freed+= s.freedBytes;
+		evicted+= s.evicted;
+		downgraded+= s.downgraded;
+		upgraded+= s.upgraded;
+		restored+= s.restored;
+		overBudget+= s.overBudget ? 1 : 0;
+		peak= std::max(peak, s.residentBytes);
+	}
+	glBindTexture(GL_TEXTURE_2D, bound);
+	double frameMs= timer.elapsedMs() / std::max(frames, 1);
+
+	printf("TextureManager: %d x %s (%.1f MB each) in a %.1f MB budget, loaded in %.1f ms, %d frames at %.2f ms, "
+		"peak %.1f MB, %.1f MB uploaded %.1f MB freed (%d evicted, %d downgraded, %d upgraded, %d restored), "
+		"%d frames over budget\n",
+		count, fileName, full / 1048576.0, manager.budget / 1048576.0, loadMs, frames, frameMs, peak / 1048576.0,
+		uploaded / 1048576.0, freed / 1048576.0, evicted, downgraded, upgraded, restored, overBudget);
+	manager.Destroy();
+}
\ No newline at end of file
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "TextureCache.h"
+#include <string>
+#include <vector>
+#include <memory>
+
+//keeps the textures it loads inside a byte budget of video memory
+//each texture's compressed mip chain stays in system memory, on the gpu
+//only the levels from topLevel down are allocated, a texture that goes
+//unused while the budget is short loses as many of its finest levels as it
+//takes, down to minSize, and is then evicted altogether, least recently
+//used first, textures that are bound get their levels back at the end of
+//the frame as far as the budget allows, and an evicted one comes back at
+//minSize the moment it's bound
+//the gl name of a texture changes when its levels do, so it's looked up
+//through its handle every frame
+class TextureManager
+{
+public:
+	typedef int Handle;
+
+	struct Stats
+	{
+		int frame;
+		int textures;
+		//textures with at least one level on the gpu
+		int resident;
+		size_t budgetBytes;
+		size_t residentBytes;
+		//churn of the last frame, bytes uploaded and freed and what caused it
+		size_t uploadedBytes;
+		size_t freedBytes;
+		int evicted;
+		int downgraded;
+		int upgraded;
+		int restored;
+		//the textures bound in the last frame alone didn't fit
+		bool overBudget;
+	};
+
+private:
+	struct Texture
+	{
+		std::string fileName;
+		//cache file image, the source of every upload
+		std::shared_ptr<TextureCache::Image> image;
+		std::vector<TextureCache::LevelInfo> levels;
+		GLenum glFormat;
+		GLuint texID;
+		//finest level on the gpu, levels.size() when evicted
+		int topLevel;
+		//coarsest topLevel it's downgraded to before being evicted
+		int floorLevel;
+		size_t bytes;
+		int lastUsed;
+	};
+
+	std::vector<Texture> textures;
+	TextureCache *cache;
+	size_t budget;
+	int minSize;
+	int frame;
+	bool verbose;
+	Stats stats;
+	//this frame's share of the churn, moved into stats by endFrame
+	Stats churn;
+
+	size_t bytesFrom(const Texture &texture, int topLevel) const;
+	//reallocates the texture with levels topLevel on, or frees it
+	void makeResident(Texture &texture, int topLevel);
+	//frees excess bytes, or what it can, from the least recently used
+	//texture not bound this frame, false when there is none left
+	bool shrinkOne(size_t excess);
+	void clearChurn();
+
+public:
+	TextureManager();
+
+	//levels of minSize texels a side and smaller are only dropped by evicting
+	void Create(size_t budgetBytes, int minSize, TextureCache &cache);
+	//frees every texture, needs the context
+	void Destroy();
+
+	//reads the texture through the cache and uploads as many levels as the
+	//budget has room for, but at least down to minSize, -1 if it can't be read
+	Handle load(const char *fileName, BlockCompressor::Quality quality);
+
+	//binds the texture to the active unit and marks it used this frame
+	GLuint bind(Handle handle);
+
+	//once a frame after drawing, brings the budget back in line and hands
+	//levels back to the textures that were bound
+	void endFrame();
+
+	void setBudget(size_t budgetBytes) { budget= budgetBytes; }
+	//a line for every frame that moved texture memory around
+	void setVerbose(bool verbose) { this->verbose= verbose; }
+
+	const Stats& getStats() const { return stats; }
+
+	//count copies of fileName under a budget of a quarter of them, with a
+	//window of a few textures sliding across the set over frames, prints
+	//the churn it took
+	static void benchmark(const char *fileName, int count, int frames, TextureCache &cache);
+};
\ No newline at end of file
@@ -0,0 +1,158 @@
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(int numThreads) : pending(0), stopping(false)
+{
+	if(numThreads <= 0)
+	{
+		numThreads= (int)std::thread::hardware_concurrency() - 1;
+		if(numThreads < 1)
+			numThreads= 1;
+	}
+
+	for(int i= 0; i < numThreads; ++i)
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		stopping= true;
+	}
+	taskReady.notify_all();
+
+	for(size_t i= 0; i < workers.size(); ++i)
+		workers[i].join();
+}
+
+ThreadPool& ThreadPool::shared()
+{
+	//first use happens on the main thread during Init
+	static ThreadPool pool;
+	return pool;
+}
+
+int ThreadPool::size() const
+{
+	return (int)workers.size() + 1;
+}
+
+void ThreadPool::workerLoop()
+{
+	for(;;)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			while(!stopping && tasks.empty())
+				taskReady.wait(lock);
+
+			if(stopping && tasks.empty())
+				return;
+
+			task= tasks.front();
+			tasks.pop_front();
+		}
+
+		task();
+
+		std::unique_lock<std::mutex> lock(queueMutex);
+		if(--pending == 0)
+			allDone.notify_all();
+	}
+}
+
+void ThreadPool::submit(const std::function<void()>& task)
+{
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		tasks.push_back(task);
+		++pending;
+	}
+	taskReady.notify_one();
+}
+
+void ThreadPool::wait()
+{
+	std::unique_lock<std::mutex> lock(queueMutex);
+	while(pending > 0)
+		allDone.wait(lock);
+}
+
+namespace
+{
+	//shared between the caller and the helper tasks, which may only get
+	//scheduled after parallelFor has already returned
+	struct ForState
+	{
+		std::atomic<int> next;
+		std::atomic<int> completed;
+		int end;
+		int grain;
+		int count;
+		std::function<void(int)> body;
+		std::mutex doneMutex;
+		std::condition_variable done;
+
+		//claims and runs chunks until none are left
+		void run()
+		{
+			for(;;)
+			{
+				int first= next.fetch_add(grain);
+				if(first >= end)
+					return;
+
+				int last= first + grain < end ? first + grain : end;
+				for(int i= first; i < last; ++i)
+					body(i);
+
+				if(completed.fetch_add(last - first) + (last - first) == count)
+				{
+					std::unique_lock<std::mutex> lock(doneMutex);
+					done.notify_all();
+				}
+			}
+		}
+	};
+}
+
+void ThreadPool::parallelFor(int begin, int end, const std::function<void(int)>& body, int grain)
+{
+	if(end <= begin)
+		return;
+	if(grain < 1)
+		grain= 1;
+
+	int count= end - begin;
+	int chunks= (count + grain - 1) / grain;
+
+	//not worth waking anybody up
+	if(chunks == 1 || workers.empty())
+	{
+		for(int i= begin; i < end; ++i)
+			body(i);
+		return;
+	}
+
+	std::shared_ptr<ForState> state= std::make_shared<ForState>();
+	state->next= begin;
+	state->completed= 0;
+	state->end= end;
+	state->grain= grain;
+	state->count= count;
+	state->body= body;
+
+	int helpers= chunks - 1 < (int)workers.size() ? chunks - 1 : (int)workers.size();
+	for(int i= 0; i < helpers; ++i)
+		submit([state]() { state->run(); });
+
+	state->run();
+
+	std::unique_lock<std::mutex> lock(state->doneMutex);
+	while(state->completed.load() < count)
+		state->done.wait(lock);
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//fixed set of worker threads shared by the cpu side terrain systems
+//the calling thread always helps out in parallelFor, so nested calls from
+//inside a task can't deadlock waiting on a busy pool
+class ThreadPool
+{
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()> > tasks;
+	std::mutex queueMutex;
+	std::condition_variable taskReady;
+	std::condition_variable allDone;
+	int pending;
+	bool stopping;
+
+	void workerLoop();
+
+public:
+	//numThreads= 0 picks one worker per hardware thread minus the caller
+	explicit ThreadPool(int numThreads= 0);
+	~ThreadPool();
+
+	//pool used by everything that doesn't bring its own
+	static ThreadPool& shared();
+
+	//number of threads that take part in parallelFor, including the caller
+	int size() const;
+
+	void submit(const std::function<void()>& task);
+
+	//blocks until every task handed to submit has finished
+	void wait();
+
+	//runs body(i) for i in [begin, end), grain indices at a time
+	void parallelFor(int begin, int end, const std::function<void(int)>& body, int grain= 1);
+};
\ No newline at end of file
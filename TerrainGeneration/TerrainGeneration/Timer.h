@@ -0,0 +1,22 @@
+#pragma once
+
+#include <chrono>
+
+//wall clock stopwatch for the timing reports the cpu side systems print
+class Timer
+{
+private:
+	std::chrono::high_resolution_clock::time_point start;
+
+public:
+	Timer() : start(std::chrono::high_resolution_clock::now()) {}
+
+	void reset() { start= std::chrono::high_resolution_clock::now(); }
+
+	double elapsedSeconds() const
+	{
+		return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	double elapsedMs() const { return elapsedSeconds() * 1000.0; }
+};
\ No newline at end of file
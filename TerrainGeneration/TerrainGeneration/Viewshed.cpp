@@ -0,0 +1,279 @@
+#include "Viewshed.h"
+
+#include "Timer.h"
+#include "simd.h"
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+namespace
+{
+	//the eight octants of an observer are its tasks
+	const int OCTANTS= 8;
+
+	//rows of the shared mask are guarded by one of these, picked by x
+	const int ROW_LOCKS= 64;
+
+	//dst|= src over count bytes
+	inline void orInto(unsigned char *dst, const unsigned char *src, int count)
+	{
+		int i= 0;
+#ifdef TG_SSE2
+		for(; i + 16 <= count; i+= 16)
+		{
+			__m128i a= _mm_loadu_si128((const __m128i*)(dst + i));
+			__m128i b= _mm_loadu_si128((const __m128i*)(src + i));
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(a, b));
+		}
+#endif
+		for(; i < count; ++i)
+			dst[i]|= src[i];
+	}
+}
+
+Viewshed::Viewshed() : width(0), depth(0), maskTex(0)
+{
+	stats.observers= 0;
+	stats.tasks= 0;
+	stats.rays= 0;
+	stats.cellsVisited= 0;
+	stats.visibleCells= 0;
+	stats.computeMs= 0.0;
+}
+
+Viewshed::~Viewshed()
+{
+	if(maskTex != 0)
+		glDeleteTextures(1, &maskTex);
+}
+
+//octant k casts rays to the cells [k * r, (k + 1) * r) of the 8r around the
+//square of half size r, two octants to a side going east, north, west, south
+//every ray of a side steps one cell along the same major axis, so four rays
+//are swept side by side in the SSE lanes
+long long Viewshed::sweepOctant(const HeightField &field, const Observer &observer, int octant,
+	int box[4], std::vector<unsigned char> &local) const
+{
+	const float *h= field.heightData();
+	int r= std::max((int)ceil(observer.radius), 1);
+	int side= octant / 2;
+	bool alongX= side % 2 == 0;
+	int sign= side < 2 ? 1 : -1;
+
+	//end point j of the side sits first + dir * j cells off the observer
+	//along the minor axis
+	int dir= (side == 0 || side == 3) ? 1 : -1;
+	int first= -dir * r;
+	int begin= (octant % 2) * r;
+	int end= begin + r;
+	int offA= first + dir * begin;
+	int offB= first + dir * (end - 1);
+
+	int originMajor= alongX ? observer.x : observer.z;
+	int originMinor= alongX ? observer.z : observer.x;
+	int majorSize= alongX ? width : depth;
+	int minorSize= alongX ? depth : width;
+	int majorStride= alongX ? depth : 1;
+	int minorStride= alongX ? 1 : depth;
+
+	int majorLo= sign > 0 ? originMajor : std::max(originMajor - r, 0);
+	int majorHi= sign > 0 ? std::min(originMajor + r, majorSize - 1) : originMajor;
+	int minorLo= std::max(originMinor + std::min(std::min(offA, offB), 0), 0);
+	int minorHi= std::min(originMinor + std::max(std::max(offA, offB), 0), minorSize - 1);
+	box[0]= alongX ? majorLo : minorLo;
+	box[1]= alongX ? majorHi : minorHi;
+	box[2]= alongX ? minorLo : majorLo;
+	box[3]= alongX ? minorHi : majorHi;
+
+	int boxDepth= box[3] - box[2] + 1;
+	local.assign((box[1] - box[0] + 1) * boxDepth, 0);
+	int localMajor= alongX ? boxDepth : 1;
+	int localMinor= alongX ? 1 : boxDepth;
+	unsigned char *out= &local[0] - majorLo * localMajor - minorLo * localMinor;
+
+	out[originMajor * localMajor + originMinor * localMinor]= 255;
+	float eye= h[observer.x * depth + observer.z] + observer.height;
+
+	long long visited= 0;
+	for(int j= begin; j < end; j+= 4)
+	{
+		//how far along the minor axis each ray moves per step, and how many
+		//steps it takes before leaving the radius or the map
+		float slope[4];
+		float invLength[4];
+		float limit[4];
+		int steps= 0;
+		for(int l= 0; l < 4; ++l)
+		{
+			slope[l]= 0.f;
+			invLength[l]= 1.f;
+			limit[l]= 0.f;
+			if(j + l >= end)
+				continue;
+			int off= first + dir * (j + l);
+			slope[l]= (float)off / r;
+			float length= sqrt(1.f + slope[l] * slope[l]);
+			int last= std::min(r, (int)(observer.radius / length));
+			last= std::min(last, sign > 0 ? majorSize - 1 - originMajor : originMajor);
+			if(off > 0)
+				last= std::min(last, (minorSize - 1 - originMinor) * r / off);
+			else if(off < 0)
+				last= std::min(last, originMinor * r / -off);
+			invLength[l]= 1.f / length;
+			limit[l]= (float)last;
+			steps= std::max(steps, last);
+			visited+= last;
+		}
+
+#ifdef TG_SSE2
+		const __m128 vSlope= _mm_loadu_ps(slope);
+		const __m128 vInvLength= _mm_loadu_ps(invLength);
+		const __m128 vLimit= _mm_loadu_ps(limit);
+		const __m128 vOrigin= _mm_set1_ps((float)originMinor);
+		const __m128 vMinorMax= _mm_set1_ps((float)(minorSize - 1));
+		const __m128 vEye= _mm_set1_ps(eye);
+		const __m128 vTarget= _mm_set1_ps(observer.targetHeight);
+		const __m128 half= _mm_set1_ps(0.5f);
+		__m128 horizon= _mm_set1_ps(-1e30f);
+		for(int i= 1; i <= steps; ++i)
+		{
+			int major= originMajor + sign * i;
+			const float *row= h + major * majorStride;
+			__m128 vi= _mm_set1_ps((float)i);
+			__m128 minor= _mm_add_ps(vOrigin, _mm_mul_ps(vi, vSlope));
+			minor= _mm_min_ps(_mm_max_ps(minor, _mm_setzero_ps()), vMinorMax);
+			__m128i cell= _mm_cvttps_epi32(minor);
+			__m128 frac= _mm_sub_ps(minor, _mm_cvtepi32_ps(cell));
+
+			int c[4];
+			_mm_storeu_si128((__m128i*)c, cell);
+			float lo[4], hi[4];
+			for(int l= 0; l < 4; ++l)
+			{
+				lo[l]= row[c[l] * minorStride];
+				hi[l]= row[std::min(c[l] + 1, minorSize - 1) * minorStride];
+			}
+			__m128 vLo= _mm_loadu_ps(lo);
+			__m128 vHi= _mm_loadu_ps(hi);
+
+			//the ray crosses this column between two cells, the nearer one is
+			//the cell we decide about and the interpolated ground raises the horizon
+			__m128 invDist= _mm_mul_ps(vInvLength, _mm_set1_ps(1.f / i));
+			__m128 roundUp= _mm_cmpge_ps(frac, half);
+			__m128 nearest= _mm_or_ps(_mm_and_ps(roundUp, vHi), _mm_andnot_ps(roundUp, vLo));
+			__m128 seen= _mm_mul_ps(_mm_sub_ps(_mm_add_ps(nearest, vTarget), vEye), invDist);
+			__m128 active= _mm_cmple_ps(vi, vLimit);
+			int visible= _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(seen, horizon), active));
+
+			__m128 ground= _mm_add_ps(vLo, _mm_mul_ps(_mm_sub_ps(vHi, vLo), frac));
+			horizon= _mm_max_ps(horizon, _mm_mul_ps(_mm_sub_ps(ground, vEye), invDist));
+
+			if(visible == 0)
+				continue;
+			int up= _mm_movemask_ps(roundUp);
+			for(int l= 0; l < 4; ++l)
+			{
+				if(visible >> l & 1)
+					out[major * localMajor + (c[l] + (up >> l & 1)) * localMinor]= 255;
+			}
+		}
+#else
+		float horizon[4]= { -1e30f, -1e30f, -1e30f, -1e30f };
+		for(int i= 1; i <= steps; ++i)
+		{
+			int major= originMajor + sign * i;
+			const float *row= h + major * majorStride;
+			for(int l= 0; l < 4; ++l)
+			{
+				if(i > limit[l])
+					continue;
+				float minor= std::min(std::max(originMinor + i * slope[l], 0.f), (float)(minorSize - 1));
+				int c= (int)minor;
+				float frac= minor - c;
+				float lo= row[c * minorStride];
+				float hi= row[std::min(c + 1, minorSize - 1) * minorStride];
+
+				float invDist= invLength[l] * (1.f / i);
+				bool roundUp= frac >= 0.5f;
+				float seen= ((roundUp ? hi : lo) + observer.targetHeight - eye) * invDist;
+				if(seen >= horizon[l])
+					out[major * localMajor + (c + (roundUp ? 1 : 0)) * localMinor]= 255;
+				horizon[l]= std::max(horizon[l], (lo + (hi - lo) * frac - eye) * invDist);
+			}
+		}
+#endif
+	}
+	return visited;
+}
+
+void Viewshed::compute(const HeightField &field, const std::vector<Observer> &observers, ThreadPool &pool)
+{
+	Timer timer;
+	width= field.getWidth();
+	depth= field.getDepth();
+	mask.assign(width * depth, 0);
+
+	//observers off the map are moved onto its edge
+	std::vector<Observer> placed(observers);
+	for(size_t o= 0; o < placed.size(); ++o)
+	{
+		placed[o].x= std::min(std::max(placed[o].x, 0), width - 1);
+		placed[o].z= std::min(std::max(placed[o].z, 0), depth - 1);
+	}
+
+	//every task sweeps into its own box and ors it into the shared mask a
+	//row at a time, so tasks of nearby observers only meet on single rows
+	int numTasks= (int)placed.size() * OCTANTS;
+	std::vector<long long> visited(numTasks, 0);
+	std::unique_ptr<std::mutex[]> rowLocks(new std::mutex[ROW_LOCKS]);
+	pool.parallelFor(0, numTasks, [&](int task) {
+		int box[4];
+		std::vector<unsigned char> local;
+		visited[task]= sweepOctant(field, placed[task / OCTANTS], task % OCTANTS, box, local);
+
+		int boxDepth= box[3] - box[2] + 1;
+		for(int x= box[0]; x <= box[1]; ++x)
+		{
+			std::lock_guard<std::mutex> lock(rowLocks[x % ROW_LOCKS]);
+			orInto(&mask[x * depth + box[2]], &local[(x - box[0]) * boxDepth], boxDepth);
+		}
+	});
+
+	stats.observers= (int)placed.size();
+	stats.tasks= numTasks;
+	stats.rays= 0;
+	stats.cellsVisited= 0;
+	for(size_t o= 0; o < placed.size(); ++o)
+		stats.rays+= OCTANTS * std::max((int)ceil(placed[o].radius), 1);
+	for(int t= 0; t < numTasks; ++t)
+		stats.cellsVisited+= visited[t];
+	stats.visibleCells= width * depth - (int)std::count(mask.begin(), mask.end(), 0);
+	stats.computeMs= timer.elapsedMs();
+
+	printf("Viewshed: %d observers on %dx%d, %.1f%% visible, %.1f ms (%lld rays, %.0f M cells/s) on %d threads\n",
+		stats.observers, width, depth, 100.0 * stats.visibleCells / (width * depth), stats.computeMs,
+		stats.rays, stats.cellsVisited / (stats.computeMs * 1000.0 + 1e-9), pool.size());
+}
+
+void Viewshed::upload()
+{
+	//the storage is immutable, so a new mask gets a new texture
+	if(maskTex != 0)
+		glDeleteTextures(1, &maskTex);
+	glGenTextures(1, &maskTex);
+
+	//unit 4 is the overlay's, rows of depth bytes aren't always 4 aligned
+	glActiveTexture(GL_TEXTURE4);
+	glBindTexture(GL_TEXTURE_2D, maskTex);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8, depth, width);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, depth, width, GL_RED, GL_UNSIGNED_BYTE, &mask[0]);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glActiveTexture(GL_TEXTURE0);
+}
\ No newline at end of file
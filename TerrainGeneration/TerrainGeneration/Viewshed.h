@@ -0,0 +1,65 @@
+#pragma once
+
+#include "GLSLProgram.h"
+#include "HeightField.h"
+#include "ThreadPool.h"
+#include <vector>
+
+//line of sight analysis over the height field grid
+//every observer casts R2 style rays to each cell on the square around it and
+//sweeps the highest slope seen so far along them, the eight octants of every
+//observer are separate pool tasks and the union of what they see ends up in
+//one mask that can be drawn over the terrain
+class Viewshed
+{
+public:
+	struct Observer
+	{
+		int x;
+		int z;
+		//eye above the ground at (x, z), and how far above the ground a
+		//cell's point has to be seen for the cell to count as visible
+		float height;
+		float targetHeight;
+		float radius;
+	};
+
+	struct Stats
+	{
+		int observers;
+		int tasks;
+		long long rays;
+		long long cellsVisited;
+		int visibleCells;
+		double computeMs;
+	};
+
+private:
+	int width;
+	int depth;
+	//255 where any observer sees the cell, indexed [x * depth + z] like the heights
+	std::vector<unsigned char> mask;
+
+	GLuint maskTex;
+	Stats stats;
+
+	//sweeps one octant of an observer into local, which covers the octant's
+	//bounding box x0, x1, z0, z1 on the map, returns the number of cells visited
+	long long sweepOctant(const HeightField &field, const Observer &observer, int octant,
+		int box[4], std::vector<unsigned char> &local) const;
+
+public:
+	Viewshed();
+	~Viewshed();
+
+	void compute(const HeightField &field, const std::vector<Observer> &observers, ThreadPool &pool);
+
+	//copies the mask into an R8 texture on unit 4, s along z and t along x
+	//like the terrain texture
+	void upload();
+
+	bool isVisible(int x, int z) const { return mask[x * depth + z] != 0; }
+	const std::vector<unsigned char>& getMask() const { return mask; }
+	GLuint getTexture() const { return maskTex; }
+	const Stats& getStats() const { return stats; }
+};
\ No newline at end of file
@@ -0,0 +1,497 @@
+#include "VoxelTerrain.h"
+
+#include "simd.h"
+#include "Timer.h"
+#include <math.h>
+
+namespace
+{
+	//cube corner i sits at (i & 1, (i >> 1) & 1, (i >> 2) & 1)
+	//edges 0-3 run along x, 4-7 along y and 8-11 along z, lower corner first
+	const int cornerPairs[12][2]=
+	{
+		{0, 1}, {2, 3}, {4, 5}, {6, 7},
+		{0, 2}, {1, 3}, {4, 6}, {5, 7},
+		{0, 4}, {1, 5}, {2, 6}, {3, 7}
+	};
+
+	//corners of each cube face, counter clockwise seen from outside
+	const int faceCorners[6][4]=
+	{
+		{0, 4, 6, 2}, {1, 3, 7, 5},
+		{0, 1, 5, 4}, {2, 6, 7, 3},
+		{0, 2, 3, 1}, {4, 5, 7, 6}
+	};
+
+	//edge triples per cube case, -1 terminated
+	signed char triTable[256][16];
+	bool triTableBuilt= false;
+
+	int edgeBetween(int a, int b)
+	{
+		for(int e= 0; e < 12; ++e)
+		{
+			if((cornerPairs[e][0] == a && cornerPairs[e][1] == b) ||
+				(cornerPairs[e][0] == b && cornerPairs[e][1] == a))
+				return e;
+		}
+		return -1;
+	}
+
+	//rather than carrying the 4096 entry table around we trace the surface
+	//loops on the cube faces and fan them
+	//ambiguous faces always keep the solid corners apart, and since that only
+	//depends on the face itself neighbouring cubes agree and the mesh stays closed
+	//triangles come out counter clockwise seen from the empty side
+	void buildTriangleTable()
+	{
+		for(int cube= 0; cube < 256; ++cube)
+		{
+			//on each face a segment enters over an empty->solid edge and leaves
+			//over the edge where that run of solid corners ends
+			int nextEdge[12];
+			for(int e= 0; e < 12; ++e)
+				nextEdge[e]= -1;
+
+			for(int f= 0; f < 6; ++f)
+			{
+				for(int k= 0; k < 4; ++k)
+				{
+					int a= faceCorners[f][k];
+					int b= faceCorners[f][(k + 1) & 3];
+					if((cube >> a & 1) || !(cube >> b & 1))
+						continue;
+
+					int j= (k + 1) & 3;
+					while(cube >> faceCorners[f][(j + 1) & 3] & 1)
+						j= (j + 1) & 3;
+
+					nextEdge[edgeBetween(a, b)]= edgeBetween(faceCorners[f][j], faceCorners[f][(j + 1) & 3]);
+				}
+			}
+
+			//every crossed edge is entered on one face and left on the other,
+			//so following nextEdge walks closed loops
+			int count= 0;
+			bool used[12]= {false};
+			for(int start= 0; start < 12; ++start)
+			{
+				if(nextEdge[start] < 0 || used[start])
+					continue;
+
+				int loop[12];
+				int n= 0;
+				for(int e= start; !used[e]; e= nextEdge[e])
+				{
+					used[e]= true;
+					loop[n++]= e;
+				}
+
+				for(int i= 1; i + 1 < n; ++i)
+				{
+					triTable[cube][count++]= loop[0];
+					triTable[cube][count++]= loop[i];
+					triTable[cube][count++]= loop[i + 1];
+				}
+			}
+
+			for(; count < 16; ++count)
+				triTable[cube][count]= -1;
+		}
+		triTableBuilt= true;
+	}
+
+	float hashLattice(int x, int y, int z)
+	{
+		unsigned int h= (unsigned int)x * 73856093u ^ (unsigned int)y * 19349663u ^ (unsigned int)z * 83492791u;
+		h= (h ^ (h >> 13)) * 1274126177u;
+		h^= h >> 16;
+		return (h & 0xFFFF) / 65535.f;
+	}
+
+	//trilinear value noise in [0, 1]
+	float valueNoise(float x, float y, float z)
+	{
+		int x0= (int)floor(x);
+		int y0= (int)floor(y);
+		int z0= (int)floor(z);
+		float fx= x - x0;
+		float fy= y - y0;
+		float fz= z - z0;
+		fx= fx * fx * (3.f - 2.f * fx);
+		fy= fy * fy * (3.f - 2.f * fy);
+		fz= fz * fz * (3.f - 2.f * fz);
+
+		float c00= hashLattice(x0, y0, z0) + (hashLattice(x0 + 1, y0, z0) - hashLattice(x0, y0, z0)) * fx;
+		float c10= hashLattice(x0, y0 + 1, z0) + (hashLattice(x0 + 1, y0 + 1, z0) - hashLattice(x0, y0 + 1, z0)) * fx;
+		float c01= hashLattice(x0, y0, z0 + 1) + (hashLattice(x0 + 1, y0, z0 + 1) - hashLattice(x0, y0, z0 + 1)) * fx;
+		float c11= hashLattice(x0, y0 + 1, z0 + 1) + (hashLattice(x0 + 1, y0 + 1, z0 + 1) - hashLattice(x0, y0 + 1, z0 + 1)) * fx;
+
+		float c0= c00 + (c10 - c00) * fy;
+		float c1= c01 + (c11 - c01) * fy;
+		return c0 + (c1 - c0) * fz;
+	}
+
+	inline int sampleIndex(int x, int y, int z)
+	{
+		return (z * VoxelTerrain::CHUNK_SAMPLES + y) * VoxelTerrain::ROW_STRIDE + x;
+	}
+
+	//bit x set where row[x] is solid
+	unsigned long long classifyRow(const float *row)
+	{
+		unsigned long long mask= 0;
+#ifdef TG_SSE2
+		__m128 zero= _mm_setzero_ps();
+		for(int x= 0; x < VoxelTerrain::ROW_STRIDE; x+= 4)
+		{
+			int bits= _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(row + x), zero));
+			mask|= (unsigned long long)bits << x;
+		}
+#else
+		for(int x= 0; x < VoxelTerrain::CHUNK_SAMPLES; ++x)
+		{
+			if(row[x] > 0.f)
+				mask|= 1ull << x;
+		}
+#endif
+		return mask & ((1ull << VoxelTerrain::CHUNK_SAMPLES) - 1);
+	}
+
+	//central differences, one sided on the chunk border
+	vec3 gradientAt(const float *d, int x, int y, int z)
+	{
+		const int last= VoxelTerrain::CHUNK_CELLS;
+		int x0= x > 0 ? x - 1 : 0, x1= x < last ? x + 1 : last;
+		int y0= y > 0 ? y - 1 : 0, y1= y < last ? y + 1 : last;
+		int z0= z > 0 ? z - 1 : 0, z1= z < last ? z + 1 : last;
+
+		return vec3(
+			(d[sampleIndex(x1, y, z)] - d[sampleIndex(x0, y, z)]) / (x1 - x0),
+			(d[sampleIndex(x, y1, z)] - d[sampleIndex(x, y0, z)]) / (y1 - y0),
+			(d[sampleIndex(x, y, z1)] - d[sampleIndex(x, y, z0)]) / (z1 - z0));
+	}
+
+	const float caveFrequency= 1.f / 48.f;
+	const float caveThreshold= 0.62f;
+	const float caveStrength= 40.f;
+}
+
+VoxelTerrain::VoxelTerrain() : chunksX(0), chunksY(0), chunksZ(0), voxelSize(1.f), pool(NULL)
+{
+	lastStats.chunksMeshed= 0;
+	lastStats.triangles= 0;
+	lastStats.threads= 0;
+	lastStats.seconds= 0.0;
+	lastStats.chunksPerSecond= 0.0;
+}
+
+VoxelTerrain::~VoxelTerrain()
+{
+	for(size_t i= 0; i < chunks.size(); ++i)
+	{
+		if(chunks[i].vaoHandle == 0)
+			continue;
+		glDeleteVertexArrays(1, &chunks[i].vaoHandle);
+		glDeleteBuffers(1, &chunks[i].vertexBuffer);
+		glDeleteBuffers(1, &chunks[i].elementBuffer);
+	}
+}
+
+bool VoxelTerrain::Create(const HeightField &field, float vSize, ThreadPool &threadPool)
+{
+	if(!triTableBuilt)
+		buildTriangleTable();
+
+	pool= &threadPool;
+	voxelSize= vSize;
+
+	//height maps are 8 bit, so 256 units covers everything above ground
+	chunksX= (int)ceil(field.getWidth() / voxelSize / CHUNK_CELLS);
+	chunksY= (int)ceil(256.f / voxelSize / CHUNK_CELLS);
+	chunksZ= (int)ceil(field.getDepth() / voxelSize / CHUNK_CELLS);
+
+	chunks.resize(chunksX * chunksY * chunksZ);
+	for(int cz= 0; cz < chunksZ; ++cz)
+	{
+		for(int cy= 0; cy < chunksY; ++cy)
+		{
+			for(int cx= 0; cx < chunksX; ++cx)
+			{
+				Chunk &c= chunks[(cz * chunksY + cy) * chunksX + cx];
+				c.cx= cx;
+				c.cy= cy;
+				c.cz= cz;
+				c.vaoHandle= 0;
+				c.vertexBuffer= 0;
+				c.elementBuffer= 0;
+				c.numOfElements= 0;
+				c.dirty= true;
+			}
+		}
+	}
+
+	pool->parallelFor(0, (int)chunks.size(), [&](int i) { generateDensity(chunks[i], field); });
+
+	update();
+	return true;
+}
+
+void VoxelTerrain::generateDensity(Chunk &c, const HeightField &field)
+{
+	c.density.assign(ROW_STRIDE * CHUNK_SAMPLES * CHUNK_SAMPLES, 0.f);
+
+	for(int z= 0; z < CHUNK_SAMPLES; ++z)
+	{
+		for(int x= 0; x < CHUNK_SAMPLES; ++x)
+		{
+			float wx= (c.cx * CHUNK_CELLS + x) * voxelSize;
+			float wz= (c.cz * CHUNK_CELLS + z) * voxelSize;
+			float ground= field.sampleHeight(wx, wz);
+
+			for(int y= 0; y < CHUNK_SAMPLES; ++y)
+			{
+				float wy= (c.cy * CHUNK_CELLS + y) * voxelSize;
+				float d= ground - wy;
+
+				//caves stay a few voxels clear of the bottom of the volume
+				if(d > 0.f && wy > 2.f * voxelSize)
+				{
+					float cave= caveStrength * (valueNoise(wx * caveFrequency, wy * caveFrequency, wz * caveFrequency) - caveThreshold);
+					if(-cave < d)
+						d= -cave;
+				}
+				c.density[sampleIndex(x, y, z)]= d;
+			}
+		}
+	}
+}
+
+float VoxelTerrain::densityAt(int x, int y, int z) const
+{
+	if(x < 0 || y < 0 || z < 0)
+		return 0.f;
+
+	int cx= x / CHUNK_CELLS;
+	int cy= y / CHUNK_CELLS;
+	int cz= z / CHUNK_CELLS;
+
+	//the far face of the volume lives in the last chunk's shared samples
+	if(cx == chunksX && x % CHUNK_CELLS == 0) --cx;
+	if(cy == chunksY && y % CHUNK_CELLS == 0) --cy;
+	if(cz == chunksZ && z % CHUNK_CELLS == 0) --cz;
+	if(cx >= chunksX || cy >= chunksY || cz >= chunksZ)
+		return 0.f;
+
+	const Chunk &c= chunks[(cz * chunksY + cy) * chunksX + cx];
+	return c.density[sampleIndex(x - cx * CHUNK_CELLS, y - cy * CHUNK_CELLS, z - cz * CHUNK_CELLS)];
+}
+
+void VoxelTerrain::edit(const vec3 &center, float radius, float amount)
+{
+	vec3 lattice= center / voxelSize;
+	float r= radius / voxelSize;
+
+	int x0= (int)floor(lattice.x - r), x1= (int)ceil(lattice.x + r);
+	int y0= (int)floor(lattice.y - r), y1= (int)ceil(lattice.y + r);
+	int z0= (int)floor(lattice.z - r), z1= (int)ceil(lattice.z + r);
+
+	for(int z= z0; z <= z1; ++z)
+	{
+		for(int y= y0; y <= y1; ++y)
+		{
+			for(int x= x0; x <= x1; ++x)
+			{
+				vec3 d= vec3((float)x, (float)y, (float)z) - lattice;
+				float dist= sqrt(glm::dot(d, d));
+				if(dist > r)
+					continue;
+				float delta= amount * (1.f - dist / r);
+
+				//samples on a chunk boundary are stored by every chunk that shares them
+				for(int oz= 0; oz < 2; ++oz)
+				{
+					for(int oy= 0; oy < 2; ++oy)
+					{
+						for(int ox= 0; ox < 2; ++ox)
+						{
+							int cx= x / CHUNK_CELLS - ox;
+							int cy= y / CHUNK_CELLS - oy;
+							int cz= z / CHUNK_CELLS - oz;
+							if(x < 0 || y < 0 || z < 0 || cx < 0 || cy < 0 || cz < 0 ||
+								cx >= chunksX || cy >= chunksY || cz >= chunksZ)
+								continue;
+
+							int lx= x - cx * CHUNK_CELLS;
+							int ly= y - cy * CHUNK_CELLS;
+							int lz= z - cz * CHUNK_CELLS;
+							if(lx > CHUNK_CELLS || ly > CHUNK_CELLS || lz > CHUNK_CELLS)
+								continue;
+
+							Chunk &c= chunks[(cz * chunksY + cy) * chunksX + cx];
+							c.density[sampleIndex(lx, ly, lz)]+= delta;
+							c.dirty= true;
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+void VoxelTerrain::meshChunk(Chunk &c)
+{
+	c.vertices.clear();
+	c.indices.clear();
+
+	const float *d= &c.density[0];
+
+	//solid bits for every row of samples
+	std::vector<unsigned long long> rowMask(CHUNK_SAMPLES * CHUNK_SAMPLES);
+	for(int z= 0; z < CHUNK_SAMPLES; ++z)
+		for(int y= 0; y < CHUNK_SAMPLES; ++y)
+			rowMask[z * CHUNK_SAMPLES + y]= classifyRow(d + sampleIndex(0, y, z));
+
+	//vertex index for the +x, +y and +z edge leaving each sample, so cells
+	//sharing an edge share its vertex
+	std::vector<int> edgeCache(3 * CHUNK_SAMPLES * CHUNK_SAMPLES * CHUNK_SAMPLES, -1);
+
+	const unsigned long long full= (1ull << CHUNK_SAMPLES) - 1;
+	vec3 origin= vec3((float)c.cx, (float)c.cy, (float)c.cz) * (float)CHUNK_CELLS;
+
+	for(int z= 0; z < CHUNK_CELLS; ++z)
+	{
+		for(int y= 0; y < CHUNK_CELLS; ++y)
+		{
+			unsigned long long r00= rowMask[z * CHUNK_SAMPLES + y];
+			unsigned long long r10= rowMask[z * CHUNK_SAMPLES + y + 1];
+			unsigned long long r01= rowMask[(z + 1) * CHUNK_SAMPLES + y];
+			unsigned long long r11= rowMask[(z + 1) * CHUNK_SAMPLES + y + 1];
+
+			//whole row of cells entirely inside or outside
+			if((r00 | r10 | r01 | r11) == 0 || (r00 & r10 & r01 & r11) == full)
+				continue;
+
+			for(int x= 0; x < CHUNK_CELLS; ++x)
+			{
+				int cube= (int)((r00 >> x) & 3) | (int)((r10 >> x) & 3) << 2 |
+					(int)((r01 >> x) & 3) << 4 | (int)((r11 >> x) & 3) << 6;
+				if(cube == 0 || cube == 255)
+					continue;
+
+				for(int t= 0; triTable[cube][t] >= 0; ++t)
+				{
+					int e= triTable[cube][t];
+					int a= cornerPairs[e][0];
+					int b= cornerPairs[e][1];
+					int axis= e >> 2;
+
+					int ax= x + (a & 1), ay= y + (a >> 1 & 1), az= z + (a >> 2 & 1);
+					int cacheIndex= ((az * CHUNK_SAMPLES + ay) * CHUNK_SAMPLES + ax) * 3 + axis;
+					if(edgeCache[cacheIndex] < 0)
+					{
+						int bx= x + (b & 1), by= y + (b >> 1 & 1), bz= z + (b >> 2 & 1);
+						float da= d[sampleIndex(ax, ay, az)];
+						float db= d[sampleIndex(bx, by, bz)];
+						float s= da / (da - db);
+
+						vec3 ga= gradientAt(d, ax, ay, az);
+						vec3 gb= gradientAt(d, bx, by, bz);
+						vec3 grad= ga + (gb - ga) * s;
+						float len= sqrt(glm::dot(grad, grad));
+						vec3 normal= len > 0.f ? grad * (-1.f / len) : vec3(0.f, 1.f, 0.f);
+
+						vec3 p= origin + vec3((float)ax, (float)ay, (float)az);
+						p[axis]+= s;
+						p= p * voxelSize;
+
+						edgeCache[cacheIndex]= (int)(c.vertices.size() / 6);
+						c.vertices.push_back(p.x);
+						c.vertices.push_back(p.y);
+						c.vertices.push_back(p.z);
+						c.vertices.push_back(normal.x);
+						c.vertices.push_back(normal.y);
+						c.vertices.push_back(normal.z);
+					}
+					c.indices.push_back(edgeCache[cacheIndex]);
+				}
+			}
+		}
+	}
+}
+
+void VoxelTerrain::uploadChunk(Chunk &c)
+{
+	c.numOfElements= (int)c.indices.size();
+	if(c.numOfElements == 0)
+		return;
+
+	if(c.vaoHandle == 0)
+	{
+		glGenVertexArrays(1, &c.vaoHandle);
+		glGenBuffers(1, &c.vertexBuffer);
+		glGenBuffers(1, &c.elementBuffer);
+
+		glBindVertexArray(c.vaoHandle);
+		glBindBuffer(GL_ARRAY_BUFFER, c.vertexBuffer);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, c.elementBuffer);
+		glBindVertexArray(0);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, c.vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, c.vertices.size() * sizeof(float), &c.vertices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, c.elementBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, c.indices.size() * sizeof(GLuint), &c.indices[0], GL_STATIC_DRAW);
+
+	//the gpu has its own copy now
+	std::vector<float>().swap(c.vertices);
+	std::vector<GLuint>().swap(c.indices);
+}
+
+int VoxelTerrain::update()
+{
+	std::vector<int> dirty;
+	for(size_t i= 0; i < chunks.size(); ++i)
+	{
+		if(chunks[i].dirty)
+			dirty.push_back((int)i);
+	}
+	if(dirty.empty())
+		return 0;
+
+	Timer timer;
+	pool->parallelFor(0, (int)dirty.size(), [&](int i) { meshChunk(chunks[dirty[i]]); });
+	double meshSeconds= timer.elapsedSeconds();
+
+	int triangles= 0;
+	for(size_t i= 0; i < dirty.size(); ++i)
+	{
+		Chunk &c= chunks[dirty[i]];
+		triangles+= (int)c.indices.size() / 3;
+		uploadChunk(c);
+		c.dirty= false;
+	}
+
+	lastStats.chunksMeshed= (int)dirty.size();
+	lastStats.triangles= triangles;
+	lastStats.threads= pool->size();
+	lastStats.seconds= meshSeconds;
+	lastStats.chunksPerSecond= meshSeconds > 0.0 ? dirty.size() / meshSeconds : 0.0;
+	return lastStats.chunksMeshed;
+}
+
+void VoxelTerrain::Render(void)
+{
+	for(size_t i= 0; i < chunks.size(); ++i)
+	{
+		if(chunks[i].numOfElements == 0)
+			continue;
+		glBindVertexArray(chunks[i].vaoHandle);
+		glDrawElements(GL_TRIANGLES, chunks[i].numOfElements, GL_UNSIGNED_INT, (void*)0);
+	}
+	glBindVertexArray(0);
+}
\ No newline at end of file
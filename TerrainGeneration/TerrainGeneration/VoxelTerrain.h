@@ -0,0 +1,83 @@
+#pragma once
+
+#include "GLSLProgram.h"
+#include "HeightField.h"
+#include "ThreadPool.h"
+#include <vector>
+#include <glm/glm.hpp>
+using glm::vec3;
+
+//chunked density field meshed with marching cubes
+//positive density is solid ground, so unlike the height field it can
+//represent caves and overhangs
+class VoxelTerrain
+{
+public:
+	//cells along each edge of a chunk
+	static const int CHUNK_CELLS= 32;
+	//density samples along each edge, the last one duplicates the first of the next chunk
+	static const int CHUNK_SAMPLES= CHUNK_CELLS + 1;
+	//samples per stored row, padded to a multiple of 4 for the SSE classification
+	static const int ROW_STRIDE= 36;
+
+	struct MeshStats
+	{
+		int chunksMeshed;
+		int triangles;
+		int threads;
+		double seconds;
+		double chunksPerSecond;
+	};
+
+private:
+	struct Chunk
+	{
+		int cx, cy, cz;
+		//ROW_STRIDE * CHUNK_SAMPLES * CHUNK_SAMPLES samples, x fastest then y then z
+		std::vector<float> density;
+		//interleaved position and normal, world space
+		std::vector<float> vertices;
+		std::vector<GLuint> indices;
+
+		GLuint vaoHandle;
+		GLuint vertexBuffer;
+		GLuint elementBuffer;
+		int numOfElements;
+		bool dirty;
+	};
+
+	int chunksX;
+	int chunksY;
+	int chunksZ;
+	float voxelSize;
+	std::vector<Chunk> chunks;
+	ThreadPool *pool;
+	MeshStats lastStats;
+
+	void generateDensity(Chunk &c, const HeightField &field);
+	void meshChunk(Chunk &c);
+	void uploadChunk(Chunk &c);
+
+public:
+	VoxelTerrain();
+	~VoxelTerrain();
+
+	//samples the height field every voxelSize units, carving noise caves under the surface
+	bool Create(const HeightField &field, float voxelSize, ThreadPool &pool);
+
+	//adds amount to the density inside a sphere (negative digs), falling off
+	//towards the edge, and marks the chunks it touched for re-meshing
+	void edit(const vec3 &center, float radius, float amount);
+
+	//re-meshes the dirty chunks on the pool and uploads them, quietly since
+	//it runs every frame while digging, getStats has the timings
+	//returns the number of chunks meshed
+	int update();
+
+	void Render(void);
+
+	//density at lattice point (x, y, z), zero outside the volume
+	float densityAt(int x, int y, int z) const;
+
+	const MeshStats& getStats() const { return lastStats; }
+};
\ No newline at end of file
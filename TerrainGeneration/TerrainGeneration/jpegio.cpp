@@ -0,0 +1,818 @@
+#include "jpegio.h"
+
+#include "MappedFile.h"
+#include "simd.h"
+#include "Timer.h"
+#include <vector>
+#include <string>
+#include <math.h>
+#include <string.h>
+#include <stdio.h>
+#ifdef TG_SSE2
+#include <xmmintrin.h>
+#endif
+
+namespace JPEGIO {
+
+namespace {
+
+using TGAIO::IOException;
+
+// Natural order index of each zigzag position, padded so a corrupt run
+// length past the end lands on a harmless slot
+const int ZIGZAG[64 + 16] = {
+	 0,  1,  8, 16,  9,  2,  3, 10,
+	17, 24, 32, 25, 18, 11,  4,  5,
+	12, 19, 26, 33, 40, 48, 41, 34,
+	27, 20, 13,  6,  7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36,
+	29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46,
+	53, 60, 61, 54, 47, 55, 62, 63,
+	63, 63, 63, 63, 63, 63, 63, 63,
+	63, 63, 63, 63, 63, 63, 63, 63
+};
+
+// Codes this long or shorter are decoded with a single table lookup
+const int FAST_BITS = 9;
+
+struct Huffman {
+	GLubyte fast[1 << FAST_BITS];
+	// For AC tables, codes whose run, size and value all fit in FAST_BITS:
+	// value << 8 | run << 4 | bits used, 0 where they don't
+	short fastAC[1 << FAST_BITS];
+	GLubyte values[256];
+	GLubyte sizes[257];
+	unsigned short codes[256];
+	// Largest code of each length, left aligned to 16 bits
+	unsigned int maxcode[18];
+	// Index of the first value of each length less its first code
+	int delta[17];
+	bool defined;
+};
+
+struct Component {
+	int id;
+	int h, v;
+	int tq;
+	int td, ta;
+	// Samples of the component itself, and its padded block grid
+	int width, height;
+	int blocksW, blocksH;
+	// Dequantization with the IDCT's scale folded in, natural order
+	float quant[64];
+	std::vector<short> coefs;
+	std::vector<GLubyte> plane;
+};
+
+struct Frame {
+	int width, height;
+	int hmax, vmax;
+	int mcusX, mcusY;
+	std::vector<Component> components;
+	unsigned short quant[4][64];
+	bool quantDefined[4];
+	Huffman dc[4];
+	Huffman ac[4];
+	int restartInterval;
+	int adobeTransform;
+};
+
+void buildHuffman( Huffman & huff, const GLubyte * counts, const GLubyte * symbols ) {
+	int k = 0;
+	for( int i = 0; i < 16; i++ ) {
+		for( int j = 0; j < counts[i]; j++ ) {
+			if( k >= 256 )
+				throw IOException("Error: bad JPEG Huffman table");
+			huff.sizes[k++] = (GLubyte)(i + 1);
+		}
+	}
+	huff.sizes[k] = 0;
+	memcpy(huff.values, symbols, k);
+
+	// Canonical codes, each length counting on from the last
+	unsigned int code = 0;
+	k = 0;
+	for( int j = 1; j <= 16; j++ ) {
+		huff.delta[j] = k - (int)code;
+		int first = k;
+		while( huff.sizes[k] == j )
+			huff.codes[k++] = (unsigned short)code++;
+		if( k > first && code - 1 >= (1u << j) )
+			throw IOException("Error: bad JPEG Huffman table");
+		huff.maxcode[j] = code << (16 - j);
+		code <<= 1;
+	}
+	huff.maxcode[17] = 0xFFFFFFFF;
+
+	memset(huff.fast, 255, sizeof(huff.fast));
+	for( int i = 0; i < k; i++ ) {
+		int s = huff.sizes[i];
+		if( s <= FAST_BITS ) {
+			int c = huff.codes[i] << (FAST_BITS - s);
+			int m = 1 << (FAST_BITS - s);
+			for( int j = 0; j < m; j++ )
+				huff.fast[c + j] = (GLubyte)i;
+		}
+	}
+
+	memset(huff.fastAC, 0, sizeof(huff.fastAC));
+	for( int i = 0; i < (1 << FAST_BITS); i++ ) {
+		int index = huff.fast[i];
+		if( index == 255 )
+			continue;
+		int rs = huff.values[index];
+		int run = rs >> 4;
+		int magnitude = rs & 15;
+		int length = huff.sizes[index];
+		if( magnitude == 0 || length + magnitude > FAST_BITS )
+			continue;
+		int v = (i << length) & ((1 << FAST_BITS) - 1);
+		v >>= FAST_BITS - magnitude;
+		if( v < (1 << (magnitude - 1)) )
+			v += 1 - (1 << magnitude);
+		if( v >= -128 && v <= 127 )
+			huff.fastAC[i] = (short)((v << 8) | (run << 4) | (length + magnitude));
+	}
+	huff.defined = true;
+}
+
+// Entropy coded bits of one restart interval, end is the marker that closes
+// it and reads past the end return zero bits
+class BitReader {
+	const GLubyte * p;
+	const GLubyte * end;
+	unsigned int bits;
+	int count;
+
+	void fill() {
+		while( count <= 24 ) {
+			unsigned int byte = 0;
+			if( p < end ) {
+				byte = *p++;
+				if( byte == 0xFF ) {
+					// A stuffed zero, anything else is a marker
+					if( p < end && *p == 0 )
+						p++;
+					else {
+						p = end;
+						byte = 0;
+					}
+				}
+			}
+			bits |= byte << (24 - count);
+			count += 8;
+		}
+	}
+
+public:
+	BitReader( const GLubyte * start, const GLubyte * end ) : p(start), end(end), bits(0), count(0) { }
+
+	// The next FAST_BITS bits, topped up first
+	int peekFast() {
+		fill();
+		return (int)(bits >> (32 - FAST_BITS));
+	}
+
+	void skip( int s ) {
+		bits <<= s;
+		count -= s;
+	}
+
+	int decode( const Huffman & huff ) {
+		fill();
+		int k = huff.fast[bits >> (32 - FAST_BITS)];
+		if( k < 255 ) {
+			int s = huff.sizes[k];
+			bits <<= s;
+			count -= s;
+			return huff.values[k];
+		}
+		unsigned int top = bits >> 16;
+		int s = FAST_BITS + 1;
+		while( top >= huff.maxcode[s] )
+			s++;
+		if( s > 16 ) {
+			// Not a code at all, skip a byte and carry on
+			bits <<= 8;
+			count -= 8;
+			return 0;
+		}
+		int index = (int)(bits >> (32 - s)) + huff.delta[s];
+		bits <<= s;
+		count -= s;
+		return index >= 0 && index < 256 ? huff.values[index] : 0;
+	}
+
+	// s bits, 1 to 16, sign extended the way JPEG codes magnitudes
+	int receiveExtend( int s ) {
+		fill();
+		int v = (int)(bits >> (32 - s));
+		bits <<= s;
+		count -= s;
+		return v < (1 << (s - 1)) ? v - (1 << s) + 1 : v;
+	}
+};
+
+void decodeBlock( BitReader & reader, const Huffman & dc, const Huffman & ac, int & pred, short * coef ) {
+	memset(coef, 0, 64 * sizeof(short));
+	int t = reader.decode(dc);
+	if( t > 0 && t <= 16 )
+		pred += reader.receiveExtend(t);
+	coef[0] = (short)pred;
+	for( int k = 1; k < 64; ) {
+		int fast = ac.fastAC[reader.peekFast()];
+		if( fast ) {
+			k += (fast >> 4) & 15;
+			reader.skip(fast & 15);
+			coef[ZIGZAG[k++]] = (short)(fast >> 8);
+			continue;
+		}
+		int rs = reader.decode(ac);
+		int r = rs >> 4;
+		int s = rs & 15;
+		if( s == 0 ) {
+			if( r != 15 )
+				break;
+			k += 16;
+			continue;
+		}
+		k += r;
+		coef[ZIGZAG[k]] = (short)reader.receiveExtend(s);
+		k++;
+	}
+}
+
+// One scan's worth of what decodeInterval needs
+struct Scan {
+	int count;
+	int components[4];
+	// MCUs in the scan and per row of it
+	int mcus;
+	int mcusPerRow;
+};
+
+void decodeInterval( Frame & frame, const Scan & scan, const GLubyte * start, const GLubyte * end,
+                     int first, int count ) {
+	BitReader reader(start, end);
+	int pred[4] = { 0, 0, 0, 0 };
+	for( int m = first; m < first + count; m++ ) {
+		int mx = m % scan.mcusPerRow;
+		int my = m / scan.mcusPerRow;
+		for( int s = 0; s < scan.count; s++ ) {
+			Component & c = frame.components[scan.components[s]];
+			const Huffman & dc = frame.dc[c.td];
+			const Huffman & ac = frame.ac[c.ta];
+			if( scan.count == 1 ) {
+				// Non interleaved, one block per MCU
+				decodeBlock(reader, dc, ac, pred[s], &c.coefs[((size_t)my * c.blocksW + mx) * 64]);
+				continue;
+			}
+			for( int by = 0; by < c.v; by++ ) {
+				for( int bx = 0; bx < c.h; bx++ ) {
+					size_t block = (size_t)(my * c.v + by) * c.blocksW + mx * c.h + bx;
+					decodeBlock(reader, dc, ac, pred[s], &c.coefs[block * 64]);
+				}
+			}
+		}
+	}
+}
+
+// The AAN butterfly of the float IDCT in libjpeg over 8 values step apart,
+// on floats for the scalar path and four columns at once with SSE
+inline float add( float a, float b ) { return a + b; }
+inline float sub( float a, float b ) { return a - b; }
+inline float mul( float a, float k ) { return a * k; }
+#ifdef TG_SSE2
+inline __m128 add( __m128 a, __m128 b ) { return _mm_add_ps(a, b); }
+inline __m128 sub( __m128 a, __m128 b ) { return _mm_sub_ps(a, b); }
+inline __m128 mul( __m128 a, float k ) { return _mm_mul_ps(a, _mm_set1_ps(k)); }
+#endif
+
+template<typename T>
+void idct8( T * v, int step ) {
+	// Even part
+	T tmp10 = add(v[0], v[4 * step]);
+	T tmp11 = sub(v[0], v[4 * step]);
+	T tmp13 = add(v[2 * step], v[6 * step]);
+	T tmp12 = sub(mul(sub(v[2 * step], v[6 * step]), 1.414213562f), tmp13);
+	T tmp0 = add(tmp10, tmp13);
+	T tmp3 = sub(tmp10, tmp13);
+	T tmp1 = add(tmp11, tmp12);
+	T tmp2 = sub(tmp11, tmp12);
+
+	// Odd part
+	T z13 = add(v[5 * step], v[3 * step]);
+	T z10 = sub(v[5 * step], v[3 * step]);
+	T z11 = add(v[step], v[7 * step]);
+	T z12 = sub(v[step], v[7 * step]);
+	T tmp7 = add(z11, z13);
+	tmp11 = mul(sub(z11, z13), 1.414213562f);
+	T z5 = mul(add(z10, z12), 1.847759065f);
+	tmp10 = sub(z5, mul(z12, 1.082392200f));
+	tmp12 = sub(z5, mul(z10, 2.613125930f));
+	T tmp6 = sub(tmp12, tmp7);
+	T tmp5 = sub(tmp11, tmp6);
+	T tmp4 = sub(tmp10, tmp5);
+
+	v[0] = add(tmp0, tmp7);
+	v[7 * step] = sub(tmp0, tmp7);
+	v[step] = add(tmp1, tmp6);
+	v[6 * step] = sub(tmp1, tmp6);
+	v[2 * step] = add(tmp2, tmp5);
+	v[5 * step] = sub(tmp2, tmp5);
+	v[3 * step] = add(tmp3, tmp4);
+	v[4 * step] = sub(tmp3, tmp4);
+}
+
+// Dequantizes and inverse transforms one block into 8 rows of out
+void idctBlock( const short * coef, const float * quant, GLubyte * out, int stride ) {
+#ifdef TG_SSE2
+	// m[r * 2 + half] holds columns half * 4 to half * 4 + 3 of row r
+	__m128 m[16];
+	for( int r = 0; r < 8; r++ ) {
+		__m128i c = _mm_loadu_si128((const __m128i *)(coef + r * 8));
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(c, c), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(c, c), 16);
+		m[r * 2] = _mm_mul_ps(_mm_cvtepi32_ps(lo), _mm_loadu_ps(quant + r * 8));
+		m[r * 2 + 1] = _mm_mul_ps(_mm_cvtepi32_ps(hi), _mm_loadu_ps(quant + r * 8 + 4));
+	}
+	// Columns, then transposed so the rows are done the same way
+	idct8(m, 2);
+	idct8(m + 1, 2);
+	for( int pass = 0; pass < 2; pass++ ) {
+		__m128 t[16];
+		for( int br = 0; br < 2; br++ ) {
+			for( int bc = 0; bc < 2; bc++ ) {
+				__m128 a = m[(br * 4) * 2 + bc];
+				__m128 b = m[(br * 4 + 1) * 2 + bc];
+				__m128 c = m[(br * 4 + 2) * 2 + bc];
+				__m128 d = m[(br * 4 + 3) * 2 + bc];
+				_MM_TRANSPOSE4_PS(a, b, c, d);
+				t[(bc * 4) * 2 + br] = a;
+				t[(bc * 4 + 1) * 2 + br] = b;
+				t[(bc * 4 + 2) * 2 + br] = c;
+				t[(bc * 4 + 3) * 2 + br] = d;
+			}
+		}
+		memcpy(m, t, sizeof(t));
+		if( pass == 0 ) {
+			idct8(m, 2);
+			idct8(m + 1, 2);
+		}
+	}
+	const __m128 bias = _mm_set1_ps(128.f);
+	for( int r = 0; r < 8; r++ ) {
+		__m128i lo = _mm_cvtps_epi32(_mm_add_ps(m[r * 2], bias));
+		__m128i hi = _mm_cvtps_epi32(_mm_add_ps(m[r * 2 + 1], bias));
+		__m128i words = _mm_packs_epi32(lo, hi);
+		_mm_storel_epi64((__m128i *)(out + r * stride), _mm_packus_epi16(words, words));
+	}
+#else
+	float m[64];
+	for( int i = 0; i < 64; i++ )
+		m[i] = coef[i] * quant[i];
+	for( int c = 0; c < 8; c++ )
+		idct8(m + c, 8);
+	for( int r = 0; r < 8; r++ )
+		idct8(m + r * 8, 1);
+	for( int r = 0; r < 8; r++ ) {
+		for( int c = 0; c < 8; c++ ) {
+			float v = floorf(m[r * 8 + c] + 128.5f);
+			out[r * stride + c] = (GLubyte)(v < 0.f ? 0.f : (v > 255.f ? 255.f : v));
+		}
+	}
+#endif
+}
+
+// Converts count pixels of full resolution Y, Cb and Cr to RGBA
+void yccToRGBA( const GLubyte * y, const GLubyte * cb, const GLubyte * cr, GLubyte * out, int count ) {
+	int i = 0;
+#ifdef TG_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alpha = _mm_set1_epi8((char)0xFF);
+	const __m128 half = _mm_set1_ps(128.f);
+	for( ; i + 8 <= count; i += 8 ) {
+		__m128i y16 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(y + i)), zero);
+		__m128i cb16 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(cb + i)), zero);
+		__m128i cr16 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(cr + i)), zero);
+		__m128i channel[3][2];
+		for( int h = 0; h < 2; h++ ) {
+			__m128 yf = _mm_cvtepi32_ps(h ? _mm_unpackhi_epi16(y16, zero) : _mm_unpacklo_epi16(y16, zero));
+			__m128 cbf = _mm_sub_ps(_mm_cvtepi32_ps(h ? _mm_unpackhi_epi16(cb16, zero) : _mm_unpacklo_epi16(cb16, zero)), half);
+			__m128 crf = _mm_sub_ps(_mm_cvtepi32_ps(h ? _mm_unpackhi_epi16(cr16, zero) : _mm_unpacklo_epi16(cr16, zero)), half);
+			__m128 r = _mm_add_ps(yf, _mm_mul_ps(crf, _mm_set1_ps(1.402f)));
+			__m128 g = _mm_sub_ps(yf, _mm_add_ps(_mm_mul_ps(cbf, _mm_set1_ps(0.344136f)), _mm_mul_ps(crf, _mm_set1_ps(0.714136f))));
+			__m128 b = _mm_add_ps(yf, _mm_mul_ps(cbf, _mm_set1_ps(1.772f)));
+			channel[0][h] = _mm_cvtps_epi32(r);
+			channel[1][h] = _mm_cvtps_epi32(g);
+			channel[2][h] = _mm_cvtps_epi32(b);
+		}
+		__m128i r8 = _mm_packus_epi16(_mm_packs_epi32(channel[0][0], channel[0][1]), zero);
+		__m128i g8 = _mm_packus_epi16(_mm_packs_epi32(channel[1][0], channel[1][1]), zero);
+		__m128i b8 = _mm_packus_epi16(_mm_packs_epi32(channel[2][0], channel[2][1]), zero);
+		__m128i rg = _mm_unpacklo_epi8(r8, g8);
+		__m128i ba = _mm_unpacklo_epi8(b8, alpha);
+		_mm_storeu_si128((__m128i *)(out + i*4), _mm_unpacklo_epi16(rg, ba));
+		_mm_storeu_si128((__m128i *)(out + i*4 + 16), _mm_unpackhi_epi16(rg, ba));
+	}
+#endif
+	for( ; i < count; i++ ) {
+		float yf = y[i];
+		float cbf = cb[i] - 128.f;
+		float crf = cr[i] - 128.f;
+		float rgb[3] = { yf + 1.402f * crf, yf - 0.344136f * cbf - 0.714136f * crf, yf + 1.772f * cbf };
+		for( int k = 0; k < 3; k++ ) {
+			float v = floorf(rgb[k] + 0.5f);
+			out[i*4 + k] = (GLubyte)(v < 0.f ? 0.f : (v > 255.f ? 255.f : v));
+		}
+		out[i*4 + 3] = 0xFF;
+	}
+}
+
+// Where each output column samples a subsampled component, two source
+// columns and the weight of the second in 256ths, centered like libjpeg's
+// fancy upsampling
+struct Taps {
+	std::vector<int> first;
+	std::vector<int> second;
+	std::vector<int> weight;
+};
+
+void makeTaps( int outSize, int inSize, int factor, int maxFactor, Taps & taps ) {
+	taps.first.resize(outSize);
+	taps.second.resize(outSize);
+	taps.weight.resize(outSize);
+	for( int i = 0; i < outSize; i++ ) {
+		float at = (i + 0.5f) * factor / maxFactor - 0.5f;
+		int a = (int)floorf(at);
+		int w = (int)((at - a) * 256.f + 0.5f);
+		taps.first[i] = a < 0 ? 0 : (a >= inSize ? inSize - 1 : a);
+		taps.second[i] = a + 1 < 0 ? 0 : (a + 1 >= inSize ? inSize - 1 : a + 1);
+		taps.weight[i] = w;
+	}
+}
+
+// Row y of a component brought up to full resolution
+void upsampleRow( const Component & c, const Taps & xTaps, const Taps & yTaps, int y, int width, GLubyte * out ) {
+	int stride = c.blocksW * 8;
+	const GLubyte * row0 = &c.plane[(size_t)yTaps.first[y] * stride];
+	const GLubyte * row1 = &c.plane[(size_t)yTaps.second[y] * stride];
+	int wy = yTaps.weight[y];
+	for( int x = 0; x < width; x++ ) {
+		int x0 = xTaps.first[x];
+		int x1 = xTaps.second[x];
+		int wx = xTaps.weight[x];
+		int top = row0[x0] * (256 - wx) + row0[x1] * wx;
+		int bottom = row1[x0] * (256 - wx) + row1[x1] * wx;
+		out[x] = (GLubyte)((top * (256 - wy) + bottom * wy + 32768) >> 16);
+	}
+}
+
+void corrupt( const char * fName ) {
+	throw IOException(std::string("Error: ") + fName + " is truncated or not a JPEG file");
+}
+
+int readShort( const GLubyte * p ) {
+	return (p[0] << 8) | p[1];
+}
+
+} // namespace
+
+bool isJPEG( const char * fName ) {
+	FILE * fp = fopen(fName, "rb");
+	if( !fp )
+		return false;
+	unsigned char magic[3] = { 0, 0, 0 };
+	size_t got = fread(magic, 1, 3, fp);
+	fclose(fp);
+	return got == 3 && magic[0] == 0xFF && magic[1] == 0xD8 && magic[2] == 0xFF;
+}
+
+GLubyte * read( const char * fName, int & width, int & height, ThreadPool & pool ) throw(IOException) {
+	MappedFile file;
+	if( !file.open(fName) )
+		throw IOException(std::string("Error: can't open ") + fName);
+	const GLubyte * p = file.bytes();
+	const GLubyte * end = p + file.size();
+	if( file.size() < 4 || p[0] != 0xFF || p[1] != 0xD8 )
+		corrupt(fName);
+	p += 2;
+
+	Frame frame;
+	memset(frame.quantDefined, 0, sizeof(frame.quantDefined));
+	for( int t = 0; t < 4; t++ ) {
+		frame.dc[t].defined = false;
+		frame.ac[t].defined = false;
+	}
+	frame.restartInterval = 0;
+	frame.adobeTransform = -1;
+	frame.width = 0;
+	bool done = false;
+
+	while( !done ) {
+		// Markers may be padded with any number of 0xFF
+		while( p < end && *p != 0xFF )
+			p++;
+		while( p < end && *p == 0xFF )
+			p++;
+		if( p >= end )
+			corrupt(fName);
+		int marker = *p++;
+		if( marker == 0xD9 )
+			break;
+		if( marker == 0xD8 || marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7) )
+			continue;
+		if( end - p < 2 )
+			corrupt(fName);
+		int length = readShort(p);
+		if( length < 2 || end - p < length )
+			corrupt(fName);
+		const GLubyte * segment = p + 2;
+		const GLubyte * segmentEnd = p + length;
+		p = segmentEnd;
+
+		switch( marker ) {
+		case 0xC0:
+		case 0xC1: {
+			if( segmentEnd - segment < 6 || frame.width != 0 )
+				corrupt(fName);
+			if( segment[0] != 8 )
+				throw IOException(std::string("Error: ") + fName + " has 12 bit samples, which aren't supported");
+			frame.height = readShort(segment + 1);
+			frame.width = readShort(segment + 3);
+			int count = segment[5];
+			if( frame.width == 0 || frame.height == 0 )
+				throw IOException(std::string("Error: ") + fName + " leaves its height to a DNL marker, which isn't supported");
+			if( (count != 1 && count != 3) || segmentEnd - segment < 6 + count * 3 )
+				throw IOException(std::string("Error: ") + fName + " isn't grayscale or three component color");
+			frame.hmax = frame.vmax = 1;
+			for( int i = 0; i < count; i++ ) {
+				Component c;
+				const GLubyte * s = segment + 6 + i * 3;
+				c.id = s[0];
+				c.h = s[1] >> 4;
+				c.v = s[1] & 15;
+				c.tq = s[2] & 3;
+				c.td = c.ta = 0;
+				if( c.h < 1 || c.h > 4 || c.v < 1 || c.v > 4 )
+					corrupt(fName);
+				frame.hmax = c.h > frame.hmax ? c.h : frame.hmax;
+				frame.vmax = c.v > frame.vmax ? c.v : frame.vmax;
+				frame.components.push_back(c);
+			}
+			frame.mcusX = (frame.width + 8 * frame.hmax - 1) / (8 * frame.hmax);
+			frame.mcusY = (frame.height + 8 * frame.vmax - 1) / (8 * frame.vmax);
+			for( size_t i = 0; i < frame.components.size(); i++ ) {
+				Component & c = frame.components[i];
+				c.width = (frame.width * c.h + frame.hmax - 1) / frame.hmax;
+				c.height = (frame.height * c.v + frame.vmax - 1) / frame.vmax;
+				c.blocksW = frame.mcusX * c.h;
+				c.blocksH = frame.mcusY * c.v;
+				c.coefs.assign((size_t)c.blocksW * c.blocksH * 64, 0);
+			}
+			break;
+		}
+		case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+		case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+			throw IOException(std::string("Error: ") + fName + " is progressive, lossless or arithmetic coded, only baseline JPEG is supported");
+		case 0xC4:
+			while( segment < segmentEnd ) {
+				if( segmentEnd - segment < 17 )
+					corrupt(fName);
+				int tc = segment[0] >> 4;
+				int th = segment[0] & 3;
+				int total = 0;
+				for( int i = 0; i < 16; i++ )
+					total += segment[1 + i];
+				if( total > 256 || segmentEnd - segment < 17 + total )
+					corrupt(fName);
+				buildHuffman(tc == 0 ? frame.dc[th] : frame.ac[th], segment + 1, segment + 17);
+				segment += 17 + total;
+			}
+			break;
+		case 0xDB:
+			while( segment < segmentEnd ) {
+				int pq = segment[0] >> 4;
+				int tq = segment[0] & 3;
+				if( segmentEnd - segment < 1 + 64 * (pq + 1) )
+					corrupt(fName);
+				for( int i = 0; i < 64; i++ )
+					frame.quant[tq][ZIGZAG[i]] = (unsigned short)(pq ? readShort(segment + 1 + i * 2) : segment[1 + i]);
+				frame.quantDefined[tq] = true;
+				segment += 1 + 64 * (pq + 1);
+			}
+			break;
+		case 0xDD:
+			if( segmentEnd - segment < 2 )
+				corrupt(fName);
+			frame.restartInterval = readShort(segment);
+			break;
+		case 0xEE:
+			// Adobe, its transform flag says whether three components are YCbCr
+			if( segmentEnd - segment >= 12 && memcmp(segment, "Adobe", 5) == 0 )
+				frame.adobeTransform = segment[11];
+			break;
+		case 0xDA: {
+			if( frame.width == 0 || segmentEnd - segment < 1 )
+				corrupt(fName);
+			Scan scan;
+			scan.count = segment[0];
+			if( scan.count < 1 || scan.count > (int)frame.components.size() || segmentEnd - segment < 4 + scan.count * 2 )
+				corrupt(fName);
+			for( int s = 0; s < scan.count; s++ ) {
+				int id = segment[1 + s * 2];
+				int tables = segment[2 + s * 2];
+				scan.components[s] = -1;
+				for( size_t i = 0; i < frame.components.size(); i++ ) {
+					if( frame.components[i].id == id )
+						scan.components[s] = (int)i;
+				}
+				if( scan.components[s] < 0 )
+					corrupt(fName);
+				Component & c = frame.components[scan.components[s]];
+				c.td = (tables >> 4) & 3;
+				c.ta = tables & 3;
+				if( !frame.dc[c.td].defined || !frame.ac[c.ta].defined || !frame.quantDefined[c.tq] )
+					corrupt(fName);
+
+				// The AAN scale factors and the final divide by 8 go into the table
+				for( int r = 0; r < 8; r++ ) {
+					for( int col = 0; col < 8; col++ ) {
+						double sr = r == 0 ? 1.0 : cos(r * 3.14159265358979 / 16.0) * sqrt(2.0);
+						double sc = col == 0 ? 1.0 : cos(col * 3.14159265358979 / 16.0) * sqrt(2.0);
+						c.quant[r * 8 + col] = (float)(frame.quant[c.tq][r * 8 + col] * sr * sc / 8.0);
+					}
+				}
+			}
+			if( scan.count == 1 ) {
+				const Component & c = frame.components[scan.components[0]];
+				scan.mcusPerRow = (c.width + 7) / 8;
+				scan.mcus = scan.mcusPerRow * ((c.height + 7) / 8);
+			}
+			else {
+				scan.mcusPerRow = frame.mcusX;
+				scan.mcus = frame.mcusX * frame.mcusY;
+			}
+
+			// The entropy coded data runs to the first marker that isn't a
+			// restart, which split it into independent intervals
+			std::vector<const GLubyte *> starts(1, segmentEnd);
+			std::vector<const GLubyte *> ends;
+			const GLubyte * q = segmentEnd;
+			while( true ) {
+				while( q < end && *q != 0xFF )
+					q++;
+				if( end - q < 2 )
+					corrupt(fName);
+				int next = q[1];
+				if( next == 0x00 || next == 0xFF ) {
+					q += next == 0x00 ? 2 : 1;
+					continue;
+				}
+				ends.push_back(q);
+				if( next < 0xD0 || next > 0xD7 )
+					break;
+				q += 2;
+				starts.push_back(q);
+			}
+			p = q;
+
+			// Without restarts the whole scan is one interval
+			int intervals = (int)starts.size();
+			int perInterval = frame.restartInterval > 0 ? frame.restartInterval : scan.mcus;
+			if( intervals != (scan.mcus + perInterval - 1) / perInterval )
+				corrupt(fName);
+			pool.parallelFor(0, intervals, [&](int i) {
+				int first = i * perInterval;
+				int count = first + perInterval > scan.mcus ? scan.mcus - first : perInterval;
+				decodeInterval(frame, scan, starts[i], ends[i], first, count);
+			}, 1);
+			break;
+		}
+		default:
+			break;
+		}
+	}
+	if( frame.width == 0 )
+		corrupt(fName);
+
+	// Dequantize and transform every block, a row of blocks per task
+	for( size_t i = 0; i < frame.components.size(); i++ ) {
+		Component & c = frame.components[i];
+		c.plane.resize((size_t)c.blocksW * c.blocksH * 64);
+		int stride = c.blocksW * 8;
+		pool.parallelFor(0, c.blocksH, [&](int by) {
+			for( int bx = 0; bx < c.blocksW; bx++ ) {
+				size_t block = (size_t)by * c.blocksW + bx;
+				idctBlock(&c.coefs[block * 64], c.quant, &c.plane[(size_t)by * 8 * stride + bx * 8], stride);
+			}
+		}, 4);
+		std::vector<short>().swap(c.coefs);
+	}
+
+	// Upsample and convert, a row of pixels at a time, written bottom up
+	width = frame.width;
+	height = frame.height;
+	GLubyte * pixels = new GLubyte[(size_t)width * height * 4];
+	int count = (int)frame.components.size();
+	std::vector<Taps> xTaps(count), yTaps(count);
+	for( int i = 0; i < count; i++ ) {
+		const Component & c = frame.components[i];
+		makeTaps(width, c.width, c.h, frame.hmax, xTaps[i]);
+		makeTaps(height, c.height, c.v, frame.vmax, yTaps[i]);
+	}
+	bool rgb = count == 3 && frame.adobeTransform == 0;
+	pool.parallelFor(0, height, [&](int y) {
+		std::vector<GLubyte> rows((size_t)width * 3);
+		const GLubyte * channel[3];
+		for( int i = 0; i < count; i++ ) {
+			const Component & c = frame.components[i];
+			if( c.h == frame.hmax && c.v == frame.vmax )
+				channel[i] = &c.plane[(size_t)y * c.blocksW * 8];
+			else {
+				upsampleRow(c, xTaps[i], yTaps[i], y, width, &rows[(size_t)i * width]);
+				channel[i] = &rows[(size_t)i * width];
+			}
+		}
+		GLubyte * out = pixels + (size_t)(height - 1 - y) * width * 4;
+		if( count == 1 || rgb ) {
+			for( int x = 0; x < width; x++ ) {
+				out[x*4    ] = channel[0][x];
+				out[x*4 + 1] = channel[count == 1 ? 0 : 1][x];
+				out[x*4 + 2] = channel[count == 1 ? 0 : 2][x];
+				out[x*4 + 3] = 0xFF;
+			}
+		}
+		else
+			yccToRGBA(channel[0], channel[1], channel[2], out, width);
+	}, 16);
+
+	printf("%s: (%d x %d) %d component JPEG, %d restart intervals\n", fName, width, height, count,
+	       frame.restartInterval > 0 ? (frame.mcusX * frame.mcusY + frame.restartInterval - 1) / frame.restartInterval : 0);
+	return pixels;
+}
+
+bool benchmark( const char * jpgName, const char * tgaName, int runs ) {
+	try {
+		int w, h, tw, th;
+		double jpgMs = 0.0, tgaMs = 0.0;
+		GLubyte * jpg = 0;
+		GLubyte * tga = 0;
+		for( int run = 0; run < runs; run++ ) {
+			delete [] jpg;
+			delete [] tga;
+			Timer timer;
+			jpg = read(jpgName, w, h);
+			jpgMs += timer.elapsedMs();
+			timer.reset();
+			tga = TGAIO::read(tgaName, tw, th);
+			tgaMs += timer.elapsedMs();
+		}
+
+		// Color channels only, the TGA's alpha isn't in the JPEG
+		double psnr = 0.0;
+		if( jpg && tga && w == tw && h == th ) {
+			double error = 0.0;
+			for( size_t i = 0; i < (size_t)w * h; i++ ) {
+				for( int k = 0; k < 3; k++ ) {
+					double d = (double)jpg[i*4 + k] - tga[i*4 + k];
+					error += d * d;
+				}
+			}
+			error /= (double)w * h * 3;
+			psnr = error > 0.0 ? 10.0 * log10(255.0 * 255.0 / error) : 99.0;
+		}
+		delete [] jpg;
+		delete [] tga;
+
+		FILE * fp = fopen(jpgName, "rb");
+		long jpgSize = 0, tgaSize = 0;
+		if( fp ) {
+			fseek(fp, 0, SEEK_END);
+			jpgSize = ftell(fp);
+			fclose(fp);
+		}
+		fp = fopen(tgaName, "rb");
+		if( fp ) {
+			fseek(fp, 0, SEEK_END);
+			tgaSize = ftell(fp);
+			fclose(fp);
+		}
+		runs = runs > 0 ? runs : 1;
+		printf("JPEGIO: %s %.2f ms (%.0f Mpixel/s) on %d threads vs %s %.2f ms, %.1f KB vs %.1f KB on disk, ",
+		       jpgName, jpgMs / runs, (double)w * h * runs / (jpgMs * 1000.0 + 1e-9), ThreadPool::shared().size(),
+		       tgaName, tgaMs / runs, jpgSize / 1024.0, tgaSize / 1024.0);
+		if( psnr > 0.0 )
+			printf("PSNR %.1f dB\n", psnr);
+		else
+			printf("different sizes, no PSNR\n");
+		return true;
+	}
+	catch( TGAIO::IOException & e ) {
+		printf("JPEGIO: benchmark of %s failed: %s\n", jpgName, e.what());
+		return false;
+	}
+}
+
+}
\ No newline at end of file
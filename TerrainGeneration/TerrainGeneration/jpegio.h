@@ -0,0 +1,39 @@
+#ifndef _JPEGIO_H
+#define _JPEGIO_H
+
+#include "GLIncludes.h"
+#include "ThreadPool.h"
+#include "tgaio.h"
+
+namespace JPEGIO {
+
+    /**
+     * True if the file starts with a JPEG start of image marker.
+     */
+    bool isJPEG( const char * fName );
+
+    /**
+     * Decodes a baseline (sequential Huffman, 8 bit) JPEG file with one
+     * (grayscale) or three (YCbCr, or RGB when an Adobe marker says so)
+     * components and any sampling factors into a new RGBA buffer, rows
+     * bottom to top like read() in TGAIO returns them.
+     * Restart intervals are entropy decoded in parallel, and the IDCT and
+     * color conversion run a row of blocks or pixels per task, with SSE
+     * where available.  Progressive, arithmetic coded and 12 bit files are
+     * refused.
+     * @return the pixels, to be freed with delete []
+     */
+    GLubyte * read( const char * fName, /*out*/ int & width, /*out*/ int & height,
+                    ThreadPool & pool = ThreadPool::shared() ) throw(TGAIO::IOException);
+
+    /**
+     * Times read() on jpgName against TGAIO::read on tgaName, which is
+     * expected to hold the same picture, and reports the sizes of both
+     * files and the PSNR of the decoded JPEG against the TGA.
+     * @param runs the number of times each is read
+     * @return false if either file can't be read
+     */
+    bool benchmark( const char * jpgName, const char * tgaName, int runs );
+}
+
+#endif
\ No newline at end of file
@@ -9,8 +9,29 @@
 #include <fstream>
 #include <assert.h>
 #include <iostream>
+#include <thread>
+#include <atomic>
+#include <random>
 
 #include "HeightField.h"
+#include "VoxelTerrain.h"
+#include "PlanetTerrain.h"
+#include "ContourLines.h"
+#include "Navigation.h"
+#include "Ocean.h"
+#include "Physics.h"
+#include "Viewshed.h"
+#include "PyramidBuilder.h"
+#include "MeshExporter.h"
+#include "HorizonCuller.h"
+#include "ScreenCapture.h"
+#include "FrameRecorder.h"
+#include "tgaio.h"
+#include "jpegio.h"
+#include "Resampler.h"
+#include "TextureManager.h"
+#include "TextureAtlas.h"
+#include "ThreadPool.h"
 
 #include <glm\glm.hpp>
 #include <glm\gtc\matrix_transform.hpp>
@@ -21,6 +42,10 @@ float xpos= 850, ypos= 350, zpos= 250, xrot= 0, yrot= 0, angle= 0.0;
 float lastx, lasty;
 
 vec3 position=vec3(0.f, 0.f, 0.f);
+//position is relative to this, it is moved along once the camera gets far
+//enough from it that floats start to lose precision
+glm::dvec3 worldOrigin;
+const float REBASE_DISTANCE= 2048.f;
 float horizontalAngle = 3.14f;
 float verticalAngle = 0.f;
 
@@ -29,8 +54,47 @@ float cScale= 1.0;
 float deltaTime = 1.0f;
 int SCREEN_WIDTH = 640;
 int SCREEN_HEIGHT = 480;
+//set by -benchmark on the command line, the timings run after Init
+bool runBenchmarks= false;
+float aspectRatio = (float)SCREEN_WIDTH / SCREEN_HEIGHT;
 
 HeightField hField;
+//everything but the height field is built the first time it is switched
+//on, so none of it holds up the first frame
+VoxelTerrain voxels;
+bool voxelsCreated= false;
+bool voxelMode= false;
+bool voxelKeyDown= false;
+PlanetTerrain planet;
+bool planetCreated= false;
+bool planetMode= false;
+bool planetKeyDown= false;
+glm::dvec3 planetPosition;
+ContourLines contours;
+bool contoursCreated= false;
+bool showContours= false;
+bool contourKeyDown= false;
+Ocean ocean;
+bool oceanCreated= false;
+bool showOcean= true;
+bool oceanKeyDown= false;
+Viewshed viewshed;
+bool viewshedCreated= false;
+bool showViewshed= false;
+bool viewshedKeyDown= false;
+bool exportKeyDown= false;
+//the export runs off the render thread, the main loop joins it once done
+MeshExporter exporter;
+std::thread exportThread;
+std::atomic<bool> exportDone(false);
+ScreenCapture capture;
+bool capturesCreated= false;
+bool captureKeyDown= false;
+bool captureRequested= false;
+int screenshotCount= 0;
+FrameRecorder recorder;
+bool recordKeyDown= false;
+int recordingCount= 0;
 
 mat4 model;
 mat4 view;
@@ -47,21 +111,74 @@ void setcamera()
 void setMatrices()
 {
 	mat4 mv= view * model;
+	hField.prog.use();
 	hField.prog.setUniform("ModelViewMatrix", mv);
 	hField.prog.setUniform("NormalMatrix", 
 							mat3(vec3(mv[0]), vec3(mv[1]), vec3(mv[2])));
 	hField.prog.setUniform("MVP", projection *mv);
+	hField.prog.setUniform("TileOrigin", vec2(0.f, 0.f));
+	hField.prog.setUniform("ShowVisibility", showViewshed);
+}
+
+//the view only knows the camera relative to worldOrigin
+glm::dvec3 cameraWorldPosition()
+{
+	vec3 t= vec3(view[3]);
+	vec3 eye= -vec3(glm::dot(vec3(view[0]), t), glm::dot(vec3(view[1]), t), glm::dot(vec3(view[2]), t));
+	return worldOrigin + glm::dvec3(eye);
+}
+
+void displayPlanet(void)
+{
+	//clip planes follow the altitude, far only needs to reach the horizon
+	double radius= planet.getRadius();
+	double dist= glm::length(planetPosition);
+	double alt= glm::max(planet.altitude(planetPosition), 1.0);
+	double top= radius + planet.getMaxElevation();
+	double farPlane= sqrt(glm::max(dist * dist - radius * radius, 0.0)) + sqrt(top * top - radius * radius) + alt;
+	mat4 planetProjection= glm::perspective(60.f, aspectRatio, (float)glm::max(alt * 0.5, 0.5), (float)farPlane);
+
+	mat4 viewProjection= planetProjection * view;
+	planet.update(planetPosition, viewProjection);
+	planet.Render(planetPosition, viewProjection);
 }
 
 void display(void)
 {
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	
-	//set identity matrix
-	model= mat4(1.0);
+	if(planetMode)
+	{
+		displayPlanet();
+		return;
+	}
+
+	//set identity matrix, moved by the origin for the meshes in world coordinates
+	model= glm::translate(mat4(1.0), vec3(-worldOrigin));
 	setcamera();
 	setMatrices();
-	hField.Render();
+	if(voxelMode)
+	{
+		hField.prog.use();
+		voxels.Render();
+	}
+	else
+	{
+		//tiles come relative to the camera, so only the view's rotation is left
+		mat4 rotation= view;
+		rotation[3]= glm::vec4(0.f, 0.f, 0.f, 1.f);
+		hField.Render(projection * rotation, cameraWorldPosition());
+	}
+
+	if(showContours)
+		contours.Render(projection * view * model);
+
+	//water goes last so it blends over whatever terrain is under it
+	if(showOcean && oceanCreated)
+	{
+		ocean.update((float)glfwGetTime(), ThreadPool::shared());
+		ocean.Render(projection * view * model, vec3(cameraWorldPosition()));
+	}
 }
 
 void Init(void)
@@ -75,6 +192,199 @@ void Init(void)
 	std::cout<<"Height Map initialized"<<std::endl;
 }
 
+void createVoxels(void)
+{
+	voxels.Create(hField, 4.f, ThreadPool::shared());
+	const VoxelTerrain::MeshStats &voxelStats= voxels.getStats();
+	printf("Voxel terrain initialized, meshed %d chunks (%d triangles) in %.2f ms, %.0f chunks/s on %d threads\n",
+		voxelStats.chunksMeshed, voxelStats.triangles, voxelStats.seconds * 1000.0, voxelStats.chunksPerSecond,
+		voxelStats.threads);
+	voxelsCreated= true;
+}
+
+void createContours(void)
+{
+	std::vector<float> levels;
+	for(float level= 10.f; level < 256.f; level+= 10.f)
+		levels.push_back(level);
+	contours.extract(hField, levels, ThreadPool::shared());
+	contours.upload();
+	contoursCreated= true;
+}
+
+//lookouts on the highest point of every block when the map is cut into
+//blocksX by blocksZ blocks
+std::vector<Viewshed::Observer> findLookouts(const HeightField &field, int blocksX, int blocksZ, float radius)
+{
+	std::vector<Viewshed::Observer> lookouts;
+	for(int i= 0; i < blocksX; ++i)
+	{
+		int x0= i * field.getWidth() / blocksX, x1= (i + 1) * field.getWidth() / blocksX;
+		for(int j= 0; j < blocksZ; ++j)
+		{
+			int z0= j * field.getDepth() / blocksZ, z1= (j + 1) * field.getDepth() / blocksZ;
+			Viewshed::Observer lookout= { x0, z0, 10.f, 0.f, radius };
+			for(int x= x0; x < x1; ++x)
+			{
+				for(int z= z0; z < z1; ++z)
+				{
+					if(field.heightAt(x, z) > field.heightAt(lookout.x, lookout.z))
+					{
+						lookout.x= x;
+						lookout.z= z;
+					}
+				}
+			}
+			lookouts.push_back(lookout);
+		}
+	}
+	return lookouts;
+}
+
+void createViewshed(void)
+{
+	//one lookout per 128x128 block
+	viewshed.compute(hField, findLookouts(hField, hField.getWidth() / 128, hField.getDepth() / 128, 300.f),
+		ThreadPool::shared());
+	viewshed.upload();
+	viewshedCreated= true;
+}
+
+void createOcean(void)
+{
+	ocean.Create(hField, 256, 256.f, 60.f, vec2(12.f, 5.f), 1e-6f);
+	std::cout<<"Ocean initialized"<<std::endl;
+	oceanCreated= true;
+}
+
+void createPlanet(void)
+{
+	planet.Create(hField, 600000.0, 20.0, ThreadPool::shared());
+	planetPosition= glm::dvec3(0.0, 0.0, planet.getRadius() * 3.0);
+	std::cout<<"Planet initialized"<<std::endl;
+	planetCreated= true;
+}
+
+void createCaptures(void)
+{
+	//the ring buffers are sized for the window as it is now
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	capture.Create(3, viewport[2], viewport[3]);
+	recorder.Create(8, viewport[2], viewport[3], 4);
+	capturesCreated= true;
+}
+
+//timings of the subsystems, only run with -benchmark so they stay off the
+//startup path
+void Benchmark(void)
+{
+	//the same map at four times the size, 4096x4096
+	HeightField bigField;
+	bigField.CreateUpsampled(hField, 4);
+
+	Navigation navigation;
+	navigation.Create(hField, 32, 4.f, 1.f, ThreadPool::shared());
+	double small= navigation.benchmark(1000, ThreadPool::shared());
+	{
+		//slopes are spread over four times as many cells on the big map, so
+		//the limits are scaled down to match
+		Navigation bigNavigation;
+		bigNavigation.Create(bigField, 32, 1.f, 4.f, ThreadPool::shared());
+		double big= bigNavigation.benchmark(1000, ThreadPool::shared());
+		printf("Navigation: %.0f queries/s on %dx%d, %.0f on %dx%d, %.2fx\n", small, hField.getWidth(),
+			hField.getDepth(), big, bigField.getWidth(), bigField.getDepth(), small / glm::max(big, 1e-9));
+	}
+
+	{
+		//100 levels evenly through the big map's height range
+		const float *heights= bigField.heightData();
+		size_t count= (size_t)bigField.getWidth() * bigField.getDepth();
+		float lowest= heights[0], highest= heights[0];
+		for(size_t i= 1; i < count; ++i)
+		{
+			lowest= glm::min(lowest, heights[i]);
+			highest= glm::max(highest, heights[i]);
+		}
+		std::vector<float> levels;
+		for(int l= 0; l < 100; ++l)
+			levels.push_back(lowest + (highest - lowest) * (l + 0.5f) / 100.f);
+		ContourLines bigContours;
+		bigContours.extract(bigField, levels, ThreadPool::shared());
+	}
+
+	{
+		//300 lookouts with a radius of 500 on the big map, the mask stays on the cpu
+		Viewshed bigViewshed;
+		bigViewshed.compute(bigField, findLookouts(bigField, 20, 15, 500.f), ThreadPool::shared());
+	}
+
+	{
+		//three seconds of 10k bodies landing on the map, in a world of their
+		//own so none of them are left over
+		Physics benchmarkPhysics;
+		benchmarkPhysics.Create(hField);
+		benchmarkPhysics.benchmark(10000, 180, ThreadPool::shared());
+
+		//the bodies where they landed, seen from a corner of the map looking
+		//across it, hidden behind ridges or not
+		const std::vector<Physics::Body> &bodies= benchmarkPhysics.getBodies();
+		std::vector<HorizonCuller::Box> boxes(bodies.size());
+		for(size_t b= 0; b < bodies.size(); ++b)
+		{
+			vec3 extent(bodies[b].boundingRadius);
+			boxes[b].min= bodies[b].position - extent;
+			boxes[b].max= bodies[b].position + extent;
+		}
+		HorizonCuller culler;
+		culler.Create(hField, 16, 512);
+		vec3 eye(0.f, hField.heightAt(0, 0) + 20.f, 0.f);
+		vec3 centre(hField.getWidth() * 0.5f, 0.f, hField.getDepth() * 0.5f);
+		centre.y= hField.heightAt((int)centre.x, (int)centre.z);
+		std::vector<unsigned char> visible;
+		culler.cull(boxes, projection * glm::lookAt(eye, centre, vec3(0.f, 1.f, 0.f)), eye, visible);
+		const HorizonCuller::Stats &stats= culler.getStats();
+		printf("Culling: %.0f%% of %d bodies culled (%d outside the view, %d behind the terrain) in %.2f ms\n",
+			stats.culledRatio * 100.f, stats.objects, stats.frustumCulled, stats.occluded, stats.cullMs);
+	}
+
+	TGAIO::benchmark("texture.tga", 5);
+	JPEGIO::benchmark("texture.jpg", "texture.tga", 3);
+	//the naive reference alone takes seconds on the 1024x1024 texture
+	Resampler::benchmark("texture.tga", 3, ThreadPool::shared());
+
+	{
+		//400 flat coloured images of 8 to 128 pixels a side on 1024x1024
+		//pages, packed once without mips and once with five levels
+		std::uniform_int_distribution<int> side(8, 128);
+		std::vector<GLubyte> pixels(128 * 128 * 4);
+		int mipLevels[2]= { 1, 5 };
+		for(int run= 0; run < 2; ++run)
+		{
+			std::mt19937 random(45);
+			TextureAtlas atlas;
+			atlas.Create(1024, mipLevels[run]);
+			for(int i= 0; i < 400; ++i)
+			{
+				char name[16];
+				sprintf(name, "image%03d", i);
+				std::fill(pixels.begin(), pixels.end(), (GLubyte)i);
+				int width= side(random);
+				atlas.add(name, &pixels[0], width, side(random));
+			}
+			atlas.build(ThreadPool::shared());
+			atlas.Destroy();
+		}
+	}
+
+	{
+		//a cache and directory of its own, the shared cache is still in use by
+		//the loader threads and its files must not be swapped underneath them
+		TextureCache benchmarkCache("texcache-bench");
+		TextureManager::benchmark("texture.tga", 16, 240, benchmarkCache);
+	}
+}
+
 /*void mouseMove_callback(GLFWwindow* window, double x, double y)
 {
 	xrot += 10.f * deltaTime * float(lastx - x);
@@ -164,14 +474,158 @@ void HandleInput(GLFWwindow* window)
 	if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS){
 		position -= right * deltaTime;
 	}
+	// Move the origin instead once the camera gets too far from it
+	if (glm::length(position) > REBASE_DISTANCE){
+		glm::dvec3 shift= glm::floor(glm::dvec3(position));
+		worldOrigin+= shift;
+		position-= vec3(shift);
+	}
+	// Fly around the planet, faster the higher up we are
+	if (planetMode){
+		double speed= glm::max(planet.altitude(planetPosition), 10.0) * deltaTime;
+		if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)
+			planetPosition += glm::dvec3(direction) * speed;
+		if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)
+			planetPosition -= glm::dvec3(direction) * speed;
+		if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
+			planetPosition += glm::dvec3(right) * speed;
+		if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
+			planetPosition -= glm::dvec3(right) * speed;
+	}
+	// Toggle the planet
+	if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS){
+		if(!planetKeyDown)
+		{
+			if(!planetCreated)
+				createPlanet();
+			planetMode= !planetMode;
+		}
+		planetKeyDown= true;
+	}
+	else{
+		planetKeyDown= false;
+	}
+	// Toggle the contour overlay
+	if (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS){
+		if(!contourKeyDown)
+		{
+			if(!contoursCreated)
+				createContours();
+			showContours= !showContours;
+		}
+		contourKeyDown= true;
+	}
+	else{
+		contourKeyDown= false;
+	}
+	// Toggle the line of sight overlay
+	if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS){
+		if(!viewshedKeyDown)
+		{
+			if(!viewshedCreated)
+				createViewshed();
+			showViewshed= !showViewshed;
+		}
+		viewshedKeyDown= true;
+	}
+	else{
+		viewshedKeyDown= false;
+	}
+	// Export the terrain mesh for offline tools
+	if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS){
+		//ignored while the last export is still running
+		if(!exportKeyDown && !exportThread.joinable())
+		{
+			exportThread= std::thread([]() {
+				exporter.exportMesh(hField, "terrain.obj", MeshExporter::OBJ, 1, ThreadPool::shared());
+				exportDone= true;
+			});
+		}
+		exportKeyDown= true;
+	}
+	else{
+		exportKeyDown= false;
+	}
+	// Take a screenshot once the frame is drawn
+	if (glfwGetKey(window, GLFW_KEY_F12) == GLFW_PRESS){
+		if(!captureKeyDown)
+		{
+			if(!capturesCreated)
+				createCaptures();
+			captureRequested= true;
+		}
+		captureKeyDown= true;
+	}
+	else{
+		captureKeyDown= false;
+	}
+	// Start or stop recording a flythrough, at most a minute of frames
+	if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS){
+		if(!recordKeyDown)
+		{
+			if(!capturesCreated)
+				createCaptures();
+			if(recorder.isRecording())
+				recorder.stop();
+			else
+			{
+				char prefix[32];
+				sprintf(prefix, "flythrough%02d_", recordingCount++);
+				recorder.start(prefix, 3600, FrameRecorder::DROP, 0.0);
+			}
+		}
+		recordKeyDown= true;
+	}
+	else{
+		recordKeyDown= false;
+	}
+	// Toggle the ocean
+	if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS){
+		if(!oceanKeyDown)
+		{
+			showOcean= !showOcean;
+			if(!showOcean && oceanCreated && ocean.getStats().frames > 0)
+			{
+				const Ocean::Stats &stats= ocean.getStats();
+				printf("Ocean: %.2f ms/frame (spectrum %.2f, fft %.2f, upload %.2f) on %d threads\n",
+					stats.totalMs, stats.spectrumMs, stats.fftMs, stats.uploadMs, ThreadPool::shared().size());
+			}
+		}
+		oceanKeyDown= true;
+	}
+	else{
+		oceanKeyDown= false;
+	}
+	// Toggle between the height field and the voxel terrain
+	if (glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS){
+		if(!voxelKeyDown)
+		{
+			if(!voxelsCreated)
+				createVoxels();
+			voxelMode= !voxelMode;
+		}
+		voxelKeyDown= true;
+	}
+	else{
+		voxelKeyDown= false;
+	}
+	// Dig into the voxel terrain in front of the camera
+	if (voxelMode && glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS){
+		voxels.edit(vec3(cameraWorldPosition()) + direction * 20.f, 8.f, -4.f);
+		voxels.update();
+	}
 	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
 	{
 		glfwSetWindowShouldClose(window, GL_TRUE);
 	}
 	
-	view = glm::lookAt(position,
-		position + direction,
-		up);
+	// The planet is drawn relative to the camera, so its view only rotates
+	if (planetMode)
+		view = glm::lookAt(vec3(0.f), direction, up);
+	else
+		view = glm::lookAt(position,
+			position + direction,
+			up);
 }
 
 static void error_callback(int error, const char* description)
@@ -183,12 +637,27 @@ static void error_callback(int error, const char* description)
 void resize(GLFWwindow* window, int w, int h)
 {
 	glViewport(0, 0, (GLsizei)w, (GLsizei)h);
-	projection= glm::perspective(60.f, (float)w/h, 1.0f, 1000.f);
+	aspectRatio= (float)w/h;
+	projection= glm::perspective(60.f, aspectRatio, 1.0f, 1000.f);
 }
 
-int main(void)
+int main(int argc, char **argv)
 {
 	GLFWwindow* window;
+	for(int a= 1; a < argc; ++a)
+	{
+		if(strcmp(argv[a], "-benchmark") == 0)
+			runBenchmarks= true;
+		//-pyramid source width depth sampleBytes builds the tiles for the
+		//streaming paths into pyramid/ and quits, finishing an interrupted build
+		if(strcmp(argv[a], "-pyramid") == 0 && a + 4 < argc)
+		{
+			PyramidBuilder pyramid;
+			bool built= pyramid.build(argv[a + 1], atoi(argv[a + 2]), atoi(argv[a + 3]), atoi(argv[a + 4]), "pyramid", 256,
+				ThreadPool::shared());
+			exit(built ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
 	glfwSetErrorCallback(error_callback);
 	if(!glfwInit())
 	{
@@ -228,19 +697,45 @@ int main(void)
 	glfwSetWindowSizeCallback(window, resize);
 	
 	Init();
-	int currentTime = 0.0f;
-	int previousTime= 0.0f;
+	if(runBenchmarks)
+		Benchmark();
+	double currentTime = 0.0;
+	double previousTime= 0.0;
 	while(!glfwWindowShouldClose(window))
 	{
 		currentTime = glfwGetTime();
-		deltaTime= currentTime-previousTime;
+		deltaTime= (float)(currentTime-previousTime);
 		previousTime = currentTime;
 		HandleInput(window);
 		display();
+		int w, h;
+		glfwGetFramebufferSize(window, &w, &h);
+		if(captureRequested)
+		{
+			char fileName[32];
+			sprintf(fileName, "screenshot%03d.tga", screenshotCount++);
+			capture.request(fileName, w, h);
+			captureRequested= false;
+		}
+		capture.update();
+		recorder.captureFrame(w, h);
+		if(exportDone)
+		{
+			exportThread.join();
+			exportDone= false;
+		}
 		glfwPollEvents();
 		glfwSwapBuffers(window);
+		//the ocean starts out shown, it is built once the first frame is up
+		if(showOcean && !oceanCreated)
+			createOcean();
 	}
 
+	if(exportThread.joinable())
+		exportThread.join();
+	capture.Destroy();
+	recorder.Destroy();
+	hField.Destroy();
 	glfwTerminate();
 	exit(EXIT_SUCCESS);
 }
\ No newline at end of file
@@ -0,0 +1,18 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+//SSE2 is the baseline for every x86 target we build (VS2012+ default to it
+//for Win32), everything else gets the scalar paths
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define TG_SSE2 1
+#include <emmintrin.h>
+#endif
+
+//SSSE3 byte shuffles only where the compiler says it may use them, MSVC has
+//no switch for it short of /arch:AVX
+#if defined(TG_SSE2) && (defined(__SSSE3__) || defined(__AVX__))
+#define TG_SSSE3 1
+#include <tmmintrin.h>
+#endif
+
+#endif // SIMD_H
\ No newline at end of file
@@ -1,11 +1,201 @@
 #include "tgaio.h"
 
+#include "MappedFile.h"
+#include "MipChain.h"
+#include "simd.h"
+#include "Timer.h"
 #include <fstream>
+#include <vector>
+#include <iterator>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
 using std::ifstream;
 using std::ofstream;
 
 namespace TGAIO {
 
+namespace {
+
+// Pixels converted per block read or written, 1 MB of 32 bpp data
+const int BLOCK_PIXELS = 1 << 18;
+
+// Swaps the red and blue bytes of count 4 byte pixels, BGRA <-> RGBA.
+// src and dst may be the same buffer.
+void swapRedBlue( const GLubyte * src, GLubyte * dst, int count ) {
+	int i = 0;
+#ifdef TG_SSE2
+	const __m128i keep = _mm_set1_epi32((int)0xFF00FF00);
+	const __m128i low = _mm_set1_epi32(0x000000FF);
+	for( ; i + 4 <= count; i += 4 ) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i*4));
+		__m128i red = _mm_and_si128(_mm_srli_epi32(v, 16), low);
+		__m128i blue = _mm_slli_epi32(_mm_and_si128(v, low), 16);
+		v = _mm_or_si128(_mm_and_si128(v, keep), _mm_or_si128(red, blue));
+		_mm_storeu_si128((__m128i *)(dst + i*4), v);
+	}
+#endif
+	for( ; i < count; i++ ) {
+		GLubyte blue = src[i*4];
+		dst[i*4    ] = src[i*4 + 2];
+		dst[i*4 + 1] = src[i*4 + 1];
+		dst[i*4 + 2] = blue;
+		dst[i*4 + 3] = src[i*4 + 3];
+	}
+}
+
+// Expands count 3 byte BGR pixels to opaque RGBA.
+void expandBGR( const GLubyte * src, GLubyte * dst, int count ) {
+	int i = 0;
+#ifdef TG_SSSE3
+	// Four pixels per shuffle, the 16 byte load reads ahead by one pixel and
+	// a bit, so the last few pixels are left to the scalar loop
+	const __m128i order = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+	const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+	for( ; i + 6 <= count; i += 4 ) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i*3));
+		v = _mm_or_si128(_mm_shuffle_epi8(v, order), alpha);
+		_mm_storeu_si128((__m128i *)(dst + i*4), v);
+	}
+#endif
+	for( ; i < count; i++ ) {
+		dst[i*4    ] = src[i*3 + 2];
+		dst[i*4 + 1] = src[i*3 + 1];
+		dst[i*4 + 2] = src[i*3    ];
+		dst[i*4 + 3] = 0xFF;
+	}
+}
+
+// A pixel as one 32 bit value, for comparing and filling
+inline GLuint pixelAt( const GLubyte * p, int i ) {
+	GLuint value;
+	memcpy(&value, p + i*4, 4);
+	return value;
+}
+
+// Decodes type 10 packets into count RGBA pixels. Raw packets go through the
+// same swizzles as uncompressed data. Returns false if the data runs out or
+// a packet runs past the end of the image.
+bool decodeRLE( const GLubyte * src, size_t size, int bpp, GLubyte * dst, int count ) {
+	const int bytes = bpp / 8;
+	const GLubyte * end = src + size;
+	int i = 0;
+	while( i < count ) {
+		if( src >= end ) return false;
+		int header = *src++;
+		int n = (header & 0x7F) + 1;
+		if( n > count - i ) return false;
+		if( header & 0x80 ) {
+			if( end - src < bytes ) return false;
+			GLubyte pixel[4] = { src[2], src[1], src[0], (GLubyte)(bytes == 4 ? src[3] : 0xFF) };
+			for( int k = 0; k < n; k++ )
+				memcpy(dst + (i + k)*4, pixel, 4);
+			src += bytes;
+		} else {
+			if( end - src < n * bytes ) return false;
+			if( bytes == 4 )
+				swapRedBlue(src, dst + i*4, n);
+			else
+				expandBGR(src, dst + i*4, n);
+			src += n * bytes;
+		}
+		i += n;
+	}
+	return true;
+}
+
+// Decodes run length packets of bytes sized pixels as they are, for the
+// formats that are kept native.
+bool decodeRLECopy( const GLubyte * src, size_t size, int bytes, GLubyte * dst, int count ) {
+	const GLubyte * end = src + size;
+	int i = 0;
+	while( i < count ) {
+		if( src >= end ) return false;
+		int header = *src++;
+		int n = (header & 0x7F) + 1;
+		if( n > count - i ) return false;
+		if( header & 0x80 ) {
+			if( end - src < bytes ) return false;
+			for( int k = 0; k < n; k++ )
+				memcpy(dst + (i + k) * bytes, src, bytes);
+			src += bytes;
+		} else {
+			if( end - src < n * bytes ) return false;
+			memcpy(dst + i * bytes, src, n * bytes);
+			src += n * bytes;
+		}
+		i += n;
+	}
+	return true;
+}
+
+// Appends count BGRA pixels as type 10 packets. Two or more equal pixels
+// make a run packet, everything else goes into raw packets.
+void encodeRLE( const GLubyte * src, int count, std::vector<GLubyte> & out ) {
+	int i = 0;
+	while( i < count ) {
+		int run = 1;
+		while( run < 128 && i + run < count && pixelAt(src, i + run) == pixelAt(src, i) ) run++;
+		if( run > 1 ) {
+			out.push_back((GLubyte)(0x80 | (run - 1)));
+			out.insert(out.end(), src + i*4, src + i*4 + 4);
+			i += run;
+			continue;
+		}
+		// Raw up to where the next run starts
+		int n = 1;
+		while( n < 128 && i + n < count &&
+		       !(i + n + 1 < count && pixelAt(src, i + n) == pixelAt(src, i + n + 1)) ) n++;
+		out.push_back((GLubyte)(n - 1));
+		out.insert(out.end(), src + i*4, src + (i + n)*4);
+		i += n;
+	}
+}
+
+// Puts rows stored top to bottom (descriptor bit 5) or pixels stored right
+// to left (bit 4) into the bottom to top, left to right order GL expects
+void orient( GLubyte * p, int width, int height, int bytes, int descriptor ) {
+	size_t rowBytes = (size_t)width * bytes;
+	if( descriptor & 0x20 ) {
+		std::vector<GLubyte> row(rowBytes);
+		for( int y = 0; y < height / 2; y++ ) {
+			GLubyte * a = p + y * rowBytes;
+			GLubyte * b = p + (height - 1 - y) * rowBytes;
+			memcpy(&row[0], a, rowBytes);
+			memcpy(a, b, rowBytes);
+			memcpy(b, &row[0], rowBytes);
+		}
+	}
+	if( descriptor & 0x10 ) {
+		GLubyte pixel[4];
+		for( int y = 0; y < height; y++ ) {
+			GLubyte * r = p + y * rowBytes;
+			for( int x = 0; x < width / 2; x++ ) {
+				GLubyte * a = r + x * bytes;
+				GLubyte * b = r + (width - 1 - x) * bytes;
+				memcpy(pixel, a, bytes);
+				memcpy(a, b, bytes);
+				memcpy(b, pixel, bytes);
+			}
+		}
+	}
+}
+
+// The name of fName with suffix added, in the system's temporary directory
+// rather than next to the assets
+std::string tempName( const char * fName, const char * suffix ) {
+	const char * dir = getenv("TEMP");
+	if( !dir ) dir = getenv("TMPDIR");
+	if( !dir ) dir = "/tmp";
+	const char * base = fName;
+	for( const char * c = fName; *c; c++ ) {
+		if( *c == '/' || *c == '\\' ) base = c + 1;
+	}
+	return std::string(dir) + "/" + base + suffix;
+}
+
+} // Anonymous namespace
+
 namespace LE {
 
 int readShort(ifstream & stream) {
@@ -57,17 +247,17 @@ GLubyte * read( const char * fName, int & width, int & height ) throw(IOExceptio
 		
 		int idLen = inFile.get();      // Length of image ID field
 		int mapType = inFile.get();    // Color map type (expect 0 == no color map)
-		int typeCode = inFile.get();   // Image type code (expect 2 == uncompressed)
+		int typeCode = inFile.get();   // Image type code (expect 2 == uncompressed, 10 == RLE)
 		inFile.ignore(5);              // Color map info (ignored)
 		int xOrigin = LE::readShort(inFile);  // X origin
 		int yOrigin = LE::readShort(inFile);  // Y origin
 		width = LE::readShort(inFile);        // Image width
 		height = LE::readShort(inFile);       // Image height
 		int bpp = inFile.get();               // Bits per pixel (expect 24 or 32)
-		inFile.ignore();                      // Image descriptor (expect 0 for 24bpp and 8 for 32bpp)
+		int descriptor = inFile.get();        // Image descriptor (alpha bits, bit 4 right to left, bit 5 top to bottom)
 		
-		if( typeCode != 2 || mapType != 0 ) {
-			throw IOException("File does not appear to be a non-color-mapped, uncompressed TGA image");
+		if( (typeCode != 2 && typeCode != 10) || mapType != 0 ) {
+			throw IOException("File does not appear to be a non-color-mapped, uncompressed or RLE TGA image");
 		}
 		
 		if( bpp != 24 && bpp != 32 ) {
@@ -83,20 +273,45 @@ GLubyte * read( const char * fName, int & width, int & height ) throw(IOExceptio
 		       xOrigin, yOrigin);
 		
 		// Read pixel data
-		GLubyte *p = new GLubyte[width * height * 4];
 		// 24 bpp -- Blue, Green, Red
 		// 32 bpp -- Blue, Green, Red, Alpha
 		// p -- stored as RGBA
-		for( unsigned int i = 0; i < (unsigned int)(width * height) ; i++ )
-		{
-			p[i*4 + 2] = inFile.get();  // Blue
-			p[i*4 + 1] = inFile.get();  // Green
-			p[i*4    ] = inFile.get();  // Red 
-			if( bpp == 32 )
-				p[i*4 + 3] = inFile.get();
-			else
-				p[i*4 + 3] = 0xFF;
+		int count = width * height;
+		GLubyte *p = new GLubyte[count * 4];
+		if( typeCode == 10 ) {
+			// Packets don't say how long they are up front, so take the rest
+			// of the file in one read and decode from memory
+			std::streampos start = inFile.tellg();
+			inFile.seekg(0, std::ios::end);
+			std::streamoff size = inFile.tellg() - start;
+			inFile.seekg(start);
+			std::vector<GLubyte> packets(size > 0 ? (size_t)size : 1);
+			inFile.read((char *)&packets[0], size);
+			if( size <= 0 || inFile.gcount() != size || !decodeRLE(&packets[0], (size_t)size, bpp, p, count) ) {
+				delete [] p;
+				throw IOException("Corrupt or truncated RLE pixel data");
+			}
+		} else if( bpp == 32 ) {
+			// Already the final size, read it in place and swizzle
+			inFile.read((char *)p, (std::streamsize)count * 4);
+			if( inFile.gcount() != (std::streamsize)count * 4 ) {
+				delete [] p;
+				throw IOException("Unexpected end of file in pixel data");
+			}
+			swapRedBlue(p, p, count);
+		} else {
+			std::vector<GLubyte> block((count < BLOCK_PIXELS ? count : BLOCK_PIXELS) * 3);
+			for( int first = 0; first < count; first += BLOCK_PIXELS ) {
+				int n = (count - first < BLOCK_PIXELS) ? count - first : BLOCK_PIXELS;
+				inFile.read((char *)&block[0], (std::streamsize)n * 3);
+				if( inFile.gcount() != (std::streamsize)n * 3 ) {
+					delete [] p;
+					throw IOException("Unexpected end of file in pixel data");
+				}
+				expandBGR(&block[0], p + first*4, n);
+			}
 		}
+		orient(p, width, height, 4, descriptor);
 		
 		inFile.close();
 		return p;
@@ -107,7 +322,131 @@ GLubyte * read( const char * fName, int & width, int & height ) throw(IOExceptio
 	}
 }
 
-void write( GLubyte * pd, int width, int height, const char * fName) throw(IOException) {
+int bytesPerPixel( PixelFormat format ) {
+	switch( format ) {
+		case GRAY8:   return 1;
+		case GRAY16:  return 2;
+		case GRAY8A8: return 2;
+		case BGR5A1:  return 2;
+		default:      return 4;
+	}
+}
+
+GLubyte * readNative( const char * fName, int & width, int & height, PixelFormat & format ) throw(IOException) {
+	
+	std::ifstream inFile(fName, std::ios::binary);
+	
+	if (!inFile) {
+		std::string msg = std::string("Error: can't open ") + fName ;
+		throw IOException(msg);
+	}
+	
+	int idLen = inFile.get();
+	int mapType = inFile.get();
+	int typeCode = inFile.get();   // 2 == true color, 3 == grayscale, + 8 for RLE
+	inFile.ignore(9);
+	width = LE::readShort(inFile);
+	height = LE::readShort(inFile);
+	int bpp = inFile.get();
+	int descriptor = inFile.get();
+	
+	bool rle = (typeCode & 8) != 0;
+	int baseType = typeCode & ~8;
+	if( mapType != 0 || (baseType != 2 && baseType != 3) ) {
+		throw IOException("File does not appear to be a non-color-mapped TGA image");
+	}
+	if( baseType == 3 && bpp == 8 ) {
+		format = GRAY8;
+	} else if( baseType == 3 && bpp == 16 && (descriptor & 0x0F) == 0 ) {
+		format = GRAY16;
+	} else if( baseType == 3 && bpp == 16 && (descriptor & 0x0F) == 8 ) {
+		format = GRAY8A8;
+	} else if( baseType == 3 && bpp == 16 ) {
+		throw IOException("16 bpp grayscale must have 0 or 8 alpha bits");
+	} else if( baseType == 2 && bpp == 16 ) {
+		format = BGR5A1;
+	} else if( baseType == 2 && (bpp == 24 || bpp == 32) ) {
+		// No native GL format to keep, these go through the RGBA path
+		inFile.close();
+		format = RGBA8;
+		return read(fName, width, height);
+	} else {
+		throw IOException("File must be 8 or 16 bpp grayscale or 16, 24 or 32 bpp color");
+	}
+	if( idLen > 0 ) inFile.ignore(idLen);
+	
+	printf("%s: (%d x %d) %d bpp %s native\n", fName, width, height, bpp,
+	       format == BGR5A1 ? "color" : (format == GRAY8A8 ? "grayscale and alpha" : "grayscale"));
+	
+	// Samples stay as stored, 16 bit values are little endian like the host
+	int count = width * height;
+	int bytes = bpp / 8;
+	GLubyte *p = new GLubyte[(size_t)count * bytes];
+	if( rle ) {
+		std::streampos start = inFile.tellg();
+		inFile.seekg(0, std::ios::end);
+		std::streamoff size = inFile.tellg() - start;
+		inFile.seekg(start);
+		std::vector<GLubyte> packets(size > 0 ? (size_t)size : 1);
+		inFile.read((char *)&packets[0], size);
+		if( size <= 0 || inFile.gcount() != size || !decodeRLECopy(&packets[0], (size_t)size, bytes, p, count) ) {
+			delete [] p;
+			throw IOException("Corrupt or truncated RLE pixel data");
+		}
+	} else {
+		inFile.read((char *)p, (std::streamsize)count * bytes);
+		if( inFile.gcount() != (std::streamsize)count * bytes ) {
+			delete [] p;
+			throw IOException("Unexpected end of file in pixel data");
+		}
+	}
+	orient(p, width, height, bytes, descriptor);
+	
+	inFile.close();
+	return p;
+}
+
+GLubyte * readByByte( const char * fName, int & width, int & height ) throw(IOException) {
+	
+	std::ifstream inFile(fName, std::ios::binary);
+	
+	if (!inFile) {
+		std::string msg = std::string("Error: can't open ") + fName ;
+		throw IOException(msg);
+	}
+	
+	int idLen = inFile.get();
+	int mapType = inFile.get();
+	int typeCode = inFile.get();
+	inFile.ignore(9);
+	width = LE::readShort(inFile);
+	height = LE::readShort(inFile);
+	int bpp = inFile.get();
+	int descriptor = inFile.get();
+	
+	if( typeCode != 2 || mapType != 0 || (bpp != 24 && bpp != 32) ) {
+		throw IOException("File must be an uncompressed 24 or 32 bpp TGA image");
+	}
+	if( idLen > 0 ) inFile.ignore(idLen);
+	
+	GLubyte *p = new GLubyte[width * height * 4];
+	for( unsigned int i = 0; i < (unsigned int)(width * height) ; i++ )
+	{
+		p[i*4 + 2] = inFile.get();  // Blue
+		p[i*4 + 1] = inFile.get();  // Green
+		p[i*4    ] = inFile.get();  // Red 
+		if( bpp == 32 )
+			p[i*4 + 3] = inFile.get();
+		else
+			p[i*4 + 3] = 0xFF;
+	}
+	
+	inFile.close();
+	orient(p, width, height, 4, descriptor);
+	return p;
+}
+
+void write( GLubyte * pd, int width, int height, const char * fName, bool rle) throw(IOException) {
 	
 	std::ofstream oFile(fName, std::ios::binary);
 	
@@ -122,7 +461,7 @@ void write( GLubyte * pd, int width, int height, const char * fName) throw(IOExc
 		
 		oFile.put(0);          // Length of image ID field
 		oFile.put(0);          // Color map type (0 == no color map)
-		oFile.put(2);          // Image type code (2 == uncompressed)
+		oFile.put(rle ? 10 : 2);  // Image type code (2 == uncompressed, 10 == RLE)
 		oFile.write(zero, 5);  // Color map info (ignored)
 		oFile.write(zero, 2);  // X origin (0)
 		oFile.write(zero, 2);  // Y origin (0)
@@ -131,13 +470,30 @@ void write( GLubyte * pd, int width, int height, const char * fName) throw(IOExc
 		oFile.put(32);               // Bits per pixel (32)
 		oFile.put(8);                // Image descriptor (8 => 32bpp)
 		
-		for( int i = 0; i < (width * height); i++ ) {
-			oFile.put( pd[i*4 + 2] );  // Blue
-			oFile.put( pd[i*4 + 1] );  // Green
-			oFile.put( pd[i*4    ] );  // Red 
-			oFile.put( pd[i*4 + 3] );  // alpha
+		// Back to Blue, Green, Red, Alpha a block of rows at a time, packets
+		// never cross a row
+		int blockRows = (width > 0 && width < BLOCK_PIXELS) ? BLOCK_PIXELS / width : 1;
+		std::vector<GLubyte> block((size_t)blockRows * width * 4 + 1);
+		std::vector<GLubyte> packets;
+		for( int row = 0; row < height; row += blockRows ) {
+			int rows = (height - row < blockRows) ? height - row : blockRows;
+			int n = rows * width;
+			swapRedBlue(pd + (size_t)row * width * 4, &block[0], n);
+			if( rle ) {
+				packets.clear();
+				for( int r = 0; r < rows; r++ )
+					encodeRLE(&block[(size_t)r * width * 4], width, packets);
+				if( !packets.empty() )
+					oFile.write((const char *)&packets[0], (std::streamsize)packets.size());
+			} else {
+				oFile.write((const char *)&block[0], (std::streamsize)n * 4);
+			}
 		}
 		
+		if( ! oFile ) {
+			std::string msg = std::string("Error writing ") + fName;
+			throw IOException(msg);
+		}
 		oFile.close();
 		
 	} catch(IOException & e) {
@@ -148,18 +504,270 @@ void write( GLubyte * pd, int width, int height, const char * fName) throw(IOExc
 	
 }
 
-GLuint loadTex(const char* fName, GLint & width, GLint &height) {
+void writeByByte( GLubyte * pd, int width, int height, const char * fName) throw(IOException) {
+	
+	std::ofstream oFile(fName, std::ios::binary);
+	
+	if( ! oFile ) {
+		std::string msg = std::string("Unable to open file ") + fName +
+			std::string(" for writing.");
+		throw IOException(msg);
+	}
+	
+	const char zero[] = {0,0,0,0,0};
+	
+	oFile.put(0);
+	oFile.put(0);
+	oFile.put(2);
+	oFile.write(zero, 5);
+	oFile.write(zero, 2);
+	oFile.write(zero, 2);
+	LE::writeShort(oFile, width);
+	LE::writeShort(oFile, height);
+	oFile.put(32);
+	oFile.put(8);
+	
+	for( int i = 0; i < (width * height); i++ ) {
+		oFile.put( pd[i*4 + 2] );  // Blue
+		oFile.put( pd[i*4 + 1] );  // Green
+		oFile.put( pd[i*4    ] );  // Red 
+		oFile.put( pd[i*4 + 3] );  // alpha
+	}
+	
+	oFile.close();
+}
+
+bool benchmark( const char * fName, int runs ) {
+	std::string outName = tempName(fName, ".bench.tga");
+	std::string outRefName = tempName(fName, ".benchref.tga");
+	try {
+		int w, h, wRef, hRef;
+		double readMs = 0.0, readRefMs = 0.0, writeMs = 0.0, writeRefMs = 0.0;
+		bool same = true;
+		for( int run = 0; run < runs; run++ ) {
+			Timer timer;
+			GLubyte *fast = read(fName, w, h);
+			readMs += timer.elapsedMs();
+			timer.reset();
+			GLubyte *slow = readByByte(fName, wRef, hRef);
+			readRefMs += timer.elapsedMs();
+			same = same && w == wRef && h == hRef && memcmp(fast, slow, w * h * 4) == 0;
+
+			timer.reset();
+			write(fast, w, h, outName.c_str());
+			writeMs += timer.elapsedMs();
+			timer.reset();
+			writeByByte(slow, w, h, outRefName.c_str());
+			writeRefMs += timer.elapsedMs();
+			delete [] fast;
+			delete [] slow;
+		}
+
+		// Both writers have to produce the same file
+		std::ifstream a(outName.c_str(), std::ios::binary), b(outRefName.c_str(), std::ios::binary);
+		std::vector<char> fileA((std::istreambuf_iterator<char>(a)), std::istreambuf_iterator<char>());
+		std::vector<char> fileB((std::istreambuf_iterator<char>(b)), std::istreambuf_iterator<char>());
+		a.close();
+		b.close();
+		same = same && fileA == fileB;
+		remove(outName.c_str());
+		remove(outRefName.c_str());
+
+		// Same pixels through the RLE encoder and decoder
+		GLubyte *original = read(fName, w, h);
+		Timer timer;
+		write(original, w, h, outName.c_str(), true);
+		double encodeMs = timer.elapsedMs();
+		double decodeMs = 0.0;
+		for( int run = 0; run < runs; run++ ) {
+			timer.reset();
+			GLubyte *decoded = read(outName.c_str(), wRef, hRef);
+			decodeMs += timer.elapsedMs();
+			same = same && w == wRef && h == hRef && memcmp(original, decoded, w * h * 4) == 0;
+			delete [] decoded;
+		}
+		delete [] original;
+		std::ifstream packed(outName.c_str(), std::ios::binary | std::ios::ate);
+		double packedSize = (double)packed.tellg();
+		packed.close();
+		remove(outName.c_str());
+
+		double mb = runs * (double)w * h * 4 / 1048576.0;
+		printf("TGAIO: %s read %.2f ms (%.0f MB/s) vs %.2f ms per byte, write %.2f ms (%.0f MB/s) vs %.2f ms, %s\n",
+		       fName, readMs / runs, mb / (readMs * 0.001 + 1e-9), readRefMs / runs,
+		       writeMs / runs, mb / (writeMs * 0.001 + 1e-9), writeRefMs / runs,
+		       same ? "identical" : "MISMATCH");
+		printf("TGAIO: RLE %.1f%% of uncompressed, encode %.2f ms, decode %.2f ms (%.0f MB/s of pixels)\n",
+		       100.0 * packedSize / ((double)w * h * 4 + 18), encodeMs, decodeMs / runs,
+		       mb / (decodeMs * 0.001 + 1e-9));
+		return same;
+	}
+	catch (IOException & e) {
+		printf("TGAIO: benchmark of %s failed: %s\n", fName, e.what());
+		remove(outName.c_str());
+		remove(outRefName.c_str());
+		return false;
+	}
+}
+
+GLuint loadTex(const char* fName, GLint & width, GLint &height, BlockCompressor::Quality quality) {
 	GLubyte * data = TGAIO::read(fName, width, height);
 
+	MipChain mips;
+	mips.build(data, width, height, 4, width * 4, ThreadPool::shared());
+
+	// BC1 unless some pixel isn't opaque
+	BlockCompressor::Format format = BlockCompressor::BC1;
+	for( int i = 0; i < width * height; i++ ) {
+		if( data[i*4 + 3] != 0xFF ) {
+			format = BlockCompressor::BC3;
+			break;
+		}
+	}
+	GLenum internalFormat = BlockCompressor::glFormat(format);
+
 	GLuint texID;
 	glGenTextures(1, &texID);
 
 	glBindTexture(GL_TEXTURE_2D, texID);
 
-        // Allocate storage
-        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
-        // Copy data into storage
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        // Allocate storage for the whole chain
+        glTexStorage2D(GL_TEXTURE_2D, MipChain::levelCount(width, height), internalFormat, width, height);
+	// Compress every level into storage
+	BlockCompressor compressor;
+	std::vector<GLubyte> blocks;
+	double encodeMs = 0.0;
+	size_t bytes = 0;
+	for( int level = 0; level < MipChain::levelCount(width, height); level++ ) {
+		const GLubyte * pixels = data;
+		int w = width, h = height;
+		if( level > 0 ) {
+			const MipChain::Level & mip = mips.getLevels()[level - 1];
+			pixels = &mip.pixels[0];
+			w = mip.width;
+			h = mip.height;
+		}
+		compressor.compress(pixels, w, h, format, quality, ThreadPool::shared(), blocks);
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, w, h, internalFormat,
+					  (GLsizei)blocks.size(), &blocks[0]);
+		encodeMs += compressor.getStats().encodeMs;
+		bytes += blocks.size();
+	}
+	printf("%s: %s %s, %.1f MB for the chain (%.1fx smaller) encoded in %.1f ms\n", fName,
+	       format == BlockCompressor::BC1 ? "BC1" : "BC3", quality == BlockCompressor::HIGH ? "high" : "fast",
+	       bytes / 1048576.0, width * height * 4 * 4.0 / 3.0 / bytes, encodeMs);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+	delete [] data;
+
+	return texID;
+}
+
+GLuint loadTexMapped(const char* fName, GLint & width, GLint & height, bool mips) {
+	MappedFile file;
+	if( !file.open(fName) ) {
+		std::string msg = std::string("Error: can't open ") + fName ;
+		throw IOException(msg);
+	}
+
+	const GLubyte * header = file.bytes();
+	if( file.size() < 18 ) {
+		throw IOException("File is too short for a TGA header");
+	}
+	int idLen = header[0];
+	int mapType = header[1];
+	int typeCode = header[2];
+	width = header[12] | (header[13] << 8);
+	height = header[14] | (header[15] << 8);
+	int bpp = header[16];
+	int descriptor = header[17];
+	size_t offset = 18 + idLen;
+	size_t rowBytes = (size_t)width * (bpp / 8);
+
+	// Only uncompressed, left to right pixels can go to GL straight from the
+	// mapping, anything else takes the copying path
+	if( typeCode != 2 || mapType != 0 || (bpp != 24 && bpp != 32) || (descriptor & 0x10) ||
+	    file.size() < offset + rowBytes * height ) {
+		file.close();
+		return loadTex(fName, width, height, BlockCompressor::FAST);
+	}
+
+	const GLubyte * pixels = file.bytes() + offset;
+	bool topDown = (descriptor & 0x20) != 0;
+	MipChain chain;
+	if( mips ) {
+		if( topDown )
+			chain.build(pixels + (height - 1) * rowBytes, width, height, bpp / 8, -(ptrdiff_t)rowBytes, ThreadPool::shared());
+		else
+			chain.build(pixels, width, height, bpp / 8, (ptrdiff_t)rowBytes, ThreadPool::shared());
+		printf("%s: (%d x %d) %d bpp mapped, %d mip levels in %.1f ms\n", fName, width, height, bpp,
+		       chain.getStats().levels, chain.getStats().buildMs);
+	} else {
+		printf("%s: (%d x %d) %d bpp mapped\n", fName, width, height, bpp);
+	}
+
+	GLuint texID;
+	glGenTextures(1, &texID);
+	glBindTexture(GL_TEXTURE_2D, texID);
+	glTexStorage2D(GL_TEXTURE_2D, mips ? MipChain::levelCount(width, height) : 1, GL_RGBA8, width, height);
+
+	// 24 bpp rows needn't be 4 byte aligned, GL swizzles BGR(A) on upload
+	GLint alignment;
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	GLenum format = (bpp == 32) ? GL_BGRA : GL_BGR;
+	if( topDown ) {
+		// Top to bottom rows, flipped by uploading them one at a time
+		for( int y = 0; y < height; y++ )
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, height - 1 - y, width, 1, format, GL_UNSIGNED_BYTE, pixels + y * rowBytes);
+	} else {
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, pixels);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+	// The levels keep the file's channel order with alpha added
+	if( mips )
+		chain.upload(GL_BGRA);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mips ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+
+	return texID;
+}
+
+GLuint loadTexNative(const char* fName, GLint & width, GLint & height) {
+	PixelFormat format;
+	GLubyte * data = readNative(fName, width, height, format);
+
+	GLenum internalFormat = GL_RGBA8, pixelFormat = GL_RGBA, type = GL_UNSIGNED_BYTE;
+	if( format == GRAY8 ) {
+		internalFormat = GL_R8;
+		pixelFormat = GL_RED;
+	} else if( format == GRAY16 ) {
+		internalFormat = GL_R16;
+		pixelFormat = GL_RED;
+		type = GL_UNSIGNED_SHORT;
+	} else if( format == GRAY8A8 ) {
+		internalFormat = GL_RG8;
+		pixelFormat = GL_RG;
+	} else if( format == BGR5A1 ) {
+		internalFormat = GL_RGB5_A1;
+		pixelFormat = GL_BGRA;
+		type = GL_UNSIGNED_SHORT_1_5_5_5_REV;
+	}
+
+	GLuint texID;
+	glGenTextures(1, &texID);
+	glBindTexture(GL_TEXTURE_2D, texID);
+	glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, width, height);
+
+	// 1 and 2 byte rows are only byte aligned
+	GLint alignment;
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, pixelFormat, type, data);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -171,8 +779,8 @@ GLuint loadTex(const char* fName, GLint & width, GLint &height) {
 
 GLuint loadTex(const char* fName) {
 	GLint w,h;
-	return TGAIO::loadTex(fName, w, h);
+	return TGAIO::loadTex(fName, w, h, BlockCompressor::FAST);
 }
 
 
-} // Namespace TGAIO
+} // Namespace TGAIO
\ No newline at end of file
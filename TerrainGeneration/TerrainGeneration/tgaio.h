@@ -2,6 +2,7 @@
 #define _TGAIO_H
 
 #include "GLIncludes.h"
+#include "BlockCompressor.h"
 
 #include <stdexcept>
 #include <string>
@@ -36,10 +37,97 @@ namespace TGAIO {
 	
     }
     
+    /**
+     * Reads an uncompressed (type 2) or RLE (type 10) 24 or 32 bpp TGA file
+     * into a new RGBA buffer.
+     * The pixel data is read in large blocks and swizzled with SSE where
+     * available.  Rows come back bottom to top and left to right whichever
+     * way the descriptor says the file stores them, the order GL expects.
+     * @return the pixels, to be freed with delete []
+     */
     GLubyte * read( const char * fName, /*out*/ int & width, /*out*/ int & height ) throw(IOException);
-    void write( GLubyte * pixelData, int width, int height, const char * fName ) throw(IOException);
     
-    GLuint loadTex( const char * fileName, GLint &width /*out*/, GLint &height /*out*/ );
+    /**
+     * Pixel layouts readNative can return.
+     */
+    enum PixelFormat {
+        GRAY8,    // 1 byte
+        GRAY16,   // 2 bytes, little endian
+        GRAY8A8,  // 2 bytes, gray then alpha
+        BGR5A1,   // 2 bytes, 16 bpp color as stored
+        RGBA8     // 4 bytes, 24 and 32 bpp color expanded like read()
+    };
+    
+    int bytesPerPixel( PixelFormat format );
+    
+    /**
+     * Reads a TGA file keeping grayscale (type 3 and 11, 8 or 16 bpp) and
+     * 16 bpp color pixels in their stored format instead of expanding them
+     * to RGBA.  16 bpp grayscale is GRAY16 when the descriptor gives no
+     * alpha bits and GRAY8A8 when it gives 8.  24 and 32 bpp color comes
+     * back as RGBA8 through read().
+     * Rows are put in the same order as read() puts them.
+     * @return the pixels, bytesPerPixel(format) each, to be freed with delete []
+     */
+    GLubyte * readNative( const char * fName, /*out*/ int & width, /*out*/ int & height,
+                          /*out*/ PixelFormat & format ) throw(IOException);
+    
+    /**
+     * Writes RGBA pixel data as a 32 bpp TGA file.
+     * @param rle true to write run length encoded (type 10) data
+     */
+    void write( GLubyte * pixelData, int width, int height, const char * fName, bool rle = false ) throw(IOException);
+    
+    /**
+     * The original byte at a time reader and writer, kept as the reference
+     * for benchmark().  The reader orients its output the same way read() does.
+     */
+    GLubyte * readByByte( const char * fName, /*out*/ int & width, /*out*/ int & height ) throw(IOException);
+    void writeByByte( GLubyte * pixelData, int width, int height, const char * fName ) throw(IOException);
+    
+    /**
+     * Times read() and write() against the byte at a time versions on the
+     * given file and checks they produce the same pixels and files, then
+     * reports the size and decode speed of the same image RLE encoded.
+     * The files it writes go to the temporary directory and are removed
+     * again, whether it succeeds or not.
+     * @param runs the number of times each is run
+     * @return true if the results are identical
+     */
+    bool benchmark( const char * fileName, int runs );
+    
+    /**
+     * Loads a TGA file into a block compressed OpenGL texture, BC1 if every
+     * pixel is opaque and BC3 otherwise, with a gamma correct mip chain.
+     * @param quality the encoder's speed / quality trade off
+     */
+    GLuint loadTex( const char * fileName, GLint &width /*out*/, GLint &height /*out*/,
+                    BlockCompressor::Quality quality = BlockCompressor::FAST );
+    
+    /**
+     * Loads a TGA file into an OpenGL texture by mapping the file and
+     * uploading the BGR(A) pixels straight from the mapping, so the base
+     * level is never copied.  Files with top to bottom rows are uploaded a
+     * row at a time; RLE and right to left files fall back to loadTex.  The
+     * texture is left uncompressed so the base level needs no CPU pass.
+     * With mips it gets a gamma correct mip chain in immutable storage like
+     * loadTex, built from the mapped rows: the levels take a third of the
+     * base's pixel count at 4 bytes each, plus 16 bytes per pixel of level 1
+     * while they are built.  Without, nothing beyond the mapping is allocated.
+     * @param fileName the file name of the TGA file.
+     * @param mips true for the mip chain, by default the texture has a single
+     *        level, which is the case the zero copy upload is for
+     * @return the texture ID
+     */
+    GLuint loadTexMapped( const char * fileName, GLint &width /*out*/, GLint &height /*out*/, bool mips = false );
+    
+    /**
+     * Loads a TGA file through readNative into a single level texture of
+     * the matching format, R8, R16, RG8, RGB5_A1 or RGBA8.
+     * @param fileName the file name of the TGA file.
+     * @return the texture ID
+     */
+    GLuint loadTexNative( const char * fileName, GLint &width /*out*/, GLint &height /*out*/ );
     
     /**
      * Loads a TGA file into an OpenGL texture.  This method only supports